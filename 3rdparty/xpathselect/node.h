@@ -23,9 +23,12 @@
 #include <list>
 #include <memory>
 #include <cstdint>
+#include <functional>
 
 namespace xpathselect
 {
+    struct XPathQueryPart;
+
     /// Represents a node in the object tree. Provide an implementation of
     /// this class in your own code.
     class Node
@@ -49,8 +52,45 @@ namespace xpathselect
         /// Return a list of the children of this node.
         virtual std::vector<Node::Ptr> Children() const =0;
 
+        /// Return the children of this node that a search for 'part' needs to
+        /// visit. Children may be left out if neither they nor any node below
+        /// them can match 'part'. Nodes whose children are expensive to create
+        /// (e.g. the items of a large model) should override this to create
+        /// only the ones a query can touch. The default returns all children.
+        virtual std::vector<Node::Ptr> ChildrenFor(XPathQueryPart const& /*part*/) const
+        {
+            return Children();
+        }
+
         /// Return a pointer to the parent class.
         virtual Node::Ptr GetParent() const =0;
+
+        /// Get std::hash<std::string> of the node's name. Query parts compare
+        /// this before comparing names, so implementations that can cache the
+        /// hash should override it.
+        virtual std::size_t GetNameHash() const
+        {
+            return std::hash<std::string>()(GetName());
+        }
+
+        /// Return true if the node is of type 'type_name', or of a type derived
+        /// from it. Used for 'is:Type' node tests. 'type_name_hash' is
+        /// std::hash of 'type_name'. Without type information, only the node
+        /// name is compared.
+        virtual bool IsOfType(std::string const& type_name, std::size_t type_name_hash) const
+        {
+            return GetNameHash() == type_name_hash && GetName() == type_name;
+        }
+
+        /// Add all nodes in the subtree rooted at this node (including the
+        /// node itself) that match 'part' to 'matches'. Implementations that
+        /// can do better than a breadth-first traversal, e.g. by looking the
+        /// nodes up in an index, should override this. Return false (leaving
+        /// 'matches' untouched) to have the subtree traversed instead.
+        virtual bool FindDescendants(XPathQueryPart const& /*part*/, std::list<Node::Ptr>& /*matches*/) const
+        {
+            return false;
+        }
     };
 
     /// NodeList is how we return lists of nodes.
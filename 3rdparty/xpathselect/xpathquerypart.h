@@ -22,6 +22,7 @@
 #include <vector>
 #include <memory>
 #include <iostream>
+#include <functional>
 
 #include <boost/optional/optional.hpp>
 #include <boost/variant/variant.hpp>
@@ -47,16 +48,75 @@ namespace xpathselect
     struct XPathQueryPart
     {
     public:
-        XPathQueryPart() {}
+        XPathQueryPart()
+        : name_hash_(0)
+        , has_name_hash_(false)
+        , is_type_test_(false)
+        , follows_search_(false)
+        {}
         XPathQueryPart(std::string node_name)
         : node_name_(node_name)
+        , name_hash_(0)
+        , has_name_hash_(false)
+        , is_type_test_(false)
+        , follows_search_(false)
         {}
 
         enum class QueryPartType {Normal, Search, Parent};
 
+        // Called once the query part has been parsed. Caches the hash of the
+        // node name, so that Matches can reject nodes with a different name
+        // without comparing strings, and recognises 'is:Type' node tests.
+        // 'follows_search' is true if the part comes after a search token.
+        void PrepareNodeTest(bool follows_search = false)
+        {
+            follows_search_ = follows_search;
+            const std::string type_test_prefix("is:");
+            is_type_test_ = node_name_.compare(0, type_test_prefix.size(), type_test_prefix) == 0;
+            type_name_ = is_type_test_ ? node_name_.substr(type_test_prefix.size()) : node_name_;
+            name_hash_ = std::hash<std::string>()(type_name_);
+            has_name_hash_ = true;
+        }
+
+        // True for 'is:Type' node tests, which match nodes of type 'Type' and
+        // of all types derived from it.
+        bool IsTypeTest() const
+        {
+            return is_type_test_;
+        }
+
+        // True if the part is searched for in whole subtrees ('//part'),
+        // false if it is matched against direct children only.
+        bool SearchesDescendants() const
+        {
+            return follows_search_;
+        }
+
+        // True if a node called 'name' can match this part, for nodes whose
+        // type is nothing but their name.
+        bool MayMatchName(std::string const& name) const
+        {
+            if (node_name_ == "*")
+                return true;
+            return (is_type_test_ ? type_name_ : node_name_) == name;
+        }
+
+        bool MatchesName(Node::Ptr const& node) const
+        {
+            if (node_name_ == "*")
+                return true;
+            if (is_type_test_)
+                return node->IsOfType(type_name_, name_hash_);
+            if (has_name_hash_ && node->GetNameHash() != name_hash_)
+                return false;
+            return node->GetName() == node_name_;
+        }
+
         bool Matches(Node::Ptr const& node) const
         {
-            bool matches = (node_name_ == "*" || node->GetName() == node_name_);
+            bool matches = MatchesName(node);
+            if (!matches)
+                return false;
             if (!parameter.empty())
             {
                 for (auto param : parameter)
@@ -105,6 +165,13 @@ namespace xpathselect
 
         std::string node_name_;
         ParamList parameter;
+
+    private:
+        std::string type_name_;
+        std::size_t name_hash_;
+        bool has_name_hash_;
+        bool is_type_test_;
+        bool follows_search_;
     };
 
 
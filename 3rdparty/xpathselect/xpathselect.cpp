@@ -37,6 +37,12 @@ namespace xpathselect
             auto end = query.cend();
             if (boost::spirit::qi::parse(begin, end, grammar, query_parts) && (begin == end))
             {
+                bool follows_search = false;
+                for (auto& part : query_parts)
+                {
+                    part.PrepareNodeTest(follows_search);
+                    follows_search = part.Type() == XPathQueryPart::QueryPartType::Search;
+                }
 #ifdef DEBUG
                 std::cout << "Query parts are: ";
                 for (auto n : query_parts)
@@ -58,6 +64,9 @@ namespace xpathselect
             NodeList matches;
             for (auto root: start_points)
             {
+                if (root->FindDescendants(next_match, matches))
+                    continue;
+
                 // non-recursive BFS traversal to find starting points:
                 std::queue<Node::Ptr> queue;
                 queue.push(root);
@@ -71,8 +80,9 @@ namespace xpathselect
                         // with the same node name.
                         matches.push_back(node);
                     }
-                    // Add all children of current node to queue.
-                    for(Node::Ptr child : node->Children())
+                    // Add all children of current node to queue, except for
+                    // those that can't lead to a match.
+                    for(Node::Ptr child : node->ChildrenFor(next_match))
                     {
                         queue.push(child);
                     }
@@ -146,10 +156,16 @@ namespace xpathselect
             if (next_query_part != query_parts.cend()
                 && next_query_part->Type() != XPathQueryPart::QueryPartType::Parent)
             {
+                // the children are matched against the next part, or searched
+                // for the part after the search token:
+                auto child_part = next_query_part;
+                if (child_part->Type() == XPathQueryPart::QueryPartType::Search
+                    && child_part + 1 != query_parts.cend())
+                    ++child_part;
                 NodeList new_start_nodes;
                 for (auto node: start_nodes)
                 {
-                    auto children = node->Children();
+                    auto children = node->ChildrenFor(*child_part);
                     if (children.size())
                     {
                         new_start_nodes.insert(
@@ -16,7 +16,12 @@ HEADERS = *.h
 target.file = libxpathselect*
 INSTALLS += target
 
-unix:macx {
+unix {
+  # linked into the (shared) driver library:
   CONFIG += staticlib
+  QMAKE_CXXFLAGS += -fPIC
+}
+
+unix:macx {
   INCLUDEPATH += /usr/local/opt/boost/include/
 }
@@ -21,6 +21,12 @@ enum autopilot_type_id
     TYPE_COLOR = 4,
     TYPE_DATETIME = 5,
     TYPE_TIME = 6,
+
+    // Driver extensions, only sent to clients that ask for them:
+
+    /// A string, byte array or string list left out for its size (see
+    /// TraversalOptions::max_value_size), as [type, length, sha1].
+    TYPE_TRUNCATED = 100,
 };
 
 #endif
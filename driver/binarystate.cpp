@@ -0,0 +1,478 @@
+#include "binarystate.h"
+
+#include <QColor>
+#include <QDateTime>
+#include <QHash>
+#include <QPair>
+#include <QPoint>
+#include <QRect>
+#include <QSize>
+#include <QStringList>
+#include <QTime>
+
+#include <cstring>
+#include <vector>
+
+const char BINARY_STATE_MAGIC[] = "APQB";
+
+// Assigns each string an index, the first time it is added.
+class StringTable
+{
+public:
+    int Add(QString const& string)
+    {
+        auto found = indices_.constFind(string);
+        if (found != indices_.constEnd())
+            return *found;
+        int index = strings_.size();
+        indices_.insert(string, index);
+        strings_.append(string);
+        return index;
+    }
+
+    QStringList const& Strings() const { return strings_; }
+
+private:
+    QHash<QString, int> indices_;
+    QStringList strings_;
+};
+
+// The values of one name and kind, as they are written.
+struct Column
+{
+    Column() : name(0), kind(PropertyRecord::Packed), rows(0), last_node(0) {}
+
+    int name;
+    PropertyRecord::Kind kind;
+    int rows;
+    int last_node;
+    QByteArray nodes;
+    QByteArray values;
+};
+
+// Reads the binary state format. Once the data turns out to be cut short or
+// malformed, ok() is false and everything read returns 0.
+class Reader
+{
+public:
+    explicit Reader(QByteArray const& data)
+        : data_(data), position_(0), ok_(true)
+    {}
+
+    bool ok() const { return ok_; }
+
+    int Fail()
+    {
+        ok_ = false;
+        return 0;
+    }
+
+    quint8 Byte()
+    {
+        if (!ok_ || position_ >= data_.size())
+            return Fail();
+        return quint8(data_.at(position_++));
+    }
+
+    quint64 Varint()
+    {
+        quint64 value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            quint8 byte = Byte();
+            value |= quint64(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return ok_ ? value : 0;
+        }
+        return Fail();
+    }
+
+    qint64 Signed()
+    {
+        quint64 value = Varint();
+        return qint64(value >> 1) ^ -qint64(value & 1);
+    }
+
+    double Double()
+    {
+        quint64 bits = 0;
+        for (int i = 0; i < 8; ++i)
+            bits |= quint64(Byte()) << (8 * i);
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    QByteArray Bytes(int size)
+    {
+        if (!ok_ || size > data_.size() - position_)
+        {
+            Fail();
+            return QByteArray();
+        }
+        position_ += size;
+        return data_.mid(position_ - size, size);
+    }
+
+    // A count of items that take at least a byte each, so it can't be more
+    // than the bytes left.
+    int Count()
+    {
+        quint64 count = Varint();
+        if (count > quint64(data_.size() - position_))
+            return Fail();
+        return int(count);
+    }
+
+    // An index into a table of 'size' entries.
+    int Index(int size)
+    {
+        quint64 index = Varint();
+        if (index >= quint64(size))
+            return Fail();
+        return int(index);
+    }
+
+private:
+    QByteArray const& data_;
+    int position_;
+    bool ok_;
+};
+
+void WriteVarint(QByteArray& out, quint64 value);
+void WriteSigned(QByteArray& out, qint64 value);
+void WriteDouble(QByteArray& out, double value);
+void WriteValue(QByteArray& out, PropertyRecord const& record, int index, StringTable& strings);
+void WritePackedItem(QByteArray& out, QVariant const& item, StringTable& strings);
+QVariant ReadValue(Reader& reader, PropertyRecord::Kind kind, QStringList const& strings);
+QVariant ReadPacked(Reader& reader, QStringList const& strings);
+int ComponentCount(PropertyRecord::Kind kind);
+
+QByteArray EncodeBinaryState(QList<NodeIntrospectionData> const& state)
+{
+    StringTable strings;
+    QByteArray paths;
+    std::vector<Column> columns;
+    QHash<QPair<int, int>, int> column_indices;
+
+    WriteVarint(paths, state.size());
+    QStringList previous_path;
+    for (int node = 0; node < state.size(); ++node)
+    {
+        NodeIntrospectionData const& data = state.at(node);
+
+        QStringList path = data.object_path.split('/');
+        int common = 0;
+        while (common < path.size() && common < previous_path.size() && path.at(common) == previous_path.at(common))
+            ++common;
+        WriteVarint(paths, common);
+        WriteVarint(paths, path.size() - common);
+        for (int i = common; i < path.size(); ++i)
+            WriteVarint(paths, strings.Add(path.at(i)));
+        previous_path = path;
+
+        for (int i = 0; i < data.state.size(); ++i)
+        {
+            PropertyRecord::Kind kind = data.state.KindAt(i);
+            QPair<int, int> key(strings.Add(data.state.NameAt(i)), kind);
+            auto found = column_indices.constFind(key);
+            int column_index = found != column_indices.constEnd() ? *found : int(columns.size());
+            if (found == column_indices.constEnd())
+            {
+                column_indices.insert(key, column_index);
+                columns.push_back(Column());
+                columns.back().name = key.first;
+                columns.back().kind = kind;
+            }
+
+            Column& column = columns[column_index];
+            WriteVarint(column.nodes, node - column.last_node);
+            column.last_node = node;
+            ++column.rows;
+            WriteValue(column.values, data.state, i, strings);
+        }
+    }
+
+    // The string table is complete only now, but goes first:
+    QByteArray data(BINARY_STATE_MAGIC, 4);
+    data.append(char(BINARY_STATE_VERSION));
+    WriteVarint(data, strings.Strings().size());
+    foreach (QString const& string, strings.Strings())
+    {
+        QByteArray utf8 = string.toUtf8();
+        WriteVarint(data, utf8.size());
+        data.append(utf8);
+    }
+    data.append(paths);
+    WriteVarint(data, columns.size());
+    for (Column const& column : columns)
+    {
+        WriteVarint(data, column.name);
+        data.append(char(column.kind));
+        WriteVarint(data, column.rows);
+        data.append(column.nodes);
+        data.append(column.values);
+    }
+    return data;
+}
+
+bool DecodeBinaryState(QByteArray const& data, QList<NodeIntrospectionData>& state)
+{
+    Reader reader(data);
+    if (reader.Bytes(4) != QByteArray(BINARY_STATE_MAGIC, 4) || reader.Byte() != BINARY_STATE_VERSION)
+        return false;
+
+    QStringList strings;
+    int string_count = reader.Count();
+    for (int i = 0; i < string_count && reader.ok(); ++i)
+        strings.append(QString::fromUtf8(reader.Bytes(reader.Count())));
+
+    QList<NodeIntrospectionData> nodes;
+    QStringList path;
+    int node_count = reader.Count();
+    for (int node = 0; node < node_count && reader.ok(); ++node)
+    {
+        int common = reader.Index(path.size() + 1);
+        int added = reader.Count();
+        path = path.mid(0, common);
+        for (int i = 0; i < added && reader.ok(); ++i)
+            path.append(strings.value(reader.Index(strings.size())));
+
+        NodeIntrospectionData data;
+        data.object_path = path.join('/');
+        nodes.append(data);
+    }
+
+    int column_count = reader.Count();
+    for (int column = 0; column < column_count && reader.ok(); ++column)
+    {
+        QString name = strings.value(reader.Index(strings.size()));
+        quint8 kind = reader.Byte();
+        if (kind > PropertyRecord::Packed)
+            return false;
+
+        int rows = reader.Count();
+        std::vector<int> row_nodes(rows);
+        int node = 0;
+        for (int row = 0; row < rows && reader.ok(); ++row)
+        {
+            node += reader.Index(nodes.size() - node);
+            row_nodes[row] = node;
+        }
+        for (int row = 0; row < rows && reader.ok(); ++row)
+        {
+            PropertyRecord& record = nodes[row_nodes[row]].state;
+            if (kind == PropertyRecord::Packed)
+                record.SetPacked(name, ReadPacked(reader, strings));
+            else
+                record.Set(name, ReadValue(reader, PropertyRecord::Kind(kind), strings));
+        }
+    }
+
+    if (!reader.ok())
+        return false;
+    state = nodes;
+    return true;
+}
+
+void WriteVarint(QByteArray& out, quint64 value)
+{
+    while (value >= 0x80)
+    {
+        out.append(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+// Zigzag encoding, so that small negative numbers take few bytes as well:
+void WriteSigned(QByteArray& out, qint64 value)
+{
+    WriteVarint(out, (quint64(value) << 1) ^ quint64(value >> 63));
+}
+
+void WriteDouble(QByteArray& out, double value)
+{
+    quint64 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    for (int i = 0; i < 8; ++i)
+        out.append(char(bits >> (8 * i)));
+}
+
+void WriteValue(QByteArray& out, PropertyRecord const& record, int index, StringTable& strings)
+{
+    PropertyRecord::Kind kind = record.KindAt(index);
+    switch (kind)
+    {
+    case PropertyRecord::Bool:
+        out.append(char(record.IntegerAt(index)));
+        break;
+    case PropertyRecord::Int:
+    case PropertyRecord::LongLong:
+        WriteSigned(out, record.IntegerAt(index));
+        break;
+    case PropertyRecord::UInt:
+    case PropertyRecord::DateTime:
+        WriteVarint(out, quint64(record.IntegerAt(index)));
+        break;
+    case PropertyRecord::ULongLong:
+        WriteVarint(out, record.UnsignedAt(index));
+        break;
+    case PropertyRecord::Double:
+        WriteDouble(out, record.DoubleAt(index));
+        break;
+    case PropertyRecord::String:
+        WriteVarint(out, strings.Add(record.StringAt(index)));
+        break;
+    case PropertyRecord::StringList:
+        WriteVarint(out, record.StringListAt(index).size());
+        foreach (QString const& string, record.StringListAt(index))
+            WriteVarint(out, strings.Add(string));
+        break;
+    case PropertyRecord::Point:
+    case PropertyRecord::Rect:
+    case PropertyRecord::Size:
+    case PropertyRecord::Color:
+    case PropertyRecord::Time:
+        for (int component = 0; component < ComponentCount(kind); ++component)
+            WriteSigned(out, record.ComponentAt(index, component));
+        break;
+    case PropertyRecord::Packed:
+    {
+        QVariantList items = record.PackedAt(index).toList();
+        WriteVarint(out, items.size());
+        foreach (QVariant const& item, items)
+            WritePackedItem(out, item, strings);
+        break;
+    }
+    }
+}
+
+// Packed values hold the types PackProperty passes on, and the ints and
+// strings of their [type, values...] lists. Anything else is sent as a string.
+void WritePackedItem(QByteArray& out, QVariant const& item, StringTable& strings)
+{
+    switch (item.userType())
+    {
+    case QVariant::Bool:
+        out.append(char(PropertyRecord::Bool));
+        out.append(char(item.toBool() ? 1 : 0));
+        break;
+    case QVariant::Int:
+        out.append(char(PropertyRecord::Int));
+        WriteSigned(out, item.toInt());
+        break;
+    case QVariant::UInt:
+        out.append(char(PropertyRecord::UInt));
+        WriteVarint(out, item.toUInt());
+        break;
+    case QVariant::LongLong:
+        out.append(char(PropertyRecord::LongLong));
+        WriteSigned(out, item.toLongLong());
+        break;
+    case QVariant::ULongLong:
+        out.append(char(PropertyRecord::ULongLong));
+        WriteVarint(out, item.toULongLong());
+        break;
+    case QVariant::Double:
+    case QMetaType::Float:
+        out.append(char(PropertyRecord::Double));
+        WriteDouble(out, item.toDouble());
+        break;
+    case QVariant::StringList:
+        out.append(char(PropertyRecord::StringList));
+        WriteVarint(out, item.toStringList().size());
+        foreach (QString const& string, item.toStringList())
+            WriteVarint(out, strings.Add(string));
+        break;
+    default:
+        out.append(char(PropertyRecord::String));
+        WriteVarint(out, strings.Add(item.toString()));
+        break;
+    }
+}
+
+QVariant ReadValue(Reader& reader, PropertyRecord::Kind kind, QStringList const& strings)
+{
+    int components[4] = { 0, 0, 0, 0 };
+    for (int component = 0; component < ComponentCount(kind); ++component)
+        components[component] = int(reader.Signed());
+
+    switch (kind)
+    {
+    case PropertyRecord::Bool:
+        return QVariant(reader.Byte() != 0);
+    case PropertyRecord::Int:
+        return QVariant(int(reader.Signed()));
+    case PropertyRecord::UInt:
+        return QVariant(uint(reader.Varint()));
+    case PropertyRecord::LongLong:
+        return QVariant(qlonglong(reader.Signed()));
+    case PropertyRecord::ULongLong:
+        return QVariant(qulonglong(reader.Varint()));
+    case PropertyRecord::Double:
+        return QVariant(reader.Double());
+    case PropertyRecord::String:
+        return QVariant(strings.value(reader.Index(strings.size())));
+    case PropertyRecord::StringList:
+    {
+        QStringList list;
+        int count = reader.Count();
+        for (int i = 0; i < count && reader.ok(); ++i)
+            list.append(strings.value(reader.Index(strings.size())));
+        return QVariant(list);
+    }
+    case PropertyRecord::Point:
+        return QVariant(QPoint(components[0], components[1]));
+    case PropertyRecord::Rect:
+        return QVariant(QRect(components[0], components[1], components[2], components[3]));
+    case PropertyRecord::Size:
+        return QVariant(QSize(components[0], components[1]));
+    case PropertyRecord::Color:
+        return QVariant(QColor(components[0], components[1], components[2], components[3]));
+    case PropertyRecord::DateTime:
+#if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
+        return QVariant(QDateTime::fromSecsSinceEpoch(qint64(uint(reader.Varint()))));
+#else
+        return QVariant(QDateTime::fromTime_t(uint(reader.Varint())));
+#endif
+    case PropertyRecord::Time:
+        return QVariant(QTime(components[0], components[1], components[2], components[3]));
+    case PropertyRecord::Packed:
+        return ReadPacked(reader, strings);
+    }
+    return QVariant();
+}
+
+QVariant ReadPacked(Reader& reader, QStringList const& strings)
+{
+    QVariantList items;
+    int count = reader.Count();
+    for (int i = 0; i < count && reader.ok(); ++i)
+    {
+        quint8 kind = reader.Byte();
+        if (kind > PropertyRecord::StringList)
+        {
+            reader.Fail();
+            break;
+        }
+        items.append(ReadValue(reader, PropertyRecord::Kind(kind), strings));
+    }
+    return items;
+}
+
+int ComponentCount(PropertyRecord::Kind kind)
+{
+    switch (kind)
+    {
+    case PropertyRecord::Point:
+    case PropertyRecord::Size:
+        return 2;
+    case PropertyRecord::Rect:
+    case PropertyRecord::Color:
+    case PropertyRecord::Time:
+        return 4;
+    default:
+        return 0;
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef BINARYSTATE_H
+#define BINARYSTATE_H
+
+#include "qtnode.h"
+
+#include <QByteArray>
+#include <QList>
+
+/// The version of the binary state format that EncodeBinaryState writes.
+/// Clients learn it from GetCapabilities and pass it to GetStateBinary.
+const int BINARY_STATE_VERSION = 1;
+
+/// Encode 'state' in the binary state format, the compact alternative to the
+/// a(sv) reply of GetState:
+///
+///   "APQB", then the version as one byte.
+///   The string table: a count, then each string as its UTF-8 length and
+///   bytes. Property names, path components (class names) and string values
+///   are stored once per reply and referred to by index.
+///   The node count, then each node's path, front-coded: the number of
+///   '/'-separated components it shares with the previous node's path, the
+///   number of components that follow, and those components.
+///   The columns: a count, then per column the name, the PropertyRecord::Kind
+///   (one byte) and a row count, the node of each row (as the difference to
+///   the node of the previous row) and the value of each row.
+///
+/// Counts, indices and unsigned values are varints (7 bits per byte, least
+/// significant first), signed values are zigzag encoded varints and doubles
+/// are 8 byte little-endian IEEE 754. A Bool is one byte. A StringList is a
+/// count and string indices. Point and Size values have 2 signed components,
+/// Rect, Color and Time values have 4. Packed values (e.g. TYPE_TRUNCATED
+/// ones) are a count of items, each a Kind byte and a value as above.
+///
+/// Columns hold the values of one name and kind; a name that has values of
+/// different kinds on different nodes has a column per kind.
+QByteArray EncodeBinaryState(QList<NodeIntrospectionData> const& state);
+
+/// Decode 'data' as written by EncodeBinaryState. Return false if it isn't in
+/// the binary state format or is cut short.
+bool DecodeBinaryState(QByteArray const& data, QList<NodeIntrospectionData>& state);
+
+#endif // BINARYSTATE_H
@@ -7,6 +7,8 @@ by the Free Software Foundation.
 */
 
 #include "dbus_adaptor.h"
+#include "binarystate.h"
+#include "sealedmemfd.h"
 #include <QtCore/QMetaObject>
 #include <QtCore/QByteArray>
 #include <QtCore/QList>
@@ -37,7 +39,6 @@ AutopilotAdaptor::~AutopilotAdaptor()
 void AutopilotAdaptor::GetState(const QString &piece, const QDBusMessage &message)
 {
     message.setDelayedReply(true);
-    QDBusMessage reply = message.createReply();
 
     // handle method call com.canonical.Unity.Debug.Introspection.GetState
     QMetaObject::invokeMethod(
@@ -45,7 +46,7 @@ void AutopilotAdaptor::GetState(const QString &piece, const QDBusMessage &messag
                 "GetState",
                 Qt::QueuedConnection,
                 Q_ARG(QString, piece),
-                Q_ARG(QDBusMessage, reply)
+                Q_ARG(QDBusMessage, message)
                 );
 }
 
@@ -56,3 +57,14 @@ void AutopilotAdaptor::GetVersion(const QDBusMessage &message)
     QDBusConnection::sessionBus().send(reply);
 }
 
+void AutopilotAdaptor::GetCapabilities(const QDBusMessage &message)
+{
+    QVariantMap capabilities;
+    capabilities["version"] = AutopilotAdaptor::WIRE_PROTO_VERSION;
+    capabilities["binaryStateVersion"] = BINARY_STATE_VERSION;
+    capabilities["fdReplies"] = SealedMemfdSupported();
+
+    QDBusMessage reply = message.createReply();
+    reply << QVariant(capabilities);
+    QDBusConnection::sessionBus().send(reply);
+}
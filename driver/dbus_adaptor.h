@@ -32,6 +32,9 @@ class AutopilotAdaptor: public QDBusAbstractAdaptor
 "     <method name='GetVersion'>"
 "       <arg type='s' name='version' direction='out' />"
 "     </method>"
+"     <method name='GetCapabilities'>"
+"       <arg type='a{sv}' name='capabilities' direction='out' />"
+"     </method>"
 "  </interface>\n"
         "")
 public:
@@ -43,6 +46,11 @@ public: // PROPERTIES
 public Q_SLOTS: // METHODS
     void GetState(const QString &piece, const QDBusMessage &message);
     void GetVersion(const QDBusMessage &message);
+    /// Reply with what this driver supports beyond GetState: "version" (the
+    /// same as GetVersion), "binaryStateVersion", the binary state format
+    /// version for com.canonical.Autopilot.Qt.GetStateBinary, and "fdReplies",
+    /// whether GetStateBinaryFd can be used.
+    void GetCapabilities(const QDBusMessage &message);
 Q_SIGNALS: // SIGNALS
 };
 
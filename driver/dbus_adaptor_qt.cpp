@@ -68,3 +68,161 @@ void AutopilotQtSpecificAdaptor::InvokeMethod(int object_id, QString method_name
                 Q_ARG(QDBusMessage, message)
                 );
 }
+
+void AutopilotQtSpecificAdaptor::SetPropertyProfilingEnabled(bool enabled)
+{
+    QMetaObject::invokeMethod(
+                parent(),
+                "SetPropertyProfilingEnabled",
+                Qt::QueuedConnection,
+                Q_ARG(bool, enabled)
+                );
+}
+
+void AutopilotQtSpecificAdaptor::GetPropertyReadCosts(int count, const QDBusMessage &message)
+{
+    message.setDelayedReply(true);
+    QMetaObject::invokeMethod(
+                parent(),
+                "GetPropertyReadCosts",
+                Qt::QueuedConnection,
+                Q_ARG(int, count),
+                Q_ARG(QDBusMessage, message)
+                );
+}
+
+void AutopilotQtSpecificAdaptor::ResetPropertyReadCosts()
+{
+    QMetaObject::invokeMethod(
+                parent(),
+                "ResetPropertyReadCosts",
+                Qt::QueuedConnection
+                );
+}
+
+void AutopilotQtSpecificAdaptor::SetPropertyCostLimit(int microseconds)
+{
+    QMetaObject::invokeMethod(
+                parent(),
+                "SetPropertyCostLimit",
+                Qt::QueuedConnection,
+                Q_ARG(int, microseconds)
+                );
+}
+
+void AutopilotQtSpecificAdaptor::SetExcludedProperties(QString class_name, QStringList properties)
+{
+    QMetaObject::invokeMethod(
+                parent(),
+                "SetExcludedProperties",
+                Qt::QueuedConnection,
+                Q_ARG(QString, class_name),
+                Q_ARG(QStringList, properties)
+                );
+}
+
+void AutopilotQtSpecificAdaptor::GetStateWithOptions(QString piece, QVariantMap options, const QDBusMessage &message)
+{
+    message.setDelayedReply(true);
+    QMetaObject::invokeMethod(
+                parent(),
+                "GetStateWithOptions",
+                Qt::QueuedConnection,
+                Q_ARG(QString, piece),
+                Q_ARG(QVariantMap, options),
+                Q_ARG(QDBusMessage, message)
+                );
+}
+
+void AutopilotQtSpecificAdaptor::GetStateBinary(QString piece, QVariantMap options, int version, const QDBusMessage &message)
+{
+    message.setDelayedReply(true);
+    QMetaObject::invokeMethod(
+                parent(),
+                "GetStateBinary",
+                Qt::QueuedConnection,
+                Q_ARG(QString, piece),
+                Q_ARG(QVariantMap, options),
+                Q_ARG(int, version),
+                Q_ARG(QDBusMessage, message)
+                );
+}
+
+void AutopilotQtSpecificAdaptor::GetStateBinaryFd(QString piece, QVariantMap options, int version, const QDBusMessage &message)
+{
+    message.setDelayedReply(true);
+    QMetaObject::invokeMethod(
+                parent(),
+                "GetStateBinaryFd",
+                Qt::QueuedConnection,
+                Q_ARG(QString, piece),
+                Q_ARG(QVariantMap, options),
+                Q_ARG(int, version),
+                Q_ARG(QDBusMessage, message)
+                );
+}
+
+void AutopilotQtSpecificAdaptor::GetGeometry(QString piece, const QDBusMessage &message)
+{
+    message.setDelayedReply(true);
+    QMetaObject::invokeMethod(
+                parent(),
+                "GetGeometry",
+                Qt::QueuedConnection,
+                Q_ARG(QString, piece),
+                Q_ARG(QDBusMessage, message)
+                );
+}
+
+void AutopilotQtSpecificAdaptor::GetNodesAt(int x, int y, const QDBusMessage &message)
+{
+    message.setDelayedReply(true);
+    QMetaObject::invokeMethod(
+                parent(),
+                "GetNodesAt",
+                Qt::QueuedConnection,
+                Q_ARG(int, x),
+                Q_ARG(int, y),
+                Q_ARG(QDBusMessage, message)
+                );
+}
+
+void AutopilotQtSpecificAdaptor::GetNodesIn(int x, int y, int width, int height, const QDBusMessage &message)
+{
+    message.setDelayedReply(true);
+    QMetaObject::invokeMethod(
+                parent(),
+                "GetNodesIn",
+                Qt::QueuedConnection,
+                Q_ARG(int, x),
+                Q_ARG(int, y),
+                Q_ARG(int, width),
+                Q_ARG(int, height),
+                Q_ARG(QDBusMessage, message)
+                );
+}
+
+void AutopilotQtSpecificAdaptor::GetPropertyChunk(int object_id, QString name, int offset, int length, const QDBusMessage &message)
+{
+    message.setDelayedReply(true);
+    QMetaObject::invokeMethod(
+                parent(),
+                "GetPropertyChunk",
+                Qt::QueuedConnection,
+                Q_ARG(int, object_id),
+                Q_ARG(QString, name),
+                Q_ARG(int, offset),
+                Q_ARG(int, length),
+                Q_ARG(QDBusMessage, message)
+                );
+}
+
+void AutopilotQtSpecificAdaptor::SetSpatialIndexEnabled(bool enabled)
+{
+    QMetaObject::invokeMethod(
+                parent(),
+                "SetSpatialIndexEnabled",
+                Qt::QueuedConnection,
+                Q_ARG(bool, enabled)
+                );
+}
@@ -34,6 +34,67 @@ class AutopilotQtSpecificAdaptor : public QDBusAbstractAdaptor
                 "      <arg type='av' name='arguments' direction='in' />"
                 "    </method>"
                 ""
+                "    <method name='SetPropertyProfilingEnabled'>"
+                "      <arg type='b' name='enabled' direction='in' />"
+                "    </method>"
+                "    <method name='GetPropertyReadCosts'>"
+                "      <arg type='i' name='count' direction='in' />"
+                "      <arg type='av' name='costs' direction='out' />"
+                "    </method>"
+                "    <method name='ResetPropertyReadCosts'>"
+                "    </method>"
+                "    <method name='SetPropertyCostLimit'>"
+                "      <arg type='i' name='microseconds' direction='in' />"
+                "    </method>"
+                "    <method name='SetExcludedProperties'>"
+                "      <arg type='s' name='class_name' direction='in' />"
+                "      <arg type='as' name='properties' direction='in' />"
+                "    </method>"
+                ""
+                "    <method name='GetStateWithOptions'>"
+                "      <arg type='s' name='piece' direction='in' />"
+                "      <arg type='a{sv}' name='options' direction='in' />"
+                "      <arg type='a(sv)' name='state' direction='out' />"
+                "    </method>"
+                "    <method name='GetStateBinary'>"
+                "      <arg type='s' name='piece' direction='in' />"
+                "      <arg type='a{sv}' name='options' direction='in' />"
+                "      <arg type='i' name='version' direction='in' />"
+                "      <arg type='ay' name='state' direction='out' />"
+                "    </method>"
+                "    <method name='GetStateBinaryFd'>"
+                "      <arg type='s' name='piece' direction='in' />"
+                "      <arg type='a{sv}' name='options' direction='in' />"
+                "      <arg type='i' name='version' direction='in' />"
+                "      <arg type='h' name='state' direction='out' />"
+                "    </method>"
+                "    <method name='GetGeometry'>"
+                "      <arg type='s' name='piece' direction='in' />"
+                "      <arg type='a(sv)' name='state' direction='out' />"
+                "    </method>"
+                "    <method name='GetNodesAt'>"
+                "      <arg type='i' name='x' direction='in' />"
+                "      <arg type='i' name='y' direction='in' />"
+                "      <arg type='a(sv)' name='state' direction='out' />"
+                "    </method>"
+                "    <method name='GetNodesIn'>"
+                "      <arg type='i' name='x' direction='in' />"
+                "      <arg type='i' name='y' direction='in' />"
+                "      <arg type='i' name='width' direction='in' />"
+                "      <arg type='i' name='height' direction='in' />"
+                "      <arg type='a(sv)' name='state' direction='out' />"
+                "    </method>"
+                "    <method name='GetPropertyChunk'>"
+                "      <arg type='i' name='object_id' direction='in' />"
+                "      <arg type='s' name='name' direction='in' />"
+                "      <arg type='i' name='offset' direction='in' />"
+                "      <arg type='i' name='length' direction='in' />"
+                "      <arg type='v' name='chunk' direction='out' />"
+                "    </method>"
+                "    <method name='SetSpatialIndexEnabled'>"
+                "      <arg type='b' name='enabled' direction='in' />"
+                "    </method>"
+                ""
                 "  </interface>\n"
         "")
 public:
@@ -48,6 +109,21 @@ public slots:
 
     void ListMethods(int object_id, const QDBusMessage& message);
     void InvokeMethod(int object_id, QString method_name, QVariantList args, const QDBusMessage& message);
+
+    void SetPropertyProfilingEnabled(bool enabled);
+    void GetPropertyReadCosts(int count, const QDBusMessage& message);
+    void ResetPropertyReadCosts();
+    void SetPropertyCostLimit(int microseconds);
+    void SetExcludedProperties(QString class_name, QStringList properties);
+
+    void GetStateWithOptions(QString piece, QVariantMap options, const QDBusMessage& message);
+    void GetStateBinary(QString piece, QVariantMap options, int version, const QDBusMessage& message);
+    void GetStateBinaryFd(QString piece, QVariantMap options, int version, const QDBusMessage& message);
+    void GetGeometry(QString piece, const QDBusMessage& message);
+    void GetNodesAt(int x, int y, const QDBusMessage& message);
+    void GetNodesIn(int x, int y, int width, int height, const QDBusMessage& message);
+    void GetPropertyChunk(int object_id, QString name, int offset, int length, const QDBusMessage& message);
+    void SetSpatialIndexEnabled(bool enabled);
     
 };
 
@@ -7,7 +7,11 @@ by the Free Software Foundation.
 */
 
 #include "dbus_object.h"
+#include "binarystate.h"
 #include "introspection.h"
+#include "propertyprofiler.h"
+#include "sealedmemfd.h"
+#include "spatialindex.h"
 #include "qtnode.h"
 
 #include <QList>
@@ -20,9 +24,15 @@ by the Free Software Foundation.
   #include <QApplication>
 #endif
 
+#include <QDateTime>
 #include <QDBusConnection>
+#include <QDBusError>
+#include <QDBusVariant>
 #include <QThread>
 
+// How long GetPropertyChunk keeps a value for the next chunk:
+const qint64 CHUNKED_VALUE_TIMEOUT_MS = 10000;
+
 DBusNode::Ptr GetNodeWithId(int object_id)
 {
     QString query = QString("//*[id=%1]").arg(object_id);
@@ -37,6 +47,14 @@ DBusNode::Ptr GetNodeWithId(int object_id)
     return objects.at(0);
 }
 
+TraversalOptions GetTraversalOptions(QVariantMap const& options)
+{
+    TraversalOptions traversal_options;
+    traversal_options.visible_only = options.value("visibleOnly", false).toBool();
+    traversal_options.max_value_size = options.value("maxValueSize", 0).toInt();
+    return traversal_options;
+}
+
 DBusObject::DBusObject(QObject *parent)
     : QObject(parent)
 {
@@ -55,6 +73,55 @@ void DBusObject::GetState(const QString &piece, const QDBusMessage &msg)
                 );
 }
 
+void DBusObject::GetStateWithOptions(const QString &piece, const QVariantMap &options, const QDBusMessage &msg)
+{
+    _queries.append(Query(piece, msg, GetTraversalOptions(options)));
+
+    QMetaObject::invokeMethod(
+                this,
+                "ProcessQuery",
+                Qt::QueuedConnection
+                );
+}
+
+void DBusObject::GetStateBinary(const QString &piece, const QVariantMap &options, int version, const QDBusMessage &message)
+{
+    QueueBinaryQuery(piece, options, version, message, false);
+}
+
+void DBusObject::GetStateBinaryFd(const QString &piece, const QVariantMap &options, int version, const QDBusMessage &message)
+{
+    QueueBinaryQuery(piece, options, version, message, true);
+}
+
+void DBusObject::QueueBinaryQuery(const QString &piece, const QVariantMap &options, int version,
+                                  const QDBusMessage &message, bool as_fd)
+{
+    if (version != BINARY_STATE_VERSION)
+    {
+        qWarning() << "Binary state version" << version << "requested, only" << BINARY_STATE_VERSION << "is supported.";
+        QDBusConnection::sessionBus().send(message.createErrorReply(QDBusError::NotSupported,
+                                                                    "Unsupported binary state version"));
+        return;
+    }
+    if (as_fd && !SealedMemfdSupported())
+    {
+        QDBusConnection::sessionBus().send(message.createErrorReply(QDBusError::NotSupported,
+                                                                    "File descriptor replies are not supported"));
+        return;
+    }
+
+    Query query(piece, message, GetTraversalOptions(options));
+    query.format = as_fd ? Query::BinaryFd : Query::Binary;
+    _queries.append(query);
+
+    QMetaObject::invokeMethod(
+                this,
+                "ProcessQuery",
+                Qt::QueuedConnection
+                );
+}
+
 void DBusObject::RegisterSignalInterest(int object_id, QString signal_name)
 {
     SignalId signal(object_id, signal_name);
@@ -292,12 +359,139 @@ void DBusObject::InvokeMethod(int object_id, QString method_name, QVariantList a
         qDebug() << "Method invocation failed.";
 }
 
+void DBusObject::SetPropertyProfilingEnabled(bool enabled)
+{
+    PropertyProfiler::Instance().SetEnabled(enabled);
+    qDebug() << "Property read profiling" << (enabled ? "enabled." : "disabled.");
+}
+
+void DBusObject::GetPropertyReadCosts(int count, const QDBusMessage &message)
+{
+    QDBusMessage reply = message.createReply();
+    reply << QVariant(PropertyProfiler::Instance().TopOffenders(count));
+    QDBusConnection::sessionBus().send(reply);
+}
+
+void DBusObject::ResetPropertyReadCosts()
+{
+    PropertyProfiler::Instance().Reset();
+}
+
+void DBusObject::SetPropertyCostLimit(int microseconds)
+{
+    PropertyProfiler::Instance().SetCostLimit(microseconds);
+}
+
+void DBusObject::SetExcludedProperties(QString class_name, QStringList properties)
+{
+    QList<QByteArray> property_names;
+    foreach (const QString &property, properties)
+        property_names.append(property.toLatin1());
+
+    PropertyProfiler::Instance().SetExcludedProperties(class_name.toLatin1(), property_names);
+}
+
+void DBusObject::GetGeometry(QString piece, const QDBusMessage &message)
+{
+    QDBusMessage reply = message.createReply();
+    QVariant var;
+    var.setValue(IntrospectGeometry(piece));
+    reply << var;
+    QDBusConnection::sessionBus().send(reply);
+}
+
+void DBusObject::GetNodesAt(int x, int y, const QDBusMessage &message)
+{
+    QDBusMessage reply = message.createReply();
+    QVariant var;
+    var.setValue(IntrospectNodesAt(QPoint(x, y)));
+    reply << var;
+    QDBusConnection::sessionBus().send(reply);
+}
+
+void DBusObject::GetNodesIn(int x, int y, int width, int height, const QDBusMessage &message)
+{
+    QDBusMessage reply = message.createReply();
+    QVariant var;
+    var.setValue(IntrospectNodesIn(QRect(x, y, width, height)));
+    reply << var;
+    QDBusConnection::sessionBus().send(reply);
+}
+
+void DBusObject::GetPropertyChunk(int object_id, QString name, int offset, int length, const QDBusMessage &message)
+{
+    // Chunks after the first one come from the value read for the first, as
+    // long as the client keeps reading:
+    qint64 now = QDateTime::currentMSecsSinceEpoch();
+    bool continued = offset > 0
+        && chunked_value_.value.isValid()
+        && chunked_value_.object_id == object_id
+        && chunked_value_.name == name
+        && now - chunked_value_.read_at < CHUNKED_VALUE_TIMEOUT_MS;
+    if (!continued)
+    {
+        chunked_value_ = ChunkedValue();
+        DBusNode::Ptr node = GetNodeWithId(object_id);
+        if (node)
+        {
+            chunked_value_.object_id = object_id;
+            chunked_value_.name = name;
+            chunked_value_.value = GetChunkableProperty(node, name);
+        }
+    }
+    chunked_value_.read_at = now;
+
+    QVariant chunk = GetValueChunk(chunked_value_.value, offset, length);
+    // The last chunk ends the session:
+    int size = chunked_value_.value.type() == QVariant::String
+        ? chunked_value_.value.toString().size()
+        : chunked_value_.value.toStringList().size();
+    if (!chunk.isValid() || qint64(offset) + length >= size)
+        chunked_value_ = ChunkedValue();
+
+    if (!chunk.isValid())
+    {
+        qWarning() << "No string or string list property" << name << "on object with id" << object_id;
+        QDBusConnection::sessionBus().send(message.createErrorReply(QDBusError::InvalidArgs, "No such property"));
+        return;
+    }
+
+    QDBusMessage reply = message.createReply();
+    reply << QVariant::fromValue(QDBusVariant(chunk));
+    QDBusConnection::sessionBus().send(reply);
+}
+
+void DBusObject::SetSpatialIndexEnabled(bool enabled)
+{
+    SpatialIndex::Instance().SetEnabled(enabled);
+    qDebug() << "Spatial index" << (enabled ? "enabled." : "disabled.");
+}
+
 void DBusObject::ProcessQuery()
 {
     Query query = _queries.takeFirst();
-    QList<NodeIntrospectionData> state = Introspect(query.first);
+    ScopedTraversalOptions options(query.options);
+    QList<NodeIntrospectionData> state = Introspect(query.piece);
+
+    QDBusMessage msg = query.call.createReply();
+    if (query.format == Query::Binary)
+    {
+        msg << EncodeBinaryState(state);
+        QDBusConnection::sessionBus().send(msg);
+        return;
+    }
+    if (query.format == Query::BinaryFd)
+    {
+        // One write into the memfd; the bus only carries the descriptor.
+        QDBusUnixFileDescriptor fd = CreateSealedMemfd(EncodeBinaryState(state));
+        if (fd.isValid())
+            msg << QVariant::fromValue(fd);
+        else
+            msg = query.call.createErrorReply(QDBusError::Failed, "Unable to write the state to a memfd");
+        QDBusConnection::sessionBus().send(msg);
+        return;
+    }
 
-    QDBusMessage msg = query.second;
     QVariant var;
     var.setValue(state);
     msg << var;
@@ -16,6 +16,9 @@ by the Free Software Foundation.
 #include <QTimer>
 #include <QSignalSpy>
 #include <QSharedPointer>
+#include <QVariantMap>
+
+#include "qtnode.h"
 
 
 class DBusObject : public QObject
@@ -26,6 +29,15 @@ public:
 
 public slots:
     void GetState(const QString &piece, const QDBusMessage& msg);
+    /// Like GetState, with TraversalOptions for this request. The options
+    /// understood are "visibleOnly" (bool) and "maxValueSize" (int).
+    void GetStateWithOptions(const QString &piece, const QVariantMap &options, const QDBusMessage& msg);
+    /// Like GetStateWithOptions, but reply with the state in the binary state
+    /// format (see EncodeBinaryState), if 'version' is BINARY_STATE_VERSION.
+    void GetStateBinary(const QString &piece, const QVariantMap &options, int version, const QDBusMessage& message);
+    /// Like GetStateBinary, but write the state into a sealed memfd and reply
+    /// with its file descriptor, for the client to mmap (see CreateSealedMemfd).
+    void GetStateBinaryFd(const QString &piece, const QVariantMap &options, int version, const QDBusMessage& message);
     void RegisterSignalInterest(int object_id, QString signal_name);
     void GetSignalEmissions(int object_id, QString signal_name, const QDBusMessage &message);
     void ListSignals(int object_id, const QDBusMessage& message);
@@ -33,13 +45,61 @@ public slots:
     void ListMethods(int object_id, const QDBusMessage& message);
     void InvokeMethod(int object_id, QString method_name, QVariantList args, const QDBusMessage &message);
 
+    void SetPropertyProfilingEnabled(bool enabled);
+    void GetPropertyReadCosts(int count, const QDBusMessage &message);
+    /// Forget the read times recorded so far, e.g. between test runs.
+    void ResetPropertyReadCosts();
+    void SetPropertyCostLimit(int microseconds);
+    void SetExcludedProperties(QString class_name, QStringList properties);
+    void GetGeometry(QString piece, const QDBusMessage &message);
+    void GetNodesAt(int x, int y, const QDBusMessage &message);
+    void GetNodesIn(int x, int y, int width, int height, const QDBusMessage &message);
+    /// Reply with part of a string or string list property, for values that
+    /// GetStateWithOptions left out for their size (see "maxValueSize").
+    void GetPropertyChunk(int object_id, QString name, int offset, int length, const QDBusMessage &message);
+    /// Enable or disable the SpatialIndex used by 'intersects' predicates.
+    void SetSpatialIndexEnabled(bool enabled);
+
 private slots:
     void ProcessQuery();
 
 private:
-    typedef QPair<QString, QDBusMessage> Query;
+    void QueueBinaryQuery(const QString &piece, const QVariantMap &options, int version,
+                          const QDBusMessage &message, bool as_fd);
+
+    struct Query
+    {
+        enum Format
+        {
+            VariantList,
+            Binary,
+            BinaryFd,
+        };
+
+        Query(QString const& piece, QDBusMessage const& call, TraversalOptions const& options = TraversalOptions())
+            : piece(piece), call(call), options(options), format(VariantList) {}
+
+        QString piece;
+        // The reply, or the error reply, is created once the query is done:
+        QDBusMessage call;
+        TraversalOptions options;
+        Format format;
+    };
     QQueue<Query> _queries;
 
+    // The value GetPropertyChunk serves chunks from, so that a client reading
+    // a large value chunk by chunk has it looked up and read only once:
+    struct ChunkedValue
+    {
+        ChunkedValue() : object_id(0), read_at(0) {}
+
+        int object_id;
+        QString name;
+        QVariant value;
+        qint64 read_at;
+    };
+    ChunkedValue chunked_value_;
+
     typedef QPair<int, QString> SignalId;
     typedef QSharedPointer<QSignalSpy> SignalSpyPtr;
     QMap<SignalId, SignalSpyPtr> signal_watchers_;
@@ -4,7 +4,7 @@ DEFINES += QT5_SUPPORT
 TARGET = rocketpilot_driver_qt5
 
 DESTDIR=..
-QT = core gui dbus quick quickwidgets widgets testlib
+QT = core gui dbus quick quickwidgets widgets testlib core-private quick-private
 
 win32* {
     CONFIG += c++11
@@ -15,9 +15,6 @@ win32* {
 win32* {
     INCLUDEPATH += $$PWD/../3rdparty/
     LIBS += $$PWD/../3rdparty/xpathselect.lib
-} else:unix:!macx {
-    CONFIG += link_pkgconfig
-    PKGCONFIG += xpathselect
 } else {
     INCLUDEPATH += $$PWD/../3rdparty/
     LIBS += $$PWD/../3rdparty/libxpathselect.a
@@ -31,6 +28,18 @@ SOURCES = qttestability.cpp \
           introspection.cpp \
           rootnode.cpp \
           qtnode.cpp \
+          fastproperties.cpp \
+          propertyprofiler.cpp \
+          propertyrecord.cpp \
+          binarystate.cpp \
+          sealedmemfd.cpp \
+          nodetyperegistry.cpp \
+          nodearena.cpp \
+          nodecache.cpp \
+          modelcache.cpp \
+          objectindex.cpp \
+          spatialindex.cpp \
+          threadbatches.cpp \
           dbus_adaptor_qt.cpp
 
 HEADERS = qttestability.h \
@@ -39,6 +48,18 @@ HEADERS = qttestability.h \
           introspection.h \
           rootnode.h \
           qtnode.h \
+          fastproperties.h \
+          propertyprofiler.h \
+          propertyrecord.h \
+          binarystate.h \
+          sealedmemfd.h \
+          nodetyperegistry.h \
+          nodearena.h \
+          nodecache.h \
+          modelcache.h \
+          objectindex.h \
+          spatialindex.h \
+          threadbatches.h \
           introspection.h \
           dbus_adaptor_qt.h \
           autopilot_types.h
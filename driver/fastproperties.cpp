@@ -0,0 +1,104 @@
+#include "fastproperties.h"
+#include "nodetyperegistry.h"
+
+#include <QtWidgets/QWidget>
+#include <QtGui/QWindow>
+#include <QtQuick/QQuickItem>
+#include <QtQuick/QQuickWindow>
+
+#include <QRect>
+#include <cstring>
+
+// Generates a reader that calls 'Getter' directly on the object. 'T' must be
+// the class that declares 'Getter', and the caller must have made sure that
+// 'object' really is a 'T'.
+template <typename T, typename R, R (T::*Getter)() const>
+QVariant ReadMember(QObject* object)
+{
+    return QVariant::fromValue((static_cast<T*>(object)->*Getter)());
+}
+
+QVariant ReadWidgetGlobalRect(QObject* object)
+{
+    QWidget *w = static_cast<QWidget*>(object);
+    QRect r = w->rect();
+    return QRect(w->mapToGlobal(r.topLeft()), r.size());
+}
+
+QVariant ReadQuickItemGlobalRect(QObject* object)
+{
+    QQuickItem *i = static_cast<QQuickItem*>(object);
+    QQuickWindow *view = i->window();
+    if (!view)
+        return QVariant();
+
+    QRectF bounding_rect = i->mapRectToScene(i->boundingRect());
+    return QRect(view->mapToGlobal(bounding_rect.toRect().topLeft()), bounding_rect.size().toSize());
+}
+
+const FastProperty WIDGET_FAST_PROPERTIES[] = {
+    { "objectName", ReadMember<QObject, QString, &QObject::objectName> },
+    { "x", ReadMember<QWidget, int, &QWidget::x> },
+    { "y", ReadMember<QWidget, int, &QWidget::y> },
+    { "width", ReadMember<QWidget, int, &QWidget::width> },
+    { "height", ReadMember<QWidget, int, &QWidget::height> },
+    { "visible", ReadMember<QWidget, bool, &QWidget::isVisible> },
+    { "enabled", ReadMember<QWidget, bool, &QWidget::isEnabled> },
+    { "windowOpacity", ReadMember<QWidget, qreal, &QWidget::windowOpacity> },
+    { "globalRect", ReadWidgetGlobalRect },
+};
+
+const FastProperty QUICKITEM_FAST_PROPERTIES[] = {
+    { "objectName", ReadMember<QObject, QString, &QObject::objectName> },
+    { "x", ReadMember<QQuickItem, qreal, &QQuickItem::x> },
+    { "y", ReadMember<QQuickItem, qreal, &QQuickItem::y> },
+    { "width", ReadMember<QQuickItem, qreal, &QQuickItem::width> },
+    { "height", ReadMember<QQuickItem, qreal, &QQuickItem::height> },
+    { "visible", ReadMember<QQuickItem, bool, &QQuickItem::isVisible> },
+    { "enabled", ReadMember<QQuickItem, bool, &QQuickItem::isEnabled> },
+    { "opacity", ReadMember<QQuickItem, qreal, &QQuickItem::opacity> },
+    { "globalRect", ReadQuickItemGlobalRect },
+};
+
+const FastProperty WINDOW_FAST_PROPERTIES[] = {
+    { "objectName", ReadMember<QObject, QString, &QObject::objectName> },
+    { "x", ReadMember<QWindow, int, &QWindow::x> },
+    { "y", ReadMember<QWindow, int, &QWindow::y> },
+    { "width", ReadMember<QWindow, int, &QWindow::width> },
+    { "height", ReadMember<QWindow, int, &QWindow::height> },
+    { "visible", ReadMember<QWindow, bool, &QWindow::isVisible> },
+    { "opacity", ReadMember<QWindow, qreal, &QWindow::opacity> },
+};
+
+const FastProperty OBJECT_FAST_PROPERTIES[] = {
+    { "objectName", ReadMember<QObject, QString, &QObject::objectName> },
+};
+
+template <std::size_t N>
+FastPropertyTable MakeTable(const FastProperty (&properties)[N])
+{
+    return FastPropertyTable { properties, properties + N };
+}
+
+FastPropertyTable GetFastProperties(QObject* object)
+{
+    return NodeTypeRegistry::Instance().Handlers(object->metaObject()).fast_properties;
+}
+
+void RegisterBuiltinFastProperties(NodeTypeRegistry& registry)
+{
+    registry.RegisterFastProperties(&QObject::staticMetaObject, MakeTable(OBJECT_FAST_PROPERTIES));
+    registry.RegisterFastProperties(&QWidget::staticMetaObject, MakeTable(WIDGET_FAST_PROPERTIES));
+    registry.RegisterFastProperties(&QQuickItem::staticMetaObject, MakeTable(QUICKITEM_FAST_PROPERTIES));
+    registry.RegisterFastProperties(&QWindow::staticMetaObject, MakeTable(WINDOW_FAST_PROPERTIES));
+}
+
+const FastProperty* FindFastProperty(FastPropertyTable const& table, const char* name)
+{
+    for (const FastProperty* p = table.begin; p != table.end; ++p)
+    {
+        if (std::strcmp(p->name, name) == 0)
+            return p;
+    }
+    return nullptr;
+}
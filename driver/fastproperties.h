@@ -0,0 +1,30 @@
+#ifndef FASTPROPERTIES_H
+#define FASTPROPERTIES_H
+
+#include <QVariant>
+
+class QObject;
+
+/// A well-known property that can be read through a direct C++ getter
+/// instead of QMetaProperty::read.
+struct FastProperty
+{
+    const char* name;
+    QVariant (*read)(QObject* object);
+};
+
+/// The fast properties available for one class. An empty table (begin == end)
+/// means every property has to be read through the meta-object system.
+struct FastPropertyTable
+{
+    const FastProperty* begin;
+    const FastProperty* end;
+};
+
+/// Return the table of fast properties that applies to 'object'.
+FastPropertyTable GetFastProperties(QObject* object);
+
+/// Return the entry for 'name' in 'table', or nullptr if there is none.
+const FastProperty* FindFastProperty(FastPropertyTable const& table, const char* name);
+
+#endif // FASTPROPERTIES_H
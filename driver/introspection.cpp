@@ -8,12 +8,16 @@ by the Free Software Foundation.
 
 
 #include <xpathselect/node.h>
+#include <xpathselect/xpathquerypart.h>
 #include <xpathselect/xpathselect.h>
 
 #include <QDebug>
 
+#include <QtGui/QGuiApplication>
+#include <QtGui/QWindow>
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QGraphicsItem>
+#include <QtWidgets/QGraphicsObject>
 #include <QtWidgets/QGraphicsScene>
 #include <QtWidgets/QGraphicsView>
 #include <QtWidgets/QWidget>
@@ -24,30 +28,47 @@ by the Free Software Foundation.
 #include <QMap>
 #include <QMetaProperty>
 #include <QObject>
+#include <QPair>
 #include <QStringList>
 #include <QVariant>
 #include <QRect>
 #include <QUrl>
 #include <QDateTime>
+#include <QElapsedTimer>
+#include <QCryptographicHash>
+
+#include <cstring>
+#include <queue>
+#include <vector>
 
 #include "autopilot_types.h"
+#include "fastproperties.h"
 #include "introspection.h"
+#include "nodetyperegistry.h"
+#include "propertyprofiler.h"
+#include "propertyrecord.h"
+#include "nodearena.h"
 #include "qtnode.h"
 #include "rootnode.h"
+#include "threadbatches.h"
 
 
 QVariant IntrospectNode(QObject* obj);
 QString GetNodeName(QObject* obj);
-QStringList GetNodeChildNames(QObject* obj);
-void AddCustomProperties(QObject* obj, QVariantMap& properties);
+void AddCustomProperties(QObject* obj, PropertyRecord& properties);
+QObject* GetWrappedObject(xpathselect::Node::Ptr const& node);
+DBusNode::Ptr GetChildNodeAt(QObjectNode::Ptr const& node, QPoint const& global_point);
+DBusNode::Ptr FindObjectNode(xpathselect::NodeVector const& nodes, QObject* object);
+bool ClipsChildren(QObject* object);
 
 QList<NodeIntrospectionData> Introspect(QString const& query_string)
 {
-    QList<NodeIntrospectionData> state;
-    QList<DBusNode::Ptr> node_list = GetNodesThatMatchQuery(query_string);
-    foreach (DBusNode::Ptr obj, node_list)
+    QList<NodeIntrospectionData> state = GetNodesIntrospectionData(GetNodesThatMatchQuery(query_string));
+    int max_value_size = CurrentTraversalOptions().max_value_size;
+    if (max_value_size > 0)
     {
-        state.append(obj->GetIntrospectionData());
+        for (NodeIntrospectionData& data : state)
+            TruncateLargeValues(data.state, max_value_size);
     }
 
     return state;
@@ -55,20 +76,53 @@ QList<NodeIntrospectionData> Introspect(QString const& query_string)
 }
 
 
-QList<DBusNode::Ptr> GetNodesThatMatchQuery(QString const& query_string)
+QList<NodeIntrospectionData> GetNodesIntrospectionData(QList<DBusNode::Ptr> const& nodes)
 {
-    std::shared_ptr<RootNode> root = std::make_shared<RootNode>(QApplication::instance());
-
-    // Add all QWidget top level widgets
-    foreach (const QWidget *widget, QApplication::topLevelWidgets())
+    // Read the properties of objects in other threads first, each thread's
+    // share in that thread, all threads at once:
+    std::vector<PropertyRecord> foreign_properties(nodes.size());
+    std::vector<bool> foreign(nodes.size(), false);
+    // Set by the tasks, in their threads; not a vector<bool>, whose elements
+    // share bytes:
+    std::vector<char> read(nodes.size(), 0);
+    ThreadBatches batches;
+    for (int i = 0; i < nodes.size(); ++i)
     {
-        root->AddChild((QObject*) widget);
+        QObject* object = GetWrappedObject(nodes.at(i));
+        if (!object || !ThreadBatches::IsForeign(object))
+            continue;
+
+        foreign[i] = true;
+        PropertyRecord* properties = &foreign_properties[i];
+        char* was_read = &read[i];
+        batches.Add(object, [object, properties, was_read] {
+            ReadNodeProperties(object, *properties);
+            *was_read = 1;
+        });
     }
-    // Add all QML top level Windows
-    foreach (QWindow *widget, QGuiApplication::allWindows())
+    batches.Run();
+
+    QList<NodeIntrospectionData> state;
+    for (int i = 0; i < nodes.size(); ++i)
     {
-        root->AddChild((QObject*) widget);
+        if (foreign[i])
+        {
+            auto object_node = std::static_pointer_cast<const QObjectNode>(nodes.at(i));
+            state.append(object_node->GetIntrospectionDataFrom(foreign_properties[i], read[i] != 0));
+        }
+        else
+            state.append(nodes.at(i)->GetIntrospectionData());
     }
+    return state;
+}
+
+
+QList<DBusNode::Ptr> GetNodesThatMatchQuery(QString const& query_string)
+{
+    // The root keeps track of the top level widgets and windows itself:
+    std::shared_ptr<RootNode> root = GetRootNode();
+    BeginGeometryPass();
+    BeginQueryArena();
 
     QList<DBusNode::Ptr> node_list;
 
@@ -87,6 +141,230 @@ QList<DBusNode::Ptr> GetNodesThatMatchQuery(QString const& query_string)
 }
 
 
+QList<NodeIntrospectionData> IntrospectGeometry(QString const& query_string)
+{
+    QList<NodeIntrospectionData> geometry;
+
+    // Only the QObject nodes below the matches can have a globalRect, so their
+    // data children need not be created:
+    xpathselect::XPathQueryPart objects("is:QObject");
+    objects.PrepareNodeTest();
+
+    // Breadth first, so that ids are handed out in the same order as in a full
+    // traversal. Paths are extended as the walk goes down instead of being
+    // built from the parent links for every node.
+    std::queue<QPair<DBusNode::Ptr, QString> > queue;
+    foreach (DBusNode::Ptr node, GetNodesThatMatchQuery(query_string))
+        queue.push(qMakePair(node, QString::fromStdString(node->GetPath())));
+    while (!queue.empty())
+    {
+        DBusNode::Ptr node = queue.front().first;
+        QString path = queue.front().second;
+        queue.pop();
+
+        auto object_node = std::dynamic_pointer_cast<const QObjectNode>(node);
+        if (!object_node)
+            continue;
+
+        QRect global_rect;
+        if (object_node->GetGlobalRect(global_rect))
+        {
+            NodeIntrospectionData data;
+            data.object_path = path;
+            data.state.Set("id", object_node->GetId());
+            data.state.Set("globalRect", global_rect);
+            geometry.append(data);
+        }
+
+        for (xpathselect::Node::Ptr const& child : node->ChildrenFor(objects))
+        {
+            queue.push(qMakePair(std::static_pointer_cast<const DBusNode>(child),
+                                 path + '/' + QString::fromStdString(child->GetName())));
+        }
+    }
+    return geometry;
+}
+
+
+QList<DBusNode::Ptr> GetNodesAt(QPoint const& global_point)
+{
+    std::shared_ptr<RootNode> root = GetRootNode();
+    BeginGeometryPass();
+    BeginQueryArena();
+
+    QObject* top_level = nullptr;
+    if (qobject_cast<QApplication*>(QCoreApplication::instance()))
+        top_level = QApplication::topLevelAt(global_point);
+    if (!top_level)
+        top_level = QGuiApplication::topLevelAt(global_point);
+
+    QList<DBusNode::Ptr> stack;
+    DBusNode::Ptr node = FindObjectNode(root->Children(), top_level);
+    while (node)
+    {
+        stack.prepend(node);
+        QObjectNode::Ptr object_node = std::dynamic_pointer_cast<const QObjectNode>(node);
+        if (!object_node)
+            break;
+
+        // The scene's index finds the top-most graphics item, along with its
+        // parent items:
+        QGraphicsView* view = qobject_cast<QGraphicsView*>(object_node->getWrappedObject());
+        if (view && view->childAt(view->mapFromGlobal(global_point)) == view->viewport())
+        {
+            xpathselect::NodeVector items;
+            GetGraphicsItemNodesIn(node, view, QRect(global_point, QSize(1, 1)), items);
+            if (!items.empty())
+            {
+                QList<DBusNode::Ptr> item_stack;
+                for (xpathselect::Node::Ptr item = items.front(); item && item.get() != node.get(); item = item->GetParent())
+                    item_stack.append(std::static_pointer_cast<const DBusNode>(item));
+                stack = item_stack + stack;
+                break;
+            }
+        }
+        node = GetChildNodeAt(object_node, global_point);
+    }
+    return stack;
+}
+
+
+// Return the child of 'node' that is shown at 'global_point' on top of its
+// siblings, or null if there is none.
+DBusNode::Ptr GetChildNodeAt(QObjectNode::Ptr const& node, QPoint const& global_point)
+{
+    QObject* object = node->getWrappedObject();
+    QObject* target = nullptr;
+    if (object->isWidgetType())
+    {
+        QWidget* widget = static_cast<QWidget*>(object);
+        QWidget* child = widget->childAt(widget->mapFromGlobal(global_point));
+        // childAt() finds the deepest child, the direct child is on the way:
+        while (child && child->parentWidget() != widget)
+            child = child->parentWidget();
+        target = child;
+
+        QQuickWidget* quick_widget = qobject_cast<QQuickWidget*>(widget);
+        if (!target && quick_widget && quick_widget->rootObject())
+        {
+            QQuickItem* root_item = quick_widget->rootObject();
+            if (root_item->contains(root_item->mapFromScene(quick_widget->mapFromGlobal(global_point))))
+                target = root_item;
+        }
+    }
+    else if (QQuickItem* item = qobject_cast<QQuickItem*>(object))
+    {
+        if (item->window())
+        {
+            QPointF local_point = item->mapFromScene(item->window()->mapFromGlobal(global_point));
+            target = item->childAt(local_point.x(), local_point.y());
+        }
+    }
+    else if (QQuickWindow* window = qobject_cast<QQuickWindow*>(object))
+    {
+        QPoint window_point = window->mapFromGlobal(global_point);
+        target = window->contentItem()->childAt(window_point.x(), window_point.y());
+    }
+
+    return target ? FindObjectNode(node->ObjectChildren(), target) : DBusNode::Ptr();
+}
+
+
+DBusNode::Ptr FindObjectNode(xpathselect::NodeVector const& nodes, QObject* object)
+{
+    if (!object)
+        return DBusNode::Ptr();
+    for (xpathselect::Node::Ptr const& node : nodes)
+    {
+        if (GetWrappedObject(node) == object)
+            return std::static_pointer_cast<const DBusNode>(node);
+    }
+    return DBusNode::Ptr();
+}
+
+
+QList<DBusNode::Ptr> GetNodesIn(QRect const& global_rect)
+{
+    std::shared_ptr<RootNode> root = GetRootNode();
+    BeginGeometryPass();
+    BeginQueryArena();
+
+    QList<DBusNode::Ptr> nodes;
+    std::queue<xpathselect::Node::Ptr> queue;
+    xpathselect::NodeVector top_level = root->Children();
+    RemoveHiddenChildren(top_level);
+    for (xpathselect::Node::Ptr const& node : top_level)
+        queue.push(node);
+    while (!queue.empty())
+    {
+        QObjectNode::Ptr node = std::dynamic_pointer_cast<const QObjectNode>(queue.front());
+        queue.pop();
+        if (!node)
+            continue;
+
+        QRect rect;
+        bool has_rect = node->GetGlobalRect(rect);
+        bool intersects = has_rect && rect.intersects(global_rect);
+        if (intersects)
+            nodes.append(node);
+        QObject* object = node->getWrappedObject();
+        if (has_rect && !intersects && ClipsChildren(object))
+            continue;
+
+        // The scene's index finds the graphics items, with their children:
+        if (QGraphicsView* view = qobject_cast<QGraphicsView*>(object))
+        {
+            QRect viewport_rect(view->viewport()->mapToGlobal(QPoint(0, 0)), view->viewport()->size());
+            QRect shown_rect = viewport_rect.intersected(global_rect);
+            if (!shown_rect.isEmpty())
+            {
+                xpathselect::NodeVector items;
+                GetGraphicsItemNodesIn(node, view, shown_rect, items);
+                // Bottom-most first, so that parent items come before their
+                // children as in the rest of the list:
+                for (auto item = items.rbegin(); item != items.rend(); ++item)
+                    nodes.append(std::static_pointer_cast<const DBusNode>(*item));
+            }
+        }
+
+        xpathselect::NodeVector children = node->ObjectChildren();
+        RemoveHiddenChildren(children);
+        for (xpathselect::Node::Ptr const& child : children)
+            queue.push(child);
+    }
+    return nodes;
+}
+
+
+// Return true if the children of 'object' aren't shown outside of its bounds.
+bool ClipsChildren(QObject* object)
+{
+    if (object->isWidgetType())
+        return true;
+    if (QQuickItem* item = qobject_cast<QQuickItem*>(object))
+        return item->clip();
+    return false;
+}
+
+
+QList<NodeIntrospectionData> IntrospectNodesAt(QPoint const& global_point)
+{
+    QList<NodeIntrospectionData> state;
+    foreach (DBusNode::Ptr node, GetNodesAt(global_point))
+        state.append(node->GetIntrospectionData());
+    return state;
+}
+
+
+QList<NodeIntrospectionData> IntrospectNodesIn(QRect const& global_rect)
+{
+    QList<NodeIntrospectionData> state;
+    foreach (DBusNode::Ptr node, GetNodesIn(global_rect))
+        state.append(node->GetIntrospectionData());
+    return state;
+}
+
+
 QVariant IntrospectNode(QObject* obj)
 {
     // return must be (name, state_map)
@@ -103,10 +381,36 @@ QString GetNodeName(QObject* obj)
 }
 
 
-QVariantMap GetNodeProperties(QObject* obj)
+QVariantMap GetNodeProperties(QObject* obj, QRect const* global_rect)
 {
-    QVariantMap object_properties;
-    const QMetaObject* meta = obj->metaObject();
+    PropertyRecord properties;
+    ReadNodeProperties(obj, properties, global_rect);
+    return properties.ToVariantMap();
+}
+
+
+void ReadNodeProperties(QObject* obj, PropertyRecord& properties, QRect const* global_rect)
+{
+    PropertyProfiler& profiler = PropertyProfiler::Instance();
+    const QMetaObject* object_meta = obj->metaObject();
+    properties.Reserve(object_meta->propertyCount() + obj->dynamicPropertyNames().size());
+
+    // Well-known properties are read through their C++ getters. The meta-object
+    // loop below skips them.
+    FastPropertyTable fast_properties = GetFastProperties(obj);
+    for (const FastProperty* p = fast_properties.begin; p != fast_properties.end; ++p)
+    {
+        if (profiler.IsExcluded(object_meta, p->name))
+            continue;
+        bool known_global_rect = global_rect && std::strcmp(p->name, "globalRect") == 0;
+        properties.Append(p->name, known_global_rect ? QVariant(*global_rect) : p->read(obj));
+    }
+
+    // Properties are appended as they come. Where a name comes up more than
+    // once (shadowed in a subclass, or dynamic as well as static), Finish keeps
+    // the first one, as the most derived class comes first here.
+    QElapsedTimer timer;
+    const QMetaObject* meta = object_meta;
     do
     {
         for(int i = meta->propertyOffset(); i < meta->propertyCount(); ++i)
@@ -117,73 +421,199 @@ QVariantMap GetNodeProperties(QObject* obj)
                 qDebug() << "Property at index" << i << "Is not valid!";
                 continue;
             }
-            QVariant object_property = PackProperty(prop.read(obj));
-            if (! object_property.isValid())
+            if (FindFastProperty(fast_properties, prop.name()))
                 continue;
-            if (!object_properties.contains(prop.name())) {
-                object_properties[prop.name()] = object_property;
-            }
-        }
-        foreach(const QByteArray &dynamicPropertyName, obj->dynamicPropertyNames()) {
-            QVariant dynamicPropertyValue = obj->property(dynamicPropertyName);
-
-            QVariant object_property = PackProperty(dynamicPropertyValue);
-            if (! object_property.isValid())
+            // Excluded properties are only read when a client asks for them by name.
+            if (profiler.IsExcluded(object_meta, prop.name()))
                 continue;
-            object_properties[dynamicPropertyName] = object_property;
+
+            if (profiler.IsEnabled())
+            {
+                timer.start();
+                QVariant value = prop.read(obj);
+                profiler.Record(meta, i, timer.nsecsElapsed());
+                properties.Append(prop.name(), value);
+            }
+            else
+            {
+                properties.Append(prop.name(), prop.read(obj));
+            }
         }
 
         meta = meta->superClass();
     } while(meta);
 
-    AddCustomProperties(obj, object_properties);
+    foreach(const QByteArray &dynamicPropertyName, obj->dynamicPropertyNames()) {
+        if (profiler.IsExcluded(object_meta, dynamicPropertyName.constData()))
+            continue;
+        properties.Append(dynamicPropertyName.constData(), obj->property(dynamicPropertyName));
+    }
+
+    properties.Finish();
+    AddCustomProperties(obj, properties);
+}
 
-    // add the 'Children' pseudo-property:
-    QStringList children = GetNodeChildNames(obj);
-    if (!children.empty())
-        object_properties["Children"] = PackProperty(children);
 
-    return object_properties;
+QVariant GetNodeProperty(QObject* obj, QByteArray const& name)
+{
+    FastPropertyTable fast_properties = GetFastProperties(obj);
+    if (const FastProperty* p = FindFastProperty(fast_properties, name.constData()))
+        return PackProperty(p->read(obj));
+
+    // covers both static and dynamic properties:
+    QVariant value = obj->property(name.constData());
+    if (value.isValid())
+        return PackProperty(value);
+
+    // Pseudo-properties are only available from the full property record.
+    PropertyRecord properties;
+    ReadNodeProperties(obj, properties);
+    return properties.value(QString::fromLatin1(name));
 }
 
 
-void AddCustomProperties(QObject* obj, QVariantMap &properties)
+void AddCustomProperties(QObject* obj, PropertyRecord& properties)
 {
     // Add any custom properties we need to the given QObject.
-    // Add GlobalRect support for QWidget-derived classes
-    if (QWidget *w = qobject_cast<QWidget*>(obj))
+    NodeTypeHandlers const& handlers = NodeTypeRegistry::Instance().Handlers(obj->metaObject());
+    if (handlers.custom_properties.isEmpty())
+        return;
+
+    QVariantMap custom_properties;
+    foreach (PropertyProvider provider, handlers.custom_properties)
+        provider(obj, custom_properties);
+    for (auto property = custom_properties.constBegin(); property != custom_properties.constEnd(); ++property)
+        properties.SetPacked(property.key(), property.value());
+}
+
+
+void AddGraphicsItemGlobalRect(QObject* obj, QVariantMap &properties)
+{
+    // globalRect for QWidget and QQuickItem derived classes comes from the
+    // fast property tables. This adds support for QGraphicsItem-derived classes.
+    QGraphicsItem *i = static_cast<QGraphicsObject*>(obj);
+    if (!i->scene() || i->scene()->views().isEmpty())
+        return;
+
+    // need to get the view that this item is in. Should only be one. If there's
+    // more than one, we're in trouble.
+    QGraphicsView *view = i->scene()->views().last();
+    properties["globalRect"] = PackProperty(GetGraphicsItemGlobalRect(i, view));
+}
+
+
+QRect GetGraphicsItemGlobalRect(QGraphicsItem* item, QGraphicsView* view)
+{
+    QRectF bounding_rect = item->mapRectToScene(item->boundingRect());
+    QRect view_rect = view->mapFromScene(bounding_rect).boundingRect();
+    return QRect(view->mapToGlobal(view_rect.topLeft()), view_rect.size());
+}
+
+
+void TruncateLargeValues(PropertyRecord& properties, int max_value_size)
+{
+    for (int i = 0; i < properties.size(); ++i)
     {
-        QRect r = w->rect();
-        r = QRect(w->mapToGlobal(r.topLeft()), r.size());
-        properties["globalRect"] = PackProperty(r);
+        // Byte arrays and URLs are held as strings already. Values that come
+        // packed, e.g. the ones of model indices, may be strings as well.
+        PropertyRecord::Kind kind = properties.KindAt(i);
+        QVariant packed_string;
+        if (kind == PropertyRecord::Packed)
+        {
+            QVariantList packed = properties.PackedAt(i).toList();
+            if (packed.size() == 2 && packed.at(0).toInt() == TYPE_PLAIN)
+            {
+                packed_string = packed.at(1);
+                if (packed_string.type() == QVariant::String)
+                    kind = PropertyRecord::String;
+                else if (packed_string.type() == QVariant::StringList)
+                    kind = PropertyRecord::StringList;
+            }
+        }
+
+        int length = 0;
+        QByteArray hashed;
+        if (kind == PropertyRecord::String)
+        {
+            QString string = packed_string.isValid() ? packed_string.toString() : properties.StringAt(i);
+            if (string.size() <= max_value_size)
+                continue;
+            length = string.size();
+            hashed = string.toUtf8();
+        }
+        else if (kind == PropertyRecord::StringList)
+        {
+            QStringList strings = packed_string.isValid() ? packed_string.toStringList() : properties.StringListAt(i);
+            int size = 0;
+            foreach (QString const& string, strings)
+                size += string.size();
+            if (size <= max_value_size)
+                continue;
+            // The children are part of the tree's structure, not a value:
+            if (properties.NameAt(i) == "Children")
+                continue;
+            length = strings.size();
+            hashed = strings.join('\n').toUtf8();
+        }
+        else
+            continue;
+
+        properties.SetPacked(i, QVariantList {
+            QVariant(TYPE_TRUNCATED),
+            QVariant(length),
+            QVariant(QString::fromLatin1(QCryptographicHash::hash(hashed, QCryptographicHash::Sha1).toHex()))
+        });
     }
-    // ...and support for QGraphicsItem-derived classes.
-    else if (QGraphicsItem *i = qobject_cast<QGraphicsItem*>(obj))
+}
+
+
+QVariant GetPropertyChunk(DBusNode::Ptr const& node, QString const& name, int offset, int length)
+{
+    if (offset < 0 || length < 0)
+        return QVariant();
+    return GetValueChunk(GetChunkableProperty(node, name), offset, length);
+}
+
+QVariant GetChunkableProperty(DBusNode::Ptr const& node, QString const& name)
+{
+    // Read on its own where possible, rather than along with all others:
+    QVariant packed_value;
+    if (auto object_node = std::dynamic_pointer_cast<const QObjectNode>(node))
     {
-        // need to get the view that this item is in. Should only be one. If there's
-        // more than one, we're in trouble.
-        QGraphicsView *view = i->scene()->views().last();
-        QRectF bounding_rect = i->boundingRect();
-        bounding_rect = i->mapRectToScene(bounding_rect);
-        QRect scene_rect = view->mapFromScene(bounding_rect).boundingRect();
-        QRect global_rect = QRect(
-                    view->mapToGlobal(scene_rect.topLeft()),
-                    scene_rect.size());
-        properties["globalRect"] = PackProperty(global_rect);
+        QObject* object = object_node->getWrappedObject();
+        QByteArray property_name = name.toUtf8();
+        RunInThreadOf(object, [object, &property_name, &packed_value] {
+            packed_value = GetNodeProperty(object, property_name);
+        });
     }
+    else
+        packed_value = node->GetIntrospectionData().state.value(name);
 
-    // ... and support for QQuickItems (aka. Qt5 Declarative items)
-    else if (QQuickItem *i = qobject_cast<QQuickItem*>(obj))
-    {
-        QQuickWindow *view = i->window();
+    QVariantList packed = packed_value.toList();
+    if (packed.size() != 2 || packed.at(0).toInt() != TYPE_PLAIN)
+        return QVariant();
 
-        if (view) {
-            QRectF bounding_rect = i->boundingRect();
-            bounding_rect = i->mapRectToScene(bounding_rect);
-            QRect global_rect = QRect(view->mapToGlobal(bounding_rect.toRect().topLeft()), bounding_rect.size().toSize());
-            properties["globalRect"] = PackProperty(global_rect);
-        }
-    }
+    QVariant const& value = packed.at(1);
+    if (value.type() != QVariant::String && value.type() != QVariant::StringList)
+        return QVariant();
+    return value;
+}
+
+QVariant GetValueChunk(QVariant const& value, int offset, int length)
+{
+    if (offset < 0 || length < 0)
+        return QVariant();
+    if (value.type() == QVariant::String)
+        return value.toString().mid(offset, length);
+    if (value.type() == QVariant::StringList)
+        return QStringList(value.toStringList().mid(offset, length));
+    return QVariant();
+}
+
+
+void RegisterBuiltinPropertyProviders(NodeTypeRegistry& registry)
+{
+    registry.RegisterCustomProperties(&QGraphicsObject::staticMetaObject, AddGraphicsItemGlobalRect);
 }
 
 QVariant PackProperty(QVariant const& prop)
@@ -303,50 +733,3 @@ QVariant PackProperty(QVariant const& prop)
     }
 }
 
-
-QStringList GetNodeChildNames(QObject* obj)
-{
-    QStringList child_names;
-    foreach (QObject *child, obj->children())
-    {
-        if (child->parent() == obj) {
-            child_names.append(GetNodeName(child));
-        }
-    }
-    // In case of a QQuickWindow, add the main contentItem()
-    if (QQuickWindow *window = qobject_cast<QQuickWindow*>(obj)) {
-        //child_names.append(GetNodeName(window->contentItem()));
-
-        // Process data property
-        if (window->property("data").isValid()) {
-            QQmlListProperty<QObject> data = qvariant_cast<QQmlListProperty<QObject>>(window->property("data"));
-            qDebug() << "Getting data property for QQuickWindow: " << data.count(&data);
-
-            for (int index = 0; index < data.count(&data); index++) {
-                QObject* item = data.at(&data, index);
-                child_names.append(GetNodeName(item));
-            }
-
-        }
-
-    }
-    // In case of QQuickItems include also childItems(), not only children().
-    if (QQuickItem *item = qobject_cast<QQuickItem*>(obj)) {
-        foreach (QObject *child, item->childItems()) {
-            child_names.append(GetNodeName(child));
-        }
-    }        
-
-    // QML Support Enhancements
-    QString nodeName = GetNodeName(obj);
-
-    if (nodeName.startsWith("QQuickLoader") && obj->property("item").isValid()) {
-        QObject *child = qvariant_cast<QObject *>(obj->property("item"));
-
-        if (child) {
-            child_names.append(GetNodeName(child));
-        }
-    }
-
-    return child_names;
-}
@@ -9,22 +9,83 @@ by the Free Software Foundation.
 #ifndef INTROSPECTION_H
 #define INTROSPECTION_H
 
+#include "propertyrecord.h"
 #include "qtnode.h"
 
+#include <QPoint>
+#include <QRect>
 #include <QVariantMap>
 
+class QGraphicsItem;
+class QGraphicsView;
+
 /// Introspect 'obj' and return it's properties in a QVariantMap.
 QList<NodeIntrospectionData> Introspect(const QString& query_string);
 
+/// Return the id and globalRect of the nodes that match the given query and
+/// of all their descendants that have a globalRect, and nothing else.
+QList<NodeIntrospectionData> IntrospectGeometry(const QString& query_string);
+
+/// Return the state of 'nodes'. The properties of objects that live in other
+/// threads are read in those threads, in parallel (see ThreadBatches).
+QList<NodeIntrospectionData> GetNodesIntrospectionData(QList<DBusNode::Ptr> const& nodes);
+
 /// Get a list of DBusNode pointers that match the given query.
 QList<DBusNode::Ptr> GetNodesThatMatchQuery(QString const& query_string);
 
+/// Return the nodes shown at 'global_point', top-most first: the widget,
+/// item or graphics item on top, its parents, and so on up to its top level
+/// widget or window. Only the branches that contain the point are visited.
+QList<DBusNode::Ptr> GetNodesAt(QPoint const& global_point);
+
+/// Return the nodes of the visible widgets, items and graphics items whose
+/// globalRect intersects 'global_rect', parents before children. Widgets, and
+/// items that clip, are only descended into if they intersect 'global_rect'.
+QList<DBusNode::Ptr> GetNodesIn(QRect const& global_rect);
+
+/// Like Introspect, for the nodes returned by GetNodesAt and GetNodesIn.
+QList<NodeIntrospectionData> IntrospectNodesAt(QPoint const& global_point);
+QList<NodeIntrospectionData> IntrospectNodesIn(QRect const& global_rect);
+
 /// Return true if 't' is a type that we can marshall over DBus
 QVariant PackProperty(QVariant const& prop);
 
 /// Return a QVariantMap containing all the properties for the
-/// given QObject.
-QVariantMap GetNodeProperties(QObject* obj);
+/// given QObject. If 'global_rect' is given, it is used for the globalRect
+/// property instead of mapping the object's geometry from scratch.
+QVariantMap GetNodeProperties(QObject* obj, QRect const* global_rect = nullptr);
+
+/// Like GetNodeProperties, but read the properties into 'properties', unpacked
+/// (see PropertyRecord).
+void ReadNodeProperties(QObject* obj, PropertyRecord& properties, QRect const* global_rect = nullptr);
+
+/// Return the bounding rectangle of 'item' in global coordinates, as shown by
+/// 'view'.
+QRect GetGraphicsItemGlobalRect(QGraphicsItem* item, QGraphicsView* view);
+
+/// Replace the strings and string lists in 'properties' that hold more
+/// than 'max_value_size' characters with TYPE_TRUNCATED values: their length
+/// (in characters, or items for string lists) and the SHA-1 of their UTF-8
+/// encoding, string list items joined by newlines.
+void TruncateLargeValues(PropertyRecord& properties, int max_value_size);
+
+/// Return part of the string or string list property 'name' of 'node':
+/// 'length' characters (or items) from 'offset' on. Return an invalid QVariant
+/// if the node has no such property.
+QVariant GetPropertyChunk(DBusNode::Ptr const& node, QString const& name, int offset, int length);
+
+/// Return the string or string list property 'name' of 'node', unpacked, or
+/// an invalid QVariant if the node has no such property. Lets the chunks of
+/// one value be taken from a single read, see GetValueChunk.
+QVariant GetChunkableProperty(DBusNode::Ptr const& node, QString const& name);
+
+/// Return 'length' characters (or items) of the string or string list 'value'
+/// from 'offset' on, or an invalid QVariant if 'value' is neither.
+QVariant GetValueChunk(QVariant const& value, int offset, int length);
+
+/// Return the packed value of the single property 'name' of the given QObject,
+/// or an invalid QVariant if there is no such property.
+QVariant GetNodeProperty(QObject* obj, QByteArray const& name);
 
 
 #endif
@@ -0,0 +1,193 @@
+#include "modelcache.h"
+#include "qtnode.h"
+
+#include <QAbstractItemModel>
+
+#include <algorithm>
+#include <vector>
+
+// Enough for the rows of a few views. Half of them are dropped when there are
+// more.
+const int MAX_INDEX_IDS = 4096;
+
+ModelCache& ModelCache::Instance()
+{
+    static ModelCache cache;
+    return cache;
+}
+
+ModelCache::ModelCache()
+    : use_count_(0)
+{
+}
+
+ModelCache::Entry& ModelCache::Lookup(const QAbstractItemModel* model, bool refresh)
+{
+    auto entry = models_.find(model);
+    if (entry == models_.end())
+    {
+        entry = models_.insert(model, Entry());
+        connect(model, SIGNAL(destroyed(QObject*)), this, SLOT(OnModelDestroyed(QObject*)));
+        connect(model, SIGNAL(modelReset()), this, SLOT(OnModelReset()));
+        // Persistent indices follow these changes, the index to id map doesn't:
+        connect(model, SIGNAL(rowsInserted(QModelIndex,int,int)), this, SLOT(OnModelLayoutChanged()));
+        connect(model, SIGNAL(rowsRemoved(QModelIndex,int,int)), this, SLOT(OnModelLayoutChanged()));
+        connect(model, SIGNAL(rowsMoved(QModelIndex,int,int,QModelIndex,int)), this, SLOT(OnModelLayoutChanged()));
+        connect(model, SIGNAL(columnsInserted(QModelIndex,int,int)), this, SLOT(OnModelLayoutChanged()));
+        connect(model, SIGNAL(columnsRemoved(QModelIndex,int,int)), this, SLOT(OnModelLayoutChanged()));
+        connect(model, SIGNAL(columnsMoved(QModelIndex,int,int,QModelIndex,int)), this, SLOT(OnModelLayoutChanged()));
+        connect(model, SIGNAL(layoutChanged()), this, SLOT(OnModelLayoutChanged()));
+        refresh = true;
+    }
+    if (refresh)
+    {
+        entry->role_names = model->roleNames();
+        entry->roles.clear();
+        for (auto role = entry->role_names.constBegin(); role != entry->role_names.constEnd(); ++role)
+            entry->roles.insert(role.value() + "Role", role.key());
+    }
+    return *entry;
+}
+
+void ModelCache::Remove(const QAbstractItemModel* model)
+{
+    auto entry = models_.find(model);
+    if (entry == models_.end())
+        return;
+
+    foreach (int32_t id, entry->ids)
+        indices_by_id_.remove(id);
+    models_.erase(entry);
+}
+
+QHash<int, QByteArray> const& ModelCache::RoleNames(const QAbstractItemModel* model)
+{
+    return Lookup(model, false).role_names;
+}
+
+int ModelCache::RoleForProperty(const QAbstractItemModel* model, QByteArray const& property_name)
+{
+    // 'text' is what QModelIndexNode calls the display role:
+    if (property_name == "text")
+        return Qt::DisplayRole;
+    if (!property_name.endsWith("Role"))
+        return -1;
+
+    int role = Lookup(model, false).roles.value(property_name, -1);
+    if (role < 0)
+        role = Lookup(model, true).roles.value(property_name, -1);
+    return role;
+}
+
+void ModelCache::RebuildIds(Entry& entry)
+{
+    QHash<QPair<const QObject*, QModelIndex>, int32_t> ids;
+    ids.reserve(entry.ids.size());
+    foreach (int32_t id, entry.ids)
+    {
+        auto index_id = indices_by_id_.find(id);
+        // Dropped, see DropLeastRecentlyUsed:
+        if (index_id == indices_by_id_.end())
+            continue;
+        // Persistent indices of removed rows become invalid:
+        if (!index_id->index.isValid())
+        {
+            indices_by_id_.erase(index_id);
+            continue;
+        }
+        ids.insert(qMakePair(index_id->view, QModelIndex(index_id->index)), id);
+    }
+    entry.ids.swap(ids);
+    entry.ids_stale = false;
+}
+
+void ModelCache::DropLeastRecentlyUsed()
+{
+    std::vector<quint64> last_used;
+    last_used.reserve(indices_by_id_.size());
+    for (auto index_id = indices_by_id_.constBegin(); index_id != indices_by_id_.constEnd(); ++index_id)
+        last_used.push_back(index_id->last_used);
+    auto median = last_used.begin() + last_used.size() / 2;
+    std::nth_element(last_used.begin(), median, last_used.end());
+
+    for (auto index_id = indices_by_id_.begin(); index_id != indices_by_id_.end(); )
+    {
+        if (index_id->last_used >= *median)
+        {
+            ++index_id;
+            continue;
+        }
+        // The model's ids are cleaned up on their next use:
+        auto entry = models_.find(index_id->model);
+        if (entry != models_.end())
+            entry->ids_stale = true;
+        index_id = indices_by_id_.erase(index_id);
+    }
+}
+
+int32_t ModelCache::IdForIndex(QModelIndex const& index, const QObject* view)
+{
+    if (!index.isValid())
+        return 0;
+
+    Entry& entry = Lookup(index.model(), false);
+    if (entry.ids_stale)
+        RebuildIds(entry);
+
+    QPair<const QObject*, QModelIndex> key(view, index);
+    int32_t id = entry.ids.value(key, 0);
+    if (!id)
+    {
+        if (indices_by_id_.size() >= MAX_INDEX_IDS)
+        {
+            DropLeastRecentlyUsed();
+            if (entry.ids_stale)
+                RebuildIds(entry);
+        }
+
+        id = AllocateNodeId();
+        entry.ids.insert(key, id);
+        IndexId index_id;
+        index_id.index = QPersistentModelIndex(index);
+        index_id.model = index.model();
+        index_id.view = view;
+        indices_by_id_.insert(id, index_id);
+    }
+    indices_by_id_[id].last_used = ++use_count_;
+    return id;
+}
+
+int32_t ModelCache::FindId(QModelIndex const& index, const QObject* view)
+{
+    auto entry = models_.find(index.model());
+    if (entry == models_.end())
+        return 0;
+    if (entry->ids_stale)
+        RebuildIds(*entry);
+    return entry->ids.value(qMakePair(view, index), 0);
+}
+
+QModelIndex ModelCache::FindIndex(int32_t id) const
+{
+    return indices_by_id_.value(id).index;
+}
+
+void ModelCache::OnModelDestroyed(QObject* model)
+{
+    // Only the address is needed, the model is half destroyed by now:
+    Remove(static_cast<QAbstractItemModel*>(model));
+}
+
+void ModelCache::OnModelReset()
+{
+    const QAbstractItemModel* model = static_cast<const QAbstractItemModel*>(sender());
+    disconnect(model, 0, this, 0);
+    Remove(model);
+}
+
+void ModelCache::OnModelLayoutChanged()
+{
+    auto entry = models_.find(static_cast<const QAbstractItemModel*>(sender()));
+    if (entry != models_.end())
+        entry->ids_stale = true;
+}
@@ -0,0 +1,98 @@
+#ifndef MODELCACHE_H
+#define MODELCACHE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QModelIndex>
+#include <QObject>
+#include <QPair>
+#include <QPersistentModelIndex>
+
+#include <cstdint>
+
+class QAbstractItemModel;
+
+/// Keeps per-model information that is expensive to get for every model
+/// index: the role names, and the ids handed out to model indices.
+///
+/// Model index ids are handed out per index and view, since the same index
+/// may be a node under several views (e.g. a QTreeView and a QML ListView
+/// showing one model), and node ids must be unique. They are kept with a
+/// QPersistentModelIndex, so an item keeps
+/// its id while rows around it are inserted, removed or moved, and an id can
+/// be turned back into an index without looking at the model. The index to
+/// id map is rebuilt from the persistent indices after the model's structure
+/// has changed. Entries are dropped when their model is reset or destroyed.
+/// Role names that aren't found are looked up again, since models may add
+/// roles (e.g. as they get their first rows) without a reset.
+///
+/// Every persistent index slows down row insertions and removals in its
+/// model, so only the ids of the most recently used indices are kept. An
+/// index whose id has been dropped gets a new one when it's next seen.
+class ModelCache : public QObject
+{
+    Q_OBJECT
+public:
+    static ModelCache& Instance();
+
+    /// Return the role names of 'model', see QAbstractItemModel::roleNames.
+    QHash<int, QByteArray> const& RoleNames(const QAbstractItemModel* model);
+
+    /// Return the role that the QModelIndex node property 'property_name'
+    /// (e.g. "displayRole" or "text") stands for, or -1 if there is none.
+    int RoleForProperty(const QAbstractItemModel* model, QByteArray const& property_name);
+
+    /// Return the id of 'index' as shown in 'view', handing out a new one if
+    /// it has none yet.
+    int32_t IdForIndex(QModelIndex const& index, const QObject* view);
+
+    /// Return the id of 'index' as shown in 'view', or 0 if it has none.
+    int32_t FindId(QModelIndex const& index, const QObject* view);
+
+    /// Return the index with the id 'id', or an invalid index if there is
+    /// none (any more).
+    QModelIndex FindIndex(int32_t id) const;
+
+private slots:
+    void OnModelDestroyed(QObject* model);
+    void OnModelReset();
+    void OnModelLayoutChanged();
+
+private:
+    ModelCache();
+
+    struct Entry
+    {
+        Entry() : ids_stale(false) {}
+
+        QHash<int, QByteArray> role_names;
+        QHash<QByteArray, int> roles;
+
+        // the ids of the model's indices, keyed by view and the indices as
+        // they were when 'ids' was last rebuilt from indices_by_id_:
+        QHash<QPair<const QObject*, QModelIndex>, int32_t> ids;
+        bool ids_stale;
+    };
+
+    struct IndexId
+    {
+        IndexId() : model(nullptr), view(nullptr), last_used(0) {}
+
+        QPersistentModelIndex index;
+        const QAbstractItemModel* model;
+        const QObject* view;
+        quint64 last_used;
+    };
+
+    Entry& Lookup(const QAbstractItemModel* model, bool refresh);
+    void Remove(const QAbstractItemModel* model);
+    void RebuildIds(Entry& entry);
+    void DropLeastRecentlyUsed();
+
+    QHash<const QAbstractItemModel*, Entry> models_;
+    // the only copy of each persistent index:
+    QHash<int32_t, IndexId> indices_by_id_;
+    quint64 use_count_;
+};
+
+#endif // MODELCACHE_H
@@ -0,0 +1,58 @@
+#include "nodearena.h"
+
+#include <QtGlobal>
+
+// Big enough for a couple of hundred nodes, so that most queries only need a
+// handful of blocks.
+const std::size_t BLOCK_SIZE = 32 * 1024;
+
+std::shared_ptr<NodeArena> NodeArena::Create()
+{
+    return std::shared_ptr<NodeArena>(new NodeArena);
+}
+
+NodeArena::NodeArena()
+    : block_used_(BLOCK_SIZE)
+{
+}
+
+NodeArena::~NodeArena()
+{
+    // Children are created after their parents, destroy them first:
+    for (auto node = nodes_.rbegin(); node != nodes_.rend(); ++node)
+        (*node)->~DBusNode();
+}
+
+void* NodeArena::Allocate(std::size_t size, std::size_t alignment)
+{
+    Q_ASSERT(size <= BLOCK_SIZE);
+
+    std::size_t offset = (block_used_ + alignment - 1) & ~(alignment - 1);
+    if (offset + size > BLOCK_SIZE)
+    {
+        blocks_.emplace_back(new char[BLOCK_SIZE]);
+        offset = 0;
+    }
+    block_used_ = offset + size;
+    return blocks_.back().get() + offset;
+}
+
+// Only referenced by the nodes, so the arena of a query whose nodes are all
+// gone is freed right away.
+std::weak_ptr<NodeArena> query_arena;
+
+std::shared_ptr<NodeArena> QueryArena()
+{
+    std::shared_ptr<NodeArena> arena = query_arena.lock();
+    if (!arena)
+    {
+        arena = NodeArena::Create();
+        query_arena = arena;
+    }
+    return arena;
+}
+
+void BeginQueryArena()
+{
+    query_arena.reset();
+}
@@ -0,0 +1,63 @@
+#ifndef NODEARENA_H
+#define NODEARENA_H
+
+#include "qtnode.h"
+
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+/// Owns the node wrappers created while answering a single query.
+///
+/// Nodes are placement-constructed in large blocks and destroyed all at once
+/// together with the arena. The std::shared_ptrs handed out for them are
+/// aliases of the arena's own control block, so creating a node does not
+/// allocate a control block of its own, and any node that is still referenced
+/// keeps the whole tree - its parents included - alive.
+class NodeArena : public std::enable_shared_from_this<NodeArena>
+{
+public:
+    static std::shared_ptr<NodeArena> Create();
+    ~NodeArena();
+
+    /// Construct a T in the arena. 'args' are passed to the constructor of T,
+    /// followed by the arena itself.
+    template <class T, class... Args>
+    std::shared_ptr<T> Make(Args&&... args)
+    {
+        T* node = new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)..., this);
+        nodes_.push_back(node);
+        return std::shared_ptr<T>(shared_from_this(), node);
+    }
+
+private:
+    NodeArena();
+    NodeArena(NodeArena const&);
+    NodeArena& operator=(NodeArena const&);
+
+    void* Allocate(std::size_t size, std::size_t alignment);
+
+    std::vector<std::unique_ptr<char[]> > blocks_;
+    std::size_t block_used_;
+    std::vector<DBusNode*> nodes_;
+};
+
+/// Return the arena the nodes of the current query are allocated in. It lives
+/// as long as any of its nodes, e.g. as long as NodeCache holds on to some of
+/// them.
+std::shared_ptr<NodeArena> QueryArena();
+
+/// Start a new query: the nodes created from now on go into a new arena.
+void BeginQueryArena();
+
+/// Create a child node of 'parent' in the arena of the current query. 'args'
+/// are passed to the constructor of T, followed by 'parent'. A parent from an
+/// earlier query is kept alive by its children.
+template <class T, class... Args>
+std::shared_ptr<T> MakeChildNode(DBusNode::Ptr const& parent, Args&&... args)
+{
+    return QueryArena()->Make<T>(std::forward<Args>(args)..., parent);
+}
+
+#endif // NODEARENA_H
@@ -0,0 +1,92 @@
+#include "nodecache.h"
+
+#include <QCoreApplication>
+#include <QEvent>
+#include <QThread>
+#include <QtQuick/QQuickItem>
+
+NodeCache& NodeCache::Instance()
+{
+    static NodeCache cache;
+    return cache;
+}
+
+NodeCache::NodeCache()
+{
+    if (QCoreApplication::instance())
+        QCoreApplication::instance()->installEventFilter(this);
+}
+
+bool NodeCache::IsCacheable(QObject* object) const
+{
+    QCoreApplication* application = QCoreApplication::instance();
+    return application
+        && object->thread() == application->thread()
+        && QThread::currentThread() == application->thread();
+}
+
+QObjectList const* NodeCache::Find(QObject* object) const
+{
+    auto children = children_.constFind(object);
+    if (children == children_.constEnd())
+        return nullptr;
+    return &children.value();
+}
+
+void NodeCache::Insert(QObject* object, QObjectList const& children)
+{
+    if (!IsCacheable(object))
+        return;
+
+    children_.insert(object, children);
+    if (watched_.contains(object))
+        return;
+
+    watched_.insert(object);
+    connect(object, SIGNAL(destroyed(QObject*)), this, SLOT(OnObjectDestroyed(QObject*)));
+    if (qobject_cast<QQuickItem*>(object))
+    {
+        // QQuickItem children are the childItems(), which don't follow the
+        // QObject hierarchy and don't send child events:
+        connect(object, SIGNAL(childrenChanged()), this, SLOT(OnChildItemsChanged()));
+    }
+}
+
+void NodeCache::Clear()
+{
+    foreach (QObject* object, watched_)
+        object->disconnect(this);
+    watched_.clear();
+    children_.clear();
+}
+
+bool NodeCache::eventFilter(QObject* watched, QEvent* event)
+{
+    switch (event->type())
+    {
+    case QEvent::ChildAdded:
+    case QEvent::ChildRemoved:
+        Invalidate(watched);
+        break;
+    default:
+        break;
+    }
+    return false;
+}
+
+void NodeCache::OnObjectDestroyed(QObject* object)
+{
+    // The object is half destroyed already, Qt removes the connections itself.
+    children_.remove(object);
+    watched_.remove(object);
+}
+
+void NodeCache::OnChildItemsChanged()
+{
+    Invalidate(sender());
+}
+
+void NodeCache::Invalidate(QObject* object)
+{
+    children_.remove(object);
+}
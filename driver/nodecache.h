@@ -0,0 +1,62 @@
+#ifndef NODECACHE_H
+#define NODECACHE_H
+
+#include <QHash>
+#include <QObject>
+#include <QSet>
+
+class QEvent;
+
+/// Keeps the QObject children of the objects visited by queries across
+/// queries.
+///
+/// Object trees change very little between two consecutive queries, so
+/// instead of calling children()/childItems() again, QObjectNode::Children
+/// wraps the objects of the lists kept here. The nodes themselves are not
+/// kept: they live in the arena of the query that created them (see
+/// QueryArena), along with that query's model indices and scene items, and
+/// holding on to some of them would keep all of those alive. Since paths
+/// come from the freshly created nodes, a list is only dropped when the
+/// object gains or loses a child and when it is destroyed. Structural changes
+/// are picked up through an application-wide event filter (ChildAdded and
+/// ChildRemoved) and, for QQuickItems, through the childrenChanged() signal.
+///
+/// Only objects living in the main thread are cached, since the event filter
+/// does not see events delivered to other threads.
+class NodeCache : public QObject
+{
+    Q_OBJECT
+public:
+    static NodeCache& Instance();
+
+    /// Return true if the children of 'object' may be cached.
+    bool IsCacheable(QObject* object) const;
+
+    /// Return the cached children of 'object', or null if there are none.
+    QObjectList const* Find(QObject* object) const;
+
+    /// Cache 'children' as the children of 'object'.
+    void Insert(QObject* object, QObjectList const& children);
+
+    /// Drop all cached lists.
+    void Clear();
+
+protected:
+    bool eventFilter(QObject* watched, QEvent* event);
+
+private slots:
+    void OnObjectDestroyed(QObject* object);
+    void OnChildItemsChanged();
+
+private:
+    NodeCache();
+
+    void Invalidate(QObject* object);
+
+    QHash<QObject*, QObjectList> children_;
+    // all objects whose signals we are connected to, i.e. every object that
+    // had its children cached at some point:
+    QSet<QObject*> watched_;
+};
+
+#endif // NODECACHE_H
@@ -0,0 +1,189 @@
+#include "nodetyperegistry.h"
+
+#include <QMetaObject>
+
+#include <cstring>
+#include <functional>
+
+NodeTypeRegistry& NodeTypeRegistry::Instance()
+{
+    static NodeTypeRegistry registry;
+    return registry;
+}
+
+NodeTypeRegistry::NodeTypeRegistry()
+    : last_type_hash_(0)
+    , last_type_bit_(-1)
+{
+    RegisterBuiltinFastProperties(*this);
+    RegisterBuiltinChildrenProviders(*this);
+    RegisterBuiltinPropertyProviders(*this);
+}
+
+NodeTypeRegistry::~NodeTypeRegistry()
+{
+    qDeleteAll(resolved_);
+}
+
+void NodeTypeRegistry::RegisterDataChildren(const QMetaObject* meta, ChildrenProvider provider,
+                                            std::vector<std::string> const& node_names,
+                                            DataChildrenCheck check)
+{
+    registrations_[meta].data_children = provider;
+    registrations_[meta].data_children_names = node_names;
+    registrations_[meta].has_data_children = check;
+    Invalidate();
+}
+
+void NodeTypeRegistry::RegisterMatchingDataChildren(const QMetaObject* meta, MatchingChildrenProvider provider)
+{
+    registrations_[meta].matching_data_children = provider;
+    Invalidate();
+}
+
+void NodeTypeRegistry::RegisterDataChildren(QByteArray const& class_name, ChildrenProvider provider,
+                                            std::vector<std::string> const& node_names,
+                                            DataChildrenCheck check)
+{
+    named_registrations_[class_name].data_children = provider;
+    named_registrations_[class_name].data_children_names = node_names;
+    named_registrations_[class_name].has_data_children = check;
+    Invalidate();
+}
+
+void NodeTypeRegistry::RegisterMatchingDataChildren(QByteArray const& class_name, MatchingChildrenProvider provider)
+{
+    named_registrations_[class_name].matching_data_children = provider;
+    Invalidate();
+}
+
+void NodeTypeRegistry::UnregisterDataChildren(const QMetaObject* meta)
+{
+    auto registration = registrations_.find(meta);
+    if (registration == registrations_.end())
+        return;
+
+    registration->data_children = nullptr;
+    registration->data_children_names.clear();
+    registration->matching_data_children = nullptr;
+    registration->has_data_children = nullptr;
+    Invalidate();
+}
+
+void NodeTypeRegistry::RegisterExtraChildren(const QMetaObject* meta, ChildrenProvider provider)
+{
+    registrations_[meta].extra_children.append(provider);
+    Invalidate();
+}
+
+void NodeTypeRegistry::RegisterObjectChildren(const QMetaObject* meta, ChildrenProvider provider)
+{
+    registrations_[meta].object_children = provider;
+    Invalidate();
+}
+
+void NodeTypeRegistry::RegisterCustomProperties(const QMetaObject* meta, PropertyProvider provider)
+{
+    registrations_[meta].custom_properties.append(provider);
+    Invalidate();
+}
+
+void NodeTypeRegistry::RegisterFastProperties(const QMetaObject* meta, FastPropertyTable table)
+{
+    registrations_[meta].fast_properties = table;
+    Invalidate();
+}
+
+NodeTypeHandlers const& NodeTypeRegistry::Handlers(const QMetaObject* meta)
+{
+    // Lookups of resolved handlers don't modify the registry, so other
+    // threads may make them (see ThreadBatches).
+    auto resolved = resolved_.constFind(meta->className());
+    if (resolved != resolved_.constEnd())
+        return **resolved;
+
+    NodeTypeHandlers*& handlers = resolved_[meta->className()];
+    if (!handlers)
+        handlers = Resolve(meta);
+    return *handlers;
+}
+
+std::string GetNodeTypeName(const QMetaObject* meta)
+{
+    // QML type names get mangled by Qt - they get _QML_N or _QMLTYPE_N appended.
+    const char* class_name = meta->className();
+    const char* mangling = std::strchr(class_name, '_');
+    if (mangling)
+        return std::string(class_name, mangling);
+    return std::string(class_name);
+}
+
+int NodeTypeRegistry::TypeBit(std::string const& name, std::size_t name_hash)
+{
+    if (name_hash == last_type_hash_ && last_type_bit_ >= 0 && name == last_type_name_)
+        return last_type_bit_;
+
+    int bit = type_bits_.value(QByteArray::fromStdString(name), -1);
+    // Names that haven't been seen yet may get a bit later on:
+    if (bit >= 0)
+    {
+        last_type_hash_ = name_hash;
+        last_type_name_ = name;
+        last_type_bit_ = bit;
+    }
+    return bit;
+}
+
+NodeTypeHandlers* NodeTypeRegistry::Resolve(const QMetaObject* meta)
+{
+    NodeTypeHandlers* handlers = new NodeTypeHandlers;
+    handlers->name = GetNodeTypeName(meta);
+    handlers->name_hash = std::hash<std::string>()(handlers->name);
+    handlers->name_string = QString::fromStdString(handlers->name);
+
+    // Walk from the most derived class to QObject:
+    for (const QMetaObject* m = meta; m; m = m->superClass())
+    {
+        QByteArray type_name = QByteArray::fromStdString(GetNodeTypeName(m));
+        auto type_bit = type_bits_.find(type_name);
+        if (type_bit == type_bits_.end())
+            type_bit = type_bits_.insert(type_name, type_bits_.size());
+        if (*type_bit >= handlers->ancestry.size())
+            handlers->ancestry.resize(*type_bit + 1);
+        handlers->ancestry.setBit(*type_bit);
+
+        const NodeTypeHandlers* registration = nullptr;
+        auto by_meta = registrations_.constFind(m);
+        if (by_meta != registrations_.constEnd())
+            registration = &by_meta.value();
+        else if (!named_registrations_.isEmpty())
+        {
+            auto by_name = named_registrations_.constFind(type_name);
+            if (by_name != named_registrations_.constEnd())
+                registration = &by_name.value();
+        }
+        if (!registration)
+            continue;
+
+        if (!handlers->data_children)
+        {
+            handlers->data_children = registration->data_children;
+            handlers->data_children_names = registration->data_children_names;
+            handlers->matching_data_children = registration->matching_data_children;
+            handlers->has_data_children = registration->has_data_children;
+        }
+        if (!handlers->object_children)
+            handlers->object_children = registration->object_children;
+        if (handlers->fast_properties.begin == handlers->fast_properties.end)
+            handlers->fast_properties = registration->fast_properties;
+        handlers->extra_children += registration->extra_children;
+        handlers->custom_properties += registration->custom_properties;
+    }
+    return handlers;
+}
+
+void NodeTypeRegistry::Invalidate()
+{
+    qDeleteAll(resolved_);
+    resolved_.clear();
+}
@@ -0,0 +1,161 @@
+#ifndef NODETYPEREGISTRY_H
+#define NODETYPEREGISTRY_H
+
+#include "fastproperties.h"
+#include "qtnode.h"
+
+#include <QBitArray>
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QVariantMap>
+#include <QVector>
+
+#include <string>
+#include <vector>
+
+struct QMetaObject;
+
+/// Adds children of 'object' to 'children'. 'parent' is the node that wraps
+/// 'object' and becomes the parent of the new nodes.
+typedef void (*ChildrenProvider)(QObject* object, xpathselect::NodeVector& children, DBusNode::Ptr parent);
+
+/// Like ChildrenProvider, but may leave out the children that neither match
+/// 'part' nor have descendants that do (see xpathselect::Node::ChildrenFor).
+typedef void (*MatchingChildrenProvider)(QObject* object, xpathselect::XPathQueryPart const& part,
+                                         xpathselect::NodeVector& children, DBusNode::Ptr parent);
+
+/// Returns false if 'object' has no data children for sure, e.g. if an item
+/// view has no model, without creating any.
+typedef bool (*DataChildrenCheck)(QObject* object);
+
+/// Adds custom (pseudo-)properties of 'object' to 'properties', packed (see
+/// PackProperty). 'properties' only holds what the providers for the class
+/// have added so far; the results replace properties of the same names.
+typedef void (*PropertyProvider)(QObject* object, QVariantMap& properties);
+
+/// The handlers that apply to one class, resolved from all registrations made
+/// for the class and its base classes.
+struct NodeTypeHandlers
+{
+    NodeTypeHandlers()
+        : data_children(nullptr)
+        , matching_data_children(nullptr)
+        , has_data_children(nullptr)
+        , object_children(nullptr)
+        , fast_properties { nullptr, nullptr }
+        , name_hash(0)
+    {}
+
+    /// Non-QObject children, e.g. the items of an item view. Only the
+    /// registration for the most derived class applies.
+    ChildrenProvider data_children;
+    /// The names of all nodes in the subtrees 'data_children' creates, or
+    /// empty if they aren't known. Queries that can't match any of them don't
+    /// need the data children to be created.
+    std::vector<std::string> data_children_names;
+    /// Creates the data children that may match a query part, if the data
+    /// children provider comes with one.
+    MatchingChildrenProvider matching_data_children;
+    /// Tells whether there are any data children, if the data children
+    /// provider comes with a check. The 'Children' property only names the
+    /// data children when there are some.
+    DataChildrenCheck has_data_children;
+    /// Additional QObject children, e.g. the root object of a QQuickView.
+    /// Registrations for all classes apply, most derived class first.
+    QVector<ChildrenProvider> extra_children;
+    /// The regular QObject children, e.g. childItems() for QQuickItems. Only
+    /// the registration for the most derived class applies.
+    ChildrenProvider object_children;
+    /// Registrations for all classes apply, most derived class first.
+    QVector<PropertyProvider> custom_properties;
+    /// Only the registration for the most derived class applies.
+    FastPropertyTable fast_properties;
+
+    /// The node name for the class, with QML type name mangling removed.
+    std::string name;
+    /// std::hash of 'name', see xpathselect::Node::GetNameHash.
+    std::size_t name_hash;
+    /// 'name' as a QString, shared by all 'Children' lists that mention it.
+    QString name_string;
+    /// The class and all its base classes, one bit per class, see
+    /// NodeTypeRegistry::TypeBit.
+    QBitArray ancestry;
+};
+
+/// Maps classes to the handlers used to introspect their instances.
+///
+/// Handlers are registered for a class and apply to all classes derived from
+/// it. They are resolved once per class, so looking up the handlers for a node
+/// is a single hash lookup. Register custom providers (e.g. for in-house
+/// widget types) before the first query is made.
+class NodeTypeRegistry
+{
+public:
+    static NodeTypeRegistry& Instance();
+    ~NodeTypeRegistry();
+
+    /// 'node_names' are the names of all nodes 'provider' creates, and of all
+    /// nodes below them, if known (see NodeTypeHandlers::data_children_names).
+    /// 'check' tells cheaply whether there are any (see
+    /// NodeTypeHandlers::has_data_children).
+    void RegisterDataChildren(const QMetaObject* meta, ChildrenProvider provider,
+                              std::vector<std::string> const& node_names = std::vector<std::string>(),
+                              DataChildrenCheck check = nullptr);
+    /// Register a provider that evaluates (some) query predicates itself, for
+    /// the data children registered for 'meta'.
+    void RegisterMatchingDataChildren(const QMetaObject* meta, MatchingChildrenProvider provider);
+    /// Register data children for the class called 'class_name', for classes
+    /// whose QMetaObject isn't public (e.g. QQuickListView).
+    void RegisterDataChildren(QByteArray const& class_name, ChildrenProvider provider,
+                              std::vector<std::string> const& node_names = std::vector<std::string>(),
+                              DataChildrenCheck check = nullptr);
+    void RegisterMatchingDataChildren(QByteArray const& class_name, MatchingChildrenProvider provider);
+    /// Remove the data children provider registered for 'meta' itself (along
+    /// with its node names, matching provider and check), so that those registered
+    /// for its base classes apply again.
+    void UnregisterDataChildren(const QMetaObject* meta);
+    void RegisterExtraChildren(const QMetaObject* meta, ChildrenProvider provider);
+    void RegisterObjectChildren(const QMetaObject* meta, ChildrenProvider provider);
+    void RegisterCustomProperties(const QMetaObject* meta, PropertyProvider provider);
+    void RegisterFastProperties(const QMetaObject* meta, FastPropertyTable table);
+
+    /// Return the handlers for objects whose class is 'meta'.
+    NodeTypeHandlers const& Handlers(const QMetaObject* meta);
+
+    /// Return the bit that stands for the class called 'name' (as a node name)
+    /// in NodeTypeHandlers::ancestry, or -1 if no class of that name has been
+    /// seen yet. 'name_hash' is std::hash of 'name'.
+    int TypeBit(std::string const& name, std::size_t name_hash);
+
+private:
+    NodeTypeRegistry();
+    NodeTypeRegistry(NodeTypeRegistry const&);
+    NodeTypeRegistry& operator=(NodeTypeRegistry const&);
+
+    NodeTypeHandlers* Resolve(const QMetaObject* meta);
+    void Invalidate();
+
+    // registrations are keyed by the (static) QMetaObject of a C++ class:
+    QHash<const QMetaObject*, NodeTypeHandlers> registrations_;
+    // ...or by class name, see RegisterDataChildren:
+    QHash<QByteArray, NodeTypeHandlers> named_registrations_;
+    // QML objects that declare their own properties get a per-instance copy of
+    // their type's QMetaObject. All copies share the class name storage, so
+    // resolved handlers are keyed by that pointer instead.
+    QHash<const char*, NodeTypeHandlers*> resolved_;
+    // bits are handed out as classes are first resolved, and never change:
+    QHash<QByteArray, int> type_bits_;
+    // 'is:' node tests look up the same name for every node they visit. The
+    // name is compared as well, hashes may collide:
+    std::size_t last_type_hash_;
+    std::string last_type_name_;
+    int last_type_bit_;
+};
+
+/// Register the children and property providers built into the driver.
+void RegisterBuiltinChildrenProviders(NodeTypeRegistry& registry);
+void RegisterBuiltinPropertyProviders(NodeTypeRegistry& registry);
+void RegisterBuiltinFastProperties(NodeTypeRegistry& registry);
+
+#endif // NODETYPEREGISTRY_H
@@ -0,0 +1,537 @@
+#include "objectindex.h"
+#include "nodetyperegistry.h"
+#include "spatialindex.h"
+#include "threadbatches.h"
+
+#include <xpathselect/xpathquerypart.h>
+
+#include <QCoreApplication>
+#include <QEvent>
+#include <QMap>
+#include <QMutexLocker>
+#include <QThread>
+#include <QtGui/QGuiApplication>
+#include <QtGui/QWindow>
+#include <QtWidgets/QApplication>
+#include <QtWidgets/QGraphicsObject>
+#include <QtWidgets/QGraphicsScene>
+#include <QtWidgets/QGraphicsView>
+#include <QtWidgets/QWidget>
+#include <QtQuick/QQuickItem>
+
+#include <private/qhooks_p.h>
+
+#include <queue>
+
+ObjectIndex* index_instance = nullptr;
+QHooks::AddQObjectCallback previous_add_hook = nullptr;
+QHooks::RemoveQObjectCallback previous_remove_hook = nullptr;
+
+bool TraceToEntries(QObject* object, QSet<QObject*> const& entries, QSet<QObject*>& reachable,
+                    QSet<QObject*>& unreachable, bool& untraceable);
+bool IsTopLevel(QObject* object);
+
+ObjectIndex& ObjectIndex::Instance()
+{
+    // Deliberately leaked, the hooks may run until the very end of the process.
+    static ObjectIndex* index = new ObjectIndex;
+    return *index;
+}
+
+ObjectIndex::ObjectIndex()
+    : next_sequence_(0)
+    , top_level_version_(0)
+{
+    // The node types in qtnode.h that don't wrap a QObject:
+    non_object_names_ << "QModelIndex" << "QmlModelRow" << "QTableWidgetItem" << "QTreeWidgetItem"
+                      << "QGraphicsItem" << "QGraphicsPathItem" << "QGraphicsRectItem" << "QGraphicsEllipseItem"
+                      << "QGraphicsPolygonItem" << "QGraphicsLineItem" << "QGraphicsPixmapItem"
+                      << "QGraphicsSimpleTextItem" << "QGraphicsItemGroup";
+
+    index_instance = this;
+    previous_add_hook = reinterpret_cast<QHooks::AddQObjectCallback>(qtHookData[QHooks::AddQObject]);
+    previous_remove_hook = reinterpret_cast<QHooks::RemoveQObjectCallback>(qtHookData[QHooks::RemoveQObject]);
+    qtHookData[QHooks::AddQObject] = reinterpret_cast<quintptr>(&ObjectIndex::OnAddQObject);
+    qtHookData[QHooks::RemoveQObject] = reinterpret_cast<quintptr>(&ObjectIndex::OnRemoveQObject);
+
+    // The hooks report the objects created from now on, find the ones that
+    // exist already through the object tree:
+    QMutexLocker lock(&mutex_);
+    if (qobject_cast<QApplication*>(QCoreApplication::instance()))
+    {
+        foreach (QWidget* widget, QApplication::topLevelWidgets())
+        {
+            top_level_.append(widget);
+            AddTree(widget);
+        }
+    }
+    if (qobject_cast<QGuiApplication*>(QCoreApplication::instance()))
+    {
+        foreach (QWindow* window, QGuiApplication::allWindows())
+        {
+            top_level_.append(window);
+            AddTree(window);
+        }
+    }
+    if (QCoreApplication::instance())
+    {
+        AddTree(QCoreApplication::instance());
+        // widgets become (or stop being) top level widgets on reparenting:
+        QCoreApplication::instance()->installEventFilter(this);
+    }
+}
+
+void ObjectIndex::OnAddQObject(QObject* object)
+{
+    {
+        QMutexLocker lock(&index_instance->mutex_);
+        index_instance->pending_.insert(object, index_instance->next_sequence_++);
+    }
+    if (previous_add_hook)
+        previous_add_hook(object);
+}
+
+void ObjectIndex::OnRemoveQObject(QObject* object)
+{
+    {
+        QMutexLocker lock(&index_instance->mutex_);
+        index_instance->Remove(object);
+    }
+    if (previous_remove_hook)
+        previous_remove_hook(object);
+}
+
+void ObjectIndex::AddTree(QObject* object)
+{
+    if (pending_.contains(object))
+        return;
+
+    pending_.insert(object, next_sequence_++);
+    foreach (QObject* child, object->children())
+        AddTree(child);
+    if (QQuickItem* item = qobject_cast<QQuickItem*>(object))
+    {
+        foreach (QQuickItem* child, item->childItems())
+            AddTree(child);
+    }
+}
+
+void ObjectIndex::Resolve()
+{
+    QList<QObject*> resolved;
+    {
+        QMutexLocker lock(&mutex_);
+        if (pending_.isEmpty())
+            return;
+
+        QMap<quint64, QObject*> new_top_level;
+        QThread* main_thread = QCoreApplication::instance()->thread();
+        for (auto pending = pending_.constBegin(); pending != pending_.constEnd(); ++pending)
+        {
+            QObject* object = pending.key();
+            // Objects of other threads may still be under construction, and
+            // their objectName may change at any time:
+            if (object->thread() != main_thread)
+            {
+                foreign_.insert(object);
+                foreign_dirty_.insert(object);
+                continue;
+            }
+
+            Entry entry;
+            entry.name = QByteArray::fromStdString(NodeTypeRegistry::Instance().Handlers(object->metaObject()).name);
+            entry.object_name = object->objectName();
+            by_name_[entry.name].insert(object);
+            if (!entry.object_name.isEmpty())
+                by_object_name_[entry.object_name].insert(object);
+            entries_.insert(object, entry);
+            resolved.append(object);
+
+            if (IsTopLevel(object) && !top_level_.contains(object))
+                new_top_level.insert(pending.value(), object);
+        }
+        pending_.clear();
+
+        if (!new_top_level.isEmpty())
+        {
+            top_level_ += new_top_level.values();
+            ++top_level_version_;
+        }
+    }
+
+    foreach (QObject* object, resolved)
+        connect(object, SIGNAL(objectNameChanged(QString)), this, SLOT(OnObjectNameChanged(QString)));
+}
+
+void ObjectIndex::Remove(QObject* object)
+{
+    pending_.remove(object);
+    foreign_.remove(object);
+    foreign_dirty_.remove(object);
+    foreign_entries_.remove(object);
+    if (top_level_.removeOne(object))
+        ++top_level_version_;
+
+    auto entry = entries_.find(object);
+    if (entry == entries_.end())
+        return;
+
+    auto named = by_name_.find(entry->name);
+    named->remove(object);
+    if (named->isEmpty())
+        by_name_.erase(named);
+
+    if (!entry->object_name.isEmpty())
+    {
+        auto object_named = by_object_name_.find(entry->object_name);
+        object_named->remove(object);
+        if (object_named->isEmpty())
+            by_object_name_.erase(object_named);
+    }
+    entries_.erase(entry);
+}
+
+void ObjectIndex::OnObjectNameChanged(QString const& object_name)
+{
+    QObject* object = sender();
+
+    QMutexLocker lock(&mutex_);
+    auto entry = entries_.find(object);
+    if (entry == entries_.end())
+        return;
+
+    if (!entry->object_name.isEmpty())
+    {
+        auto object_named = by_object_name_.find(entry->object_name);
+        object_named->remove(object);
+        if (object_named->isEmpty())
+            by_object_name_.erase(object_named);
+    }
+    entry->object_name = object_name;
+    if (!object_name.isEmpty())
+        by_object_name_[object_name].insert(object);
+}
+
+QHash<QObject*, ObjectIndex::Entry> ObjectIndex::ReadForeign()
+{
+    QMutex read_mutex;
+    QHash<QObject*, const QMetaObject*> classes;
+    QHash<QObject*, QString> object_names;
+    ThreadBatches batches;
+    {
+        // Objects are removed from foreign_ before they are destroyed, so
+        // they stay alive while the lock is held:
+        QMutexLocker lock(&mutex_);
+        foreach (QObject* object, foreign_dirty_)
+        {
+            batches.Add(object, [this, object, &read_mutex, &classes, &object_names] {
+                bool first_read;
+                {
+                    // Destroyed before its thread got to this batch? It can't
+                    // be destroyed while the batch runs, in its own thread.
+                    QMutexLocker lock(&mutex_);
+                    if (!foreign_.contains(object))
+                        return;
+                    // Renamed from here on, it is read again next time:
+                    foreign_dirty_.remove(object);
+                    first_read = !foreign_entries_.contains(object);
+                }
+                const QMetaObject* meta_object = object->metaObject();
+                QString object_name = object->objectName();
+                if (first_read)
+                {
+                    // The class is final by now, only the name may change.
+                    // Connected from here, where the object can't go away
+                    // in the meantime:
+                    connect(object, &QObject::objectNameChanged, this, [this, object] {
+                        QMutexLocker lock(&mutex_);
+                        if (foreign_.contains(object))
+                            foreign_dirty_.insert(object);
+                    }, Qt::DirectConnection);
+                }
+
+                QMutexLocker lock(&read_mutex);
+                classes.insert(object, meta_object);
+                object_names.insert(object, object_name);
+            }, false);
+        }
+    }
+    batches.Run();
+
+    // The registry is only used from this thread:
+    NodeTypeRegistry& registry = NodeTypeRegistry::Instance();
+    QMutexLocker lock(&mutex_);
+    for (auto meta_object = classes.constBegin(); meta_object != classes.constEnd(); ++meta_object)
+    {
+        QObject* object = meta_object.key();
+        // Destroyed since:
+        if (!foreign_.contains(object))
+            continue;
+        Entry& entry = foreign_entries_[object];
+        entry.name = QByteArray::fromStdString(registry.Handlers(meta_object.value()).name);
+        entry.object_name = object_names.value(object);
+    }
+    return foreign_entries_;
+}
+
+QSet<QObject*> ObjectIndex::FindByName(std::string const& name)
+{
+    Resolve();
+
+    QSet<QObject*> objects;
+    {
+        QMutexLocker lock(&mutex_);
+        objects = by_name_.value(QByteArray::fromStdString(name));
+    }
+    QByteArray utf8_name = QByteArray::fromStdString(name);
+    QHash<QObject*, Entry> foreign = ReadForeign();
+    for (auto entry = foreign.constBegin(); entry != foreign.constEnd(); ++entry)
+    {
+        if (entry->name == utf8_name)
+            objects.insert(entry.key());
+    }
+    return objects;
+}
+
+QSet<QObject*> ObjectIndex::FindByObjectName(QString const& object_name)
+{
+    Resolve();
+
+    QSet<QObject*> objects;
+    {
+        QMutexLocker lock(&mutex_);
+        objects = by_object_name_.value(object_name);
+    }
+    QHash<QObject*, Entry> foreign = ReadForeign();
+    for (auto entry = foreign.constBegin(); entry != foreign.constEnd(); ++entry)
+    {
+        if (entry->object_name == object_name)
+            objects.insert(entry.key());
+    }
+    return objects;
+}
+
+QList<QObject*> ObjectIndex::TopLevelObjects(quint64* version)
+{
+    Resolve();
+
+    QMutexLocker lock(&mutex_);
+    *version = top_level_version_;
+    return top_level_;
+}
+
+bool ObjectIndex::eventFilter(QObject* watched, QEvent* event)
+{
+    if (event->type() == QEvent::ParentChange && watched->isWidgetType())
+    {
+        QMutexLocker lock(&mutex_);
+        // Widgets that haven't been looked at yet are dealt with then:
+        if (entries_.contains(watched))
+        {
+            bool is_top_level = IsTopLevel(watched);
+            if (is_top_level != top_level_.contains(watched))
+            {
+                if (is_top_level)
+                    top_level_.append(watched);
+                else
+                    top_level_.removeOne(watched);
+                ++top_level_version_;
+            }
+        }
+    }
+    return false;
+}
+
+bool IsTopLevel(QObject* object)
+{
+    // All windows, whether top level or not, like QGuiApplication::allWindows,
+    // and the widgets listed by QApplication::topLevelWidgets:
+    if (object->isWindowType())
+        return true;
+    if (object->isWidgetType())
+    {
+        QWidget* widget = static_cast<QWidget*>(object);
+        return widget->isWindow() && widget->windowType() != Qt::Desktop;
+    }
+    return false;
+}
+
+bool ObjectIndex::IsNonObjectNodeName(std::string const& name) const
+{
+    return non_object_names_.contains(QByteArray::fromStdString(name));
+}
+
+void ObjectIndex::RegisterNonObjectNodeName(std::string const& name)
+{
+    non_object_names_.insert(QByteArray::fromStdString(name));
+}
+
+// Return true if 'object' can be reached from one of 'entries' along the
+// paths the built-in children providers take, in reverse: the QObject parent,
+// the parent item and, since QQuickWindow data and QQuickView root objects are
+// children of the window, the window of an item; for QGraphicsObjects the
+// parent item, or the views of the scene. The objects found on such a path are
+// added to 'reachable', the others to 'unreachable'. Objects of other threads
+// can't be reached, their ancestors live in the same thread. 'untraceable' is
+// set if a path leads through a node that wraps no QObject, e.g. a plain
+// QGraphicsItem, which the index can't follow.
+bool TraceToEntries(QObject* object, QSet<QObject*> const& entries, QSet<QObject*>& reachable,
+                    QSet<QObject*>& unreachable, bool& untraceable)
+{
+    if (!object || unreachable.contains(object))
+        return false;
+    if (reachable.contains(object))
+        return true;
+    if (entries.contains(object))
+    {
+        reachable.insert(object);
+        return true;
+    }
+    // Until found otherwise, which also ends cycles:
+    unreachable.insert(object);
+    if (ThreadBatches::IsForeign(object))
+        return false;
+
+    auto trace = [&entries, &reachable, &unreachable, &untraceable](QObject* ancestor) {
+        return TraceToEntries(ancestor, entries, reachable, unreachable, untraceable);
+    };
+    // Each one may lie on a path, so all of them are traced:
+    bool reaches = trace(object->parent());
+    if (QQuickItem* item = qobject_cast<QQuickItem*>(object))
+    {
+        reaches = trace(item->parentItem()) || reaches;
+        reaches = trace(item->window()) || reaches;
+    }
+    else if (QGraphicsObject* graphics_object = qobject_cast<QGraphicsObject*>(object))
+    {
+        if (QGraphicsItem* parent_item = graphics_object->parentItem())
+        {
+            if (QGraphicsObject* parent_object = parent_item->toGraphicsObject())
+                reaches = trace(parent_object) || reaches;
+            else
+                untraceable = true;
+        }
+        else if (QGraphicsScene* scene = graphics_object->scene())
+        {
+            foreach (QGraphicsView* view, scene->views())
+                reaches = trace(view) || reaches;
+        }
+    }
+
+    if (reaches)
+    {
+        unreachable.remove(object);
+        reachable.insert(object);
+    }
+    return reaches;
+}
+
+QObject* GetWrappedObject(xpathselect::Node::Ptr const& node)
+{
+    const QObjectNode* object_node = dynamic_cast<const QObjectNode*>(node.get());
+    return object_node ? object_node->getWrappedObject() : nullptr;
+}
+
+bool FindIndexedDescendants(DBusNode::Ptr const& root,
+                            xpathselect::XPathQueryPart const& part,
+                            xpathselect::NodeList& matches)
+{
+    ObjectIndex& index = ObjectIndex::Instance();
+
+    const std::string* object_name = nullptr;
+    const std::string* intersects = nullptr;
+    for (auto const& param : part.parameter)
+    {
+        if (param.param_name == "objectName")
+            object_name = boost::get<std::string>(&param.param_value);
+        else if (param.param_name == "intersects")
+            intersects = boost::get<std::string>(&param.param_value);
+    }
+    QRect area;
+    bool by_area = intersects && SpatialIndex::Instance().IsEnabled() && ParseRect(*intersects, area);
+    // 'is:Type' tests match derived classes too, which the name index can't
+    // tell. Only the objectName and spatial indices help with those.
+    bool by_name = part.node_name_ != "*" && !part.IsTypeTest();
+    if ((!by_name && !object_name && !by_area) || (by_name && index.IsNonObjectNodeName(part.node_name_)))
+        return false;
+
+    // Each index that applies narrows the candidates down further:
+    QSet<QObject*> candidates;
+    bool narrowed = false;
+    auto narrow = [&candidates, &narrowed](QSet<QObject*> const& objects) {
+        if (narrowed)
+            candidates.intersect(objects);
+        else
+            candidates = objects;
+        narrowed = true;
+    };
+    if (by_name)
+        narrow(index.FindByName(part.node_name_));
+    if (object_name)
+        narrow(index.FindByObjectName(QString::fromStdString(*object_name)));
+    if (by_area)
+        narrow(SpatialIndex::Instance().FindIntersecting(area));
+
+    xpathselect::NodeList found;
+    QSet<QObject*> reached;
+    if (part.Matches(root))
+        found.push_back(root);
+    QObject* root_object = GetWrappedObject(root);
+
+    // Candidates without a path down from the root's children (e.g. models,
+    // timers or actions without a parent, and objects of other threads)
+    // can't be in the tree, so they are dropped rather than looked for:
+    xpathselect::NodeVector root_children = root->ChildrenFor(part);
+    QSet<QObject*> entries;
+    for (xpathselect::Node::Ptr const& child : root_children)
+        entries.insert(GetWrappedObject(child));
+    QSet<QObject*> relevant;
+    QSet<QObject*> unreachable;
+    bool untraceable = false;
+    QSet<QObject*> reachable_candidates;
+    foreach (QObject* candidate, candidates)
+    {
+        if (candidate == root_object || TraceToEntries(candidate, entries, relevant, unreachable, untraceable))
+            reachable_candidates.insert(candidate);
+    }
+    if (untraceable)
+        return false;
+    if (reachable_candidates.contains(root_object))
+        reached.insert(root_object);
+
+    // Walk down from the root, but only into the subtrees that hold a
+    // candidate. Breadth first, so that ids are handed out in the same order
+    // as in a full traversal.
+    std::queue<xpathselect::Node::Ptr> queue;
+    auto visit = [&](xpathselect::NodeVector const& children) {
+        for (xpathselect::Node::Ptr const& child : children)
+        {
+            QObject* object = GetWrappedObject(child);
+            if (!relevant.contains(object))
+                continue;
+            if (reachable_candidates.contains(object))
+            {
+                reached.insert(object);
+                if (part.Matches(child))
+                    found.push_back(child);
+            }
+            queue.push(child);
+        }
+    };
+    visit(root_children);
+    while (!queue.empty())
+    {
+        xpathselect::Node::Ptr node = queue.front();
+        queue.pop();
+        visit(node->ChildrenFor(part));
+    }
+
+    // Candidates that weren't found although they have a path down from the
+    // root are reachable in ways the index doesn't know about (e.g. through
+    // custom children providers). Only a full traversal can tell.
+    if (reached.size() != reachable_candidates.size())
+        return false;
+
+    matches.splice(matches.end(), found);
+    return true;
+}
@@ -0,0 +1,111 @@
+#ifndef OBJECTINDEX_H
+#define OBJECTINDEX_H
+
+#include "qtnode.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QString>
+
+#include <string>
+
+/// Indexes all QObjects in the application by node name and by objectName, so
+/// that queries like '//QQuickListView' or '//*[objectName="saveButton"]' need
+/// not visit the whole object tree. Also keeps the list of top level widgets
+/// and windows, which are the children of the root node.
+///
+/// Objects are registered through Qt's AddQObject/RemoveQObject hooks (see
+/// qhooks_p.h). The hooks run inside QObject's constructor, in whatever
+/// thread creates the object, so they only note the object down. Its class
+/// and objectName are read the next time the index is used. Objects that live
+/// in other threads than the main thread are read in their own threads (see
+/// ThreadBatches), on the first lookup after they were created or renamed.
+///
+/// The hooks cost every QObject construction and destruction in the process
+/// a lock of an (in all likelihood uncontended) mutex and a hash update. That
+/// is well below the cost of the allocations QObject makes itself.
+class ObjectIndex : public QObject
+{
+    Q_OBJECT
+public:
+    /// Return the index, installing the hooks on first use. Objects that exist
+    /// by then are found by walking the object tree.
+    static ObjectIndex& Instance();
+
+    /// Return all objects whose node name is 'name'.
+    QSet<QObject*> FindByName(std::string const& name);
+
+    /// Return all objects whose objectName is 'object_name'.
+    QSet<QObject*> FindByObjectName(QString const& object_name);
+
+    /// Return true if nodes that don't wrap a QObject can be called 'name',
+    /// which means the index can't answer queries for that name.
+    bool IsNonObjectNodeName(std::string const& name) const;
+
+    /// Declare 'name' as the name of nodes that don't wrap a QObject, e.g.
+    /// "QModelIndex".
+    void RegisterNonObjectNodeName(std::string const& name);
+
+    /// Return the top level widgets and all windows, in the order they were
+    /// created. 'version' is set to a number that changes whenever the list
+    /// does.
+    QList<QObject*> TopLevelObjects(quint64* version);
+
+protected:
+    bool eventFilter(QObject* watched, QEvent* event);
+
+private slots:
+    void OnObjectNameChanged(QString const& object_name);
+
+private:
+    ObjectIndex();
+
+    static void OnAddQObject(QObject* object);
+    static void OnRemoveQObject(QObject* object);
+
+    void AddTree(QObject* object);
+    void Resolve();
+    void Remove(QObject* object);
+
+    struct Entry
+    {
+        QByteArray name;
+        QString object_name;
+    };
+
+    /// Return the entries of the objects of other threads. The ones that are
+    /// new or were renamed since the last call are read in the threads they
+    /// live in; only those threads are asked. Objects whose thread doesn't get
+    /// to it are left out, or keep their previous entry.
+    QHash<QObject*, Entry> ReadForeign();
+
+    // guards everything the hooks touch, i.e. all members below:
+    QMutex mutex_;
+    // objects that haven't been looked at yet, with their creation order:
+    QHash<QObject*, quint64> pending_;
+    quint64 next_sequence_;
+    QSet<QObject*> foreign_;
+    // objects of other threads that are new or were renamed since read:
+    QSet<QObject*> foreign_dirty_;
+    QHash<QObject*, Entry> foreign_entries_;
+    QHash<QObject*, Entry> entries_;
+    QHash<QByteArray, QSet<QObject*> > by_name_;
+    QHash<QString, QSet<QObject*> > by_object_name_;
+    QList<QObject*> top_level_;
+    quint64 top_level_version_;
+
+    // only used from the main thread:
+    QSet<QByteArray> non_object_names_;
+};
+
+/// Find the nodes in the tree rooted at 'root' that match 'part' through the
+/// object index. Returns false if the index can't answer the query, see
+/// xpathselect::Node::FindDescendants.
+bool FindIndexedDescendants(DBusNode::Ptr const& root,
+                            xpathselect::XPathQueryPart const& part,
+                            xpathselect::NodeList& matches);
+
+#endif // OBJECTINDEX_H
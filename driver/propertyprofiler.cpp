@@ -0,0 +1,151 @@
+#include "propertyprofiler.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QMetaObject>
+#include <QMetaProperty>
+#include <QReadLocker>
+#include <QThread>
+#include <QWriteLocker>
+
+#include <algorithm>
+
+// Don't exclude anything automatically on the strength of a single slow read.
+const int MIN_READS_FOR_EXCLUSION = 3;
+
+PropertyProfiler& PropertyProfiler::Instance()
+{
+    static PropertyProfiler profiler;
+    return profiler;
+}
+
+PropertyProfiler::PropertyProfiler()
+    : enabled_(false)
+    , cost_limit_ns_(0)
+    , exclusions_version_(0)
+    , has_exclusions_(0)
+{
+}
+
+bool PropertyProfiler::IsEnabled() const
+{
+    return enabled_ && QCoreApplication::instance()
+        && QThread::currentThread() == QCoreApplication::instance()->thread();
+}
+
+void PropertyProfiler::SetEnabled(bool enabled)
+{
+    enabled_ = enabled;
+}
+
+void PropertyProfiler::Record(const QMetaObject* meta, int property_index, qint64 nsecs)
+{
+    ReadCost& cost = costs_[PropertyKey(meta->className(), property_index)];
+    if (cost.reads == 0)
+    {
+        cost.class_name = meta->className();
+        cost.property_name = meta->property(property_index).name();
+    }
+    cost.total_ns += nsecs;
+    cost.max_ns = qMax(cost.max_ns, nsecs);
+    ++cost.reads;
+
+    if (cost_limit_ns_ > 0
+        && cost.reads >= MIN_READS_FOR_EXCLUSION
+        && cost.total_ns / cost.reads > cost_limit_ns_)
+    {
+        bool excluded;
+        {
+            QReadLocker lock(&exclusions_lock_);
+            excluded = excluded_.value(cost.class_name).contains(cost.property_name);
+        }
+        if (!excluded)
+        {
+            qWarning() << "Excluding slow property" << cost.property_name << "of class" << cost.class_name
+                       << "from bulk state, average read time is" << cost.total_ns / cost.reads / 1000 << "us.";
+            AddExclusion(cost.class_name, cost.property_name);
+        }
+    }
+}
+
+QVariantList PropertyProfiler::TopOffenders(int count) const
+{
+    QList<ReadCost> costs = costs_.values();
+    std::sort(costs.begin(), costs.end(), [](ReadCost const& a, ReadCost const& b) {
+        return a.total_ns > b.total_ns;
+    });
+
+    QVariantList offenders;
+    for (int i = 0; i < costs.size() && i < count; ++i)
+    {
+        ReadCost const& cost = costs.at(i);
+        offenders.append(QVariant(QVariantList {
+            QVariant(QString::fromLatin1(cost.class_name)),
+            QVariant(QString::fromLatin1(cost.property_name)),
+            QVariant(cost.total_ns / 1000),
+            QVariant(cost.max_ns / 1000),
+            QVariant(cost.reads)
+        }));
+    }
+    return offenders;
+}
+
+void PropertyProfiler::Reset()
+{
+    costs_.clear();
+}
+
+void PropertyProfiler::SetCostLimit(int usecs)
+{
+    cost_limit_ns_ = qint64(usecs) * 1000;
+}
+
+void PropertyProfiler::SetExcludedProperties(QByteArray const& class_name, QList<QByteArray> const& properties)
+{
+    QWriteLocker lock(&exclusions_lock_);
+    if (properties.isEmpty())
+        excluded_.remove(class_name);
+    else
+    {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+        excluded_[class_name] = QSet<QByteArray>(properties.begin(), properties.end());
+#else
+        excluded_[class_name] = properties.toSet();
+#endif
+    }
+    resolved_excluded_.clear();
+    has_exclusions_.storeRelease(!excluded_.isEmpty());
+    ++exclusions_version_;
+}
+
+void PropertyProfiler::AddExclusion(QByteArray const& class_name, QByteArray const& property_name)
+{
+    QWriteLocker lock(&exclusions_lock_);
+    excluded_[class_name].insert(property_name);
+    resolved_excluded_.clear();
+    has_exclusions_.storeRelease(1);
+    ++exclusions_version_;
+}
+
+bool PropertyProfiler::IsExcludedInHierarchy(const QMetaObject* meta, const char* property_name)
+{
+    QByteArray name = QByteArray::fromRawData(property_name, qstrlen(property_name));
+    {
+        QReadLocker lock(&exclusions_lock_);
+        auto resolved = resolved_excluded_.constFind(meta->className());
+        if (resolved != resolved_excluded_.constEnd())
+            return !resolved->isEmpty() && resolved->contains(name);
+    }
+
+    // Resolved once per class, by whichever thread reads an object of it first:
+    QWriteLocker lock(&exclusions_lock_);
+    auto resolved = resolved_excluded_.constFind(meta->className());
+    if (resolved == resolved_excluded_.constEnd())
+    {
+        QSet<QByteArray> properties;
+        for (const QMetaObject* m = meta; m; m = m->superClass())
+            properties.unite(excluded_.value(QByteArray(m->className())));
+        resolved = resolved_excluded_.insert(meta->className(), properties);
+    }
+    return !resolved->isEmpty() && resolved->contains(name);
+}
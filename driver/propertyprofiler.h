@@ -0,0 +1,95 @@
+#ifndef PROPERTYPROFILER_H
+#define PROPERTYPROFILER_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QReadWriteLock>
+#include <QSet>
+#include <QVariant>
+
+struct QMetaObject;
+
+/// Keeps track of how long property reads take per (class, property), and of
+/// the properties that are left out of the bulk state returned by GetState.
+///
+/// Excluded properties are only skipped when all properties of a node are
+/// collected. They can still be read when a client names them explicitly,
+/// e.g. in a query predicate.
+class PropertyProfiler
+{
+public:
+    static PropertyProfiler& Instance();
+
+    /// Read times are only recorded while profiling is enabled, and only for
+    /// reads made in the main thread (Record isn't thread safe).
+    bool IsEnabled() const;
+    void SetEnabled(bool enabled);
+
+    /// Record that reading property number 'property_index' of 'meta' (the
+    /// class declaring the property) took 'nsecs' nanoseconds.
+    void Record(const QMetaObject* meta, int property_index, qint64 nsecs);
+
+    /// Return up to 'count' of the most expensive properties, ordered by total
+    /// read time. Each entry is [class, property, total us, max us, reads].
+    QVariantList TopOffenders(int count) const;
+
+    /// Forget all recorded read times.
+    void Reset();
+
+    /// Properties whose average read time exceeds 'usecs' microseconds are
+    /// added to the exclude list of their class automatically. 0 disables
+    /// automatic exclusion.
+    void SetCostLimit(int usecs);
+
+    /// Replace the exclude list for 'class_name'. The list applies to that
+    /// class and everything that derives from it.
+    void SetExcludedProperties(QByteArray const& class_name, QList<QByteArray> const& properties);
+
+    /// Return a number that changes whenever the exclude lists do.
+    quint64 ExclusionsVersion() const { return exclusions_version_; }
+
+    /// Return true if 'property_name' must not be part of the bulk state of an
+    /// object whose class is 'meta'. Safe to call from any thread: objects are
+    /// read in the threads they live in.
+    bool IsExcluded(const QMetaObject* meta, const char* property_name)
+    {
+        return has_exclusions_.loadAcquire() && IsExcludedInHierarchy(meta, property_name);
+    }
+
+private:
+    PropertyProfiler();
+
+    struct ReadCost
+    {
+        ReadCost() : total_ns(0), max_ns(0), reads(0) {}
+        QByteArray class_name;
+        QByteArray property_name;
+        qint64 total_ns;
+        qint64 max_ns;
+        int reads;
+    };
+
+    // QML objects that declare their own properties get a per-instance copy of
+    // their type's QMetaObject, so QMetaObject pointers are not usable as keys.
+    // All copies share the class name storage, so that pointer is used instead.
+    typedef QPair<const char*, int> PropertyKey;
+
+    void AddExclusion(QByteArray const& class_name, QByteArray const& property_name);
+    bool IsExcludedInHierarchy(const QMetaObject* meta, const char* property_name);
+
+    bool enabled_;
+    qint64 cost_limit_ns_;
+    quint64 exclusions_version_;
+    QHash<PropertyKey, ReadCost> costs_;
+    // excluded_ and resolved_excluded_ are guarded by exclusions_lock_:
+    QReadWriteLock exclusions_lock_;
+    QAtomicInt has_exclusions_;
+    QHash<QByteArray, QSet<QByteArray> > excluded_;
+    // exclude lists resolved for the whole class hierarchy of an object:
+    QHash<const char*, QSet<QByteArray> > resolved_excluded_;
+};
+
+#endif // PROPERTYPROFILER_H
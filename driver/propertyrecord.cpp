@@ -0,0 +1,456 @@
+#include "propertyrecord.h"
+#include "autopilot_types.h"
+
+#include <QColor>
+#include <QDateTime>
+#include <QDBusArgument>
+#include <QDBusMetaType>
+#include <QDBusVariant>
+#include <QPoint>
+#include <QRect>
+#include <QSize>
+#include <QTime>
+#include <QUrl>
+
+#include <algorithm>
+#include <cstring>
+
+PropertyRecord::PropertyRecord()
+    : sorted_(true)
+{
+}
+
+void PropertyRecord::Reserve(int count)
+{
+    slots_.reserve(count);
+    // Most property names are short:
+    names_.reserve(count * 12);
+}
+
+bool PropertyRecord::Append(const char* name, QVariant const& value)
+{
+    Slot slot;
+    if (!MakeSlot(value, slot))
+        return false;
+
+    slot.name_size = int(std::strlen(name));
+    slot.name = AddName(name, slot.name_size);
+    slots_.push_back(slot);
+    sorted_ = false;
+    return true;
+}
+
+void PropertyRecord::Finish()
+{
+    if (sorted_)
+        return;
+
+    std::stable_sort(slots_.begin(), slots_.end(), [this](Slot const& a, Slot const& b) {
+        return Compare(a, names_.constData() + b.name, b.name_size) < 0;
+    });
+    auto end = std::unique(slots_.begin(), slots_.end(), [this](Slot const& a, Slot const& b) {
+        return Compare(a, names_.constData() + b.name, b.name_size) == 0;
+    });
+    slots_.erase(end, slots_.end());
+    sorted_ = true;
+}
+
+bool PropertyRecord::Set(QString const& name, QVariant const& value)
+{
+    Slot slot;
+    if (!MakeSlot(value, slot))
+        return false;
+
+    Finish();
+    QByteArray utf8_name = name.toUtf8();
+    int position = LowerBound(utf8_name.constData(), utf8_name.size());
+    if (position < size() && Compare(slots_[position], utf8_name.constData(), utf8_name.size()) == 0)
+    {
+        slot.name = slots_[position].name;
+        slot.name_size = slots_[position].name_size;
+        slots_[position] = slot;
+        return true;
+    }
+
+    slot.name_size = utf8_name.size();
+    slot.name = AddName(utf8_name.constData(), slot.name_size);
+    slots_.insert(slots_.begin() + position, slot);
+    return true;
+}
+
+void PropertyRecord::SetPacked(QString const& name, QVariant const& packed_value)
+{
+    Finish();
+    QByteArray utf8_name = name.toUtf8();
+    int position = LowerBound(utf8_name.constData(), utf8_name.size());
+    if (position < size() && Compare(slots_[position], utf8_name.constData(), utf8_name.size()) == 0)
+    {
+        SetPacked(position, packed_value);
+        return;
+    }
+
+    Slot slot;
+    slot.name_size = utf8_name.size();
+    slot.name = AddName(utf8_name.constData(), slot.name_size);
+    slot.kind = Packed;
+    slot.value.index = int(packed_.size());
+    packed_.push_back(packed_value);
+    slots_.insert(slots_.begin() + position, slot);
+}
+
+void PropertyRecord::SetPacked(int index, QVariant const& packed_value)
+{
+    Slot& slot = slots_[index];
+    slot.kind = Packed;
+    slot.value.index = int(packed_.size());
+    packed_.push_back(packed_value);
+}
+
+QVariant PropertyRecord::value(QString const& name) const
+{
+    int index = Find(name);
+    return index >= 0 ? PackedAt(index) : QVariant();
+}
+
+int PropertyRecord::Find(QString const& name) const
+{
+    QByteArray utf8_name = name.toUtf8();
+    if (!sorted_)
+    {
+        // Not sorted yet, the first one appended is the one that counts:
+        for (int i = 0; i < size(); ++i)
+        {
+            if (Compare(slots_[i], utf8_name.constData(), utf8_name.size()) == 0)
+                return i;
+        }
+        return -1;
+    }
+
+    int position = LowerBound(utf8_name.constData(), utf8_name.size());
+    if (position < size() && Compare(slots_[position], utf8_name.constData(), utf8_name.size()) == 0)
+        return position;
+    return -1;
+}
+
+qint64 PropertyRecord::IntegerAt(int index) const
+{
+    Slot const& slot = slots_[index];
+    switch (slot.kind)
+    {
+    case Bool:
+        return slot.value.boolean ? 1 : 0;
+    case Int:
+        return slot.value.int32;
+    case UInt:
+    case DateTime:
+        return slot.value.uint32;
+    case LongLong:
+        return slot.value.int64;
+    default:
+        return 0;
+    }
+}
+
+QString PropertyRecord::NameAt(int index) const
+{
+    Slot const& slot = slots_[index];
+    return QString::fromUtf8(names_.constData() + slot.name, slot.name_size);
+}
+
+QVariant PropertyRecord::PackedAt(int index) const
+{
+    Slot const& slot = slots_[index];
+    if (slot.kind == Packed)
+        return packed_[slot.value.index];
+
+    QVariant values[MaxPackedSize];
+    int count = UnpackedValuesAt(index, values);
+    QVariantList packed;
+    packed.reserve(count);
+    for (int i = 0; i < count; ++i)
+        packed.append(values[i]);
+    return packed;
+}
+
+void PropertyRecord::MarshallPackedAt(int index, QDBusArgument& argument) const
+{
+    Slot const& slot = slots_[index];
+    argument.beginArray(qMetaTypeId<QDBusVariant>());
+    if (slot.kind == Packed)
+    {
+        foreach (QVariant const& value, packed_[slot.value.index].toList())
+            argument << QDBusVariant(value);
+    }
+    else
+    {
+        QVariant values[MaxPackedSize];
+        int count = UnpackedValuesAt(index, values);
+        for (int i = 0; i < count; ++i)
+            argument << QDBusVariant(values[i]);
+    }
+    argument.endArray();
+}
+
+// The same shapes as PackProperty: set 'values' to the [type, values...] list
+// for the value at 'index', which must not be Packed, and return its length.
+int PropertyRecord::UnpackedValuesAt(int index, QVariant (&values)[MaxPackedSize]) const
+{
+    Slot const& slot = slots_[index];
+    values[0] = QVariant(TYPE_PLAIN);
+    switch (slot.kind)
+    {
+    case Bool:
+        values[1] = QVariant(slot.value.boolean);
+        return 2;
+    case Int:
+        values[1] = QVariant(int(slot.value.int32));
+        return 2;
+    case UInt:
+        values[1] = QVariant(uint(slot.value.uint32));
+        return 2;
+    case LongLong:
+        values[1] = QVariant(qlonglong(slot.value.int64));
+        return 2;
+    case ULongLong:
+        values[1] = QVariant(qulonglong(slot.value.uint64));
+        return 2;
+    case Double:
+        values[1] = QVariant(slot.value.real);
+        return 2;
+    case String:
+        values[1] = QVariant(strings_[slot.value.index]);
+        return 2;
+    case StringList:
+        values[1] = QVariant(string_lists_[slot.value.index]);
+        return 2;
+    case Point:
+    case Size:
+        values[0] = QVariant(slot.kind == Point ? TYPE_POINT : TYPE_SIZE);
+        values[1] = QVariant(slot.value.ints[0]);
+        values[2] = QVariant(slot.value.ints[1]);
+        return 3;
+    case Rect:
+    case Color:
+    case Time:
+        values[0] = QVariant(slot.kind == Rect ? TYPE_RECT : slot.kind == Color ? TYPE_COLOR : TYPE_TIME);
+        for (int i = 0; i < 4; ++i)
+            values[i + 1] = QVariant(slot.value.ints[i]);
+        return 5;
+    case DateTime:
+        values[0] = QVariant(TYPE_DATETIME);
+        values[1] = QVariant(uint(slot.value.uint32));
+        return 2;
+    case Packed:
+        break;
+    }
+    return 0;
+}
+
+QVariantMap PropertyRecord::ToVariantMap() const
+{
+    QVariantMap packed_properties;
+    for (int i = 0; i < size(); ++i)
+    {
+        // The first one appended wins, as in Finish:
+        QString name = NameAt(i);
+        if (!packed_properties.contains(name))
+            packed_properties.insert(name, PackedAt(i));
+    }
+    return packed_properties;
+}
+
+PropertyRecord PropertyRecord::FromVariantMap(QVariantMap const& packed_properties)
+{
+    PropertyRecord record;
+    record.Reserve(packed_properties.size());
+    // In order already, so each one is appended at the end:
+    for (auto property = packed_properties.constBegin(); property != packed_properties.constEnd(); ++property)
+        record.SetPacked(property.key(), property.value());
+    return record;
+}
+
+// The same conversions as PackProperty.
+bool PropertyRecord::MakeSlot(QVariant const& value, Slot& slot)
+{
+    switch (value.userType())
+    {
+    case QVariant::Bool:
+        slot.kind = Bool;
+        slot.value.boolean = value.toBool();
+        return true;
+    case QVariant::Int:
+        slot.kind = Int;
+        slot.value.int32 = value.toInt();
+        return true;
+    case QVariant::UInt:
+        slot.kind = UInt;
+        slot.value.uint32 = value.toUInt();
+        return true;
+    case QVariant::LongLong:
+        slot.kind = LongLong;
+        slot.value.int64 = value.toLongLong();
+        return true;
+    case QVariant::ULongLong:
+        slot.kind = ULongLong;
+        slot.value.uint64 = value.toULongLong();
+        return true;
+    // Depending on the architecture, qreal may be a float. D-Bus only knows
+    // doubles.
+    case QVariant::Double:
+    case QMetaType::Float:
+        slot.kind = Double;
+        slot.value.real = value.toDouble();
+        return true;
+    case QVariant::String:
+    case QVariant::ByteArray:
+    case QVariant::Url:
+        slot.kind = String;
+        slot.value.index = int(strings_.size());
+        if (value.userType() == QVariant::String)
+            strings_.push_back(value.toString());
+        else if (value.userType() == QVariant::ByteArray)
+            strings_.push_back(QString(qvariant_cast<QByteArray>(value)));
+        else
+            strings_.push_back(value.toUrl().toString());
+        return true;
+    case QVariant::StringList:
+        slot.kind = StringList;
+        slot.value.index = int(string_lists_.size());
+        string_lists_.push_back(value.toStringList());
+        return true;
+    case QVariant::Point:
+    {
+        QPoint point = qvariant_cast<QPoint>(value);
+        slot.kind = Point;
+        slot.value.ints[0] = point.x();
+        slot.value.ints[1] = point.y();
+        return true;
+    }
+    case QVariant::Rect:
+    {
+        QRect rect = qvariant_cast<QRect>(value);
+        slot.kind = Rect;
+        slot.value.ints[0] = rect.x();
+        slot.value.ints[1] = rect.y();
+        slot.value.ints[2] = rect.width();
+        slot.value.ints[3] = rect.height();
+        return true;
+    }
+    case QVariant::Size:
+    {
+        QSize size = qvariant_cast<QSize>(value);
+        slot.kind = Size;
+        slot.value.ints[0] = size.width();
+        slot.value.ints[1] = size.height();
+        return true;
+    }
+    case QVariant::Color:
+    {
+        QColor color = qvariant_cast<QColor>(value).toRgb();
+        slot.kind = Color;
+        slot.value.ints[0] = color.red();
+        slot.value.ints[1] = color.green();
+        slot.value.ints[2] = color.blue();
+        slot.value.ints[3] = color.alpha();
+        return true;
+    }
+    case QVariant::Date:
+    case QVariant::DateTime:
+        slot.kind = DateTime;
+        slot.value.uint32 = value.toDateTime().toTime_t();
+        return true;
+    case QVariant::Time:
+    {
+        QTime time = qvariant_cast<QTime>(value);
+        slot.kind = Time;
+        slot.value.ints[0] = time.hour();
+        slot.value.ints[1] = time.minute();
+        slot.value.ints[2] = time.second();
+        slot.value.ints[3] = time.msec();
+        return true;
+    }
+    default:
+        return false; // unsupported type, will not be sent to the client.
+    }
+}
+
+int PropertyRecord::AddName(const char* name, int size)
+{
+    int offset = names_.size();
+    names_.append(name, size);
+    return offset;
+}
+
+int PropertyRecord::Compare(Slot const& slot, const char* name, int size) const
+{
+    int result = std::memcmp(names_.constData() + slot.name, name, std::min(slot.name_size, size));
+    return result != 0 ? result : slot.name_size - size;
+}
+
+int PropertyRecord::LowerBound(const char* name, int size) const
+{
+    auto position = std::lower_bound(slots_.begin(), slots_.end(), 0, [this, name, size](Slot const& slot, int) {
+        return Compare(slot, name, size) < 0;
+    });
+    return int(position - slots_.begin());
+}
+
+namespace
+{
+    // A property of a record being marshalled. The QDBusVariant for its value
+    // only holds a pointer to it, which QVariant stores without allocating,
+    // and the value is written straight from the record.
+    struct RecordProperty
+    {
+        const PropertyRecord* record;
+        int index;
+    };
+}
+
+struct RecordPropertyRef
+{
+    const RecordProperty* property;
+};
+Q_DECLARE_TYPEINFO(RecordPropertyRef, Q_PRIMITIVE_TYPE);
+Q_DECLARE_METATYPE(RecordPropertyRef)
+
+QDBusArgument& operator<<(QDBusArgument& argument, RecordPropertyRef const& ref)
+{
+    // QtDBus marshals a default constructed one to learn the signature:
+    if (ref.property)
+        ref.property->record->MarshallPackedAt(ref.property->index, argument);
+    else
+    {
+        argument.beginArray(qMetaTypeId<QDBusVariant>());
+        argument.endArray();
+    }
+    return argument;
+}
+
+// Never demarshalled, records are read back as QVariantMaps (see
+// FromVariantMap).
+const QDBusArgument& operator>>(QDBusArgument const& argument, RecordPropertyRef& ref)
+{
+    ref.property = nullptr;
+    return argument;
+}
+
+QDBusArgument& operator<<(QDBusArgument& argument, PropertyRecord const& record)
+{
+    static const int record_property_type = qDBusRegisterMetaType<RecordPropertyRef>();
+    Q_UNUSED(record_property_type);
+
+    // What QtDBus does for a QVariantMap, but the values are written from
+    // their slots rather than packed into a QVariantList first:
+    argument.beginMap(QVariant::String, qMetaTypeId<QDBusVariant>());
+    for (int i = 0; i < record.size(); ++i)
+    {
+        RecordProperty property = { &record, i };
+        RecordPropertyRef ref = { &property };
+        argument.beginMapEntry();
+        argument << record.NameAt(i) << QDBusVariant(QVariant::fromValue(ref));
+        argument.endMapEntry();
+    }
+    argument.endMap();
+    return argument;
+}
@@ -0,0 +1,143 @@
+#ifndef PROPERTYRECORD_H
+#define PROPERTYRECORD_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVariant>
+#include <QVariantMap>
+
+#include <vector>
+
+class QDBusArgument;
+
+/// The properties of a single node, in typed slots.
+///
+/// Values are kept the way they are read (ints, doubles, string references,
+/// rectangles, colours, ...) in one flat vector, and names in one shared
+/// buffer. They are only packed into the [type, values...] lists clients
+/// expect (see PackProperty) when looked up by name or marshalled, so reading
+/// the properties of a node takes a few allocations instead of a list per
+/// property.
+///
+/// Properties are appended in any order while they are read, and sorted by
+/// name once all of them are there (see Finish).
+class PropertyRecord
+{
+public:
+    /// The kinds of values. Their numbers are part of the binary state format
+    /// (see binarystate.h), so new kinds go at the end.
+    enum Kind
+    {
+        Bool,
+        Int,
+        UInt,
+        LongLong,
+        ULongLong,
+        Double,
+        String,
+        StringList,
+        Point,
+        Rect,
+        Size,
+        Color,
+        DateTime,
+        Time,
+        /// A value packed already, e.g. by a PropertyProvider.
+        Packed,
+    };
+
+    PropertyRecord();
+
+    void Reserve(int count);
+
+    /// Add the property 'name' with the unpacked value 'value', without
+    /// checking whether there is one of that name already. Return false (and
+    /// add nothing) if 'value' is of a type that can't be sent to clients.
+    bool Append(const char* name, QVariant const& value);
+    /// Sort the properties appended so far. Of properties that were appended
+    /// more than once, the first one is kept.
+    void Finish();
+
+    /// Add or replace the property 'name'. Return false if 'value' can't be
+    /// sent to clients, the property is left as it was then.
+    bool Set(QString const& name, QVariant const& value);
+    /// Like Set, for a value packed already.
+    void SetPacked(QString const& name, QVariant const& packed_value);
+    /// Like SetPacked, for the property at 'index'.
+    void SetPacked(int index, QVariant const& packed_value);
+
+    int size() const { return int(slots_.size()); }
+    bool contains(QString const& name) const { return Find(name) >= 0; }
+    /// Return the packed value of the property 'name', or an invalid QVariant
+    /// if there is none.
+    QVariant value(QString const& name) const;
+    QVariant operator[](QString const& name) const { return value(name); }
+
+    /// Return the index of the property 'name', or -1 if there is none.
+    int Find(QString const& name) const;
+    QString NameAt(int index) const;
+    Kind KindAt(int index) const { return slots_[index].kind; }
+    QVariant PackedAt(int index) const;
+    /// Marshall the packed value at 'index' as av, the way QtDBus marshals
+    /// the list PackedAt returns, without building the list.
+    void MarshallPackedAt(int index, QDBusArgument& argument) const;
+    /// The value at 'index', if it is a String or StringList respectively.
+    QString const& StringAt(int index) const { return strings_[slots_[index].value.index]; }
+    QStringList const& StringListAt(int index) const { return string_lists_[slots_[index].value.index]; }
+    /// The value at 'index', if it is a Bool, Int, UInt, LongLong or DateTime.
+    qint64 IntegerAt(int index) const;
+    /// The value at 'index', if it is a ULongLong or Double respectively.
+    quint64 UnsignedAt(int index) const { return slots_[index].value.uint64; }
+    double DoubleAt(int index) const { return slots_[index].value.real; }
+    /// The coordinates, sizes, colour channels or time fields of the value at
+    /// 'index', in the order PackProperty lists them, if it is a Point, Rect,
+    /// Size, Color or Time.
+    int ComponentAt(int index, int component) const { return slots_[index].value.ints[component]; }
+
+    /// Return all properties, packed.
+    QVariantMap ToVariantMap() const;
+    static PropertyRecord FromVariantMap(QVariantMap const& packed_properties);
+
+private:
+    struct Slot
+    {
+        int name;
+        int name_size;
+        Kind kind;
+        union
+        {
+            bool boolean;
+            qint32 int32;
+            quint32 uint32;
+            qint64 int64;
+            quint64 uint64;
+            double real;
+            int ints[4];
+            // into strings_, string_lists_ or packed_:
+            int index;
+        } value;
+    };
+
+    // The most values a [type, values...] list holds, with the type:
+    static const int MaxPackedSize = 5;
+
+    int UnpackedValuesAt(int index, QVariant (&values)[MaxPackedSize]) const;
+    bool MakeSlot(QVariant const& value, Slot& slot);
+    int AddName(const char* name, int size);
+    int Compare(Slot const& slot, const char* name, int size) const;
+    int LowerBound(const char* name, int size) const;
+
+    std::vector<Slot> slots_;
+    QByteArray names_;
+    std::vector<QString> strings_;
+    std::vector<QStringList> string_lists_;
+    std::vector<QVariant> packed_;
+    bool sorted_;
+};
+
+/// Marshall 'record' as a{sv} of packed values, like the QVariantMap of
+/// packed properties it stands for.
+QDBusArgument& operator<<(QDBusArgument& argument, PropertyRecord const& record);
+
+#endif // PROPERTYRECORD_H
@@ -1,20 +1,38 @@
 #include "qtnode.h"
 
 #include "introspection.h"
+#include "modelcache.h"
+#include "nodearena.h"
+#include "nodecache.h"
+#include "nodetyperegistry.h"
+#include "spatialindex.h"
+#include "threadbatches.h"
+
+#include <xpathselect/xpathquerypart.h>
 
 #include <QDebug>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
 
 #ifdef QT5_SUPPORT
   #include <QtWidgets/QGraphicsScene>
   #include <QtWidgets/QGraphicsObject>
+  #include <QtWidgets/QGraphicsItem>
+  #include <QtWidgets/QGraphicsView>
   #include <QtQml/QQmlEngine>
   #include <QtQml/QQmlContext>
+  #include <QtQml/QJSValue>
   #include <QtQuick/QQuickView>
   #include <QtQuick/QQuickItem>
+  #include <QtQuick/QQuickWindow>
   #include <QtQuickWidgets/QQuickWidget>
+  #include <QtGui/QWindow>
+  #include <private/qquickitem_p.h>
 #else
   #include <QGraphicsScene>
   #include <QGraphicsObject>
+  #include <QGraphicsView>
 #endif
 #include <QDBusArgument>
 
@@ -24,8 +42,11 @@
 #include <QTreeView>
 #include <QTreeWidget>
 #include <QListView>
+#include <QPair>
+#include <QSet>
+#include <QVector>
 
-const QByteArray AP_ID_NAME("_autopilot_id");
+#include <algorithm>
 
 void CollectSpecialChildren(QObject* object, xpathselect::NodeVector& children, DBusNode::Ptr parent);
 
@@ -33,11 +54,36 @@ void GetDataElementChildren(QTableWidget* table, xpathselect::NodeVector& childr
 void GetDataElementChildren(QTreeView* tree_view, xpathselect::NodeVector& children, DBusNode::Ptr parent);
 void GetDataElementChildren(QTreeWidget* tree_widget, xpathselect::NodeVector& children, DBusNode::Ptr parent);
 void GetDataElementChildren(QListView* list_view, xpathselect::NodeVector& children, DBusNode::Ptr parent);
+void GetDataElementChildren(QGraphicsView* view, xpathselect::NodeVector& children, DBusNode::Ptr parent);
+
+void GetMatchingDataElementChildren(QTreeView* tree_view, xpathselect::XPathQueryPart const& part, xpathselect::NodeVector& children, DBusNode::Ptr parent);
+void GetMatchingDataElementChildren(QListView* list_view, xpathselect::XPathQueryPart const& part, xpathselect::NodeVector& children, DBusNode::Ptr parent);
+void GetMatchingDataElementChildren(QGraphicsView* view, xpathselect::XPathQueryPart const& part, xpathselect::NodeVector& children, DBusNode::Ptr parent);
+void GetMatchingModelIndexChildren(QAbstractItemView* view, QModelIndex root_index, xpathselect::XPathQueryPart const& part, xpathselect::NodeVector& children, DBusNode::Ptr parent);
+
+void CollectIndicesFor(QAbstractItemModel* model, QModelIndex parent_index, xpathselect::XPathQueryPart const* part, bool hierarchical, QAbstractItemView* shown_in, QModelIndexList& indices);
+bool ShowsModelAsTree(QAbstractItemView* view);
+bool ShowsIndex(QAbstractItemView* view, QModelIndex const& index);
+bool ShowsChildIndices(QAbstractItemView* view, QModelIndex const& index);
+QAbstractItemView* ShownIn(QAbstractItemView* view);
+bool IsShown(QObject* object);
+
+void GetQmlModelRows(QObject* view, xpathselect::NodeVector& children, DBusNode::Ptr parent);
+bool HasQmlModelRows(QObject* view);
+void GetMatchingQmlModelRows(QObject* view, xpathselect::XPathQueryPart const& part, xpathselect::NodeVector& children, DBusNode::Ptr parent);
+void CollectQmlModelRows(QObject* view, xpathselect::XPathQueryPart const* part, xpathselect::NodeVector& children, DBusNode::Ptr parent);
+QAbstractItemModel* GetQmlViewModel(QObject* view, QVariant& model_value);
 
 void CollectAllIndices(QModelIndex index, QAbstractItemModel *model, QModelIndexList &collection);
+void CollectAllIndices(QModelIndex index, QAbstractItemModel *model, QAbstractItemView* shown_in, QModelIndexList &collection);
+void CollectChildIndices(QModelIndex index, QAbstractItemModel *model, QAbstractItemView* shown_in, QModelIndexList &collection);
+void CollectMatchingIndices(QModelIndex index, QAbstractItemModel *model, QVector<QPair<int, QVariant> > const& filters, QAbstractItemView* shown_in, QModelIndexList &collection);
+bool MatchesRoleFilters(QModelIndex const& index, QVector<QPair<int, QVariant> > const& filters);
+bool IsEnumeratedBelow(QModelIndex const& index, QModelIndex const& root_index, QAbstractItemView* shown_in);
 QVariant SafePackProperty(QVariant const& prop);
 
 bool MatchProperty(QVariantMap const& packed_properties, std::string const& name, QVariant value);
+bool MatchPackedProperty(QVariant const& packed_property, QVariant value);
 
 // Produce an id suitable for xpathselects' GetId
 int32_t calculate_ap_id(quint64 big_id)
@@ -59,35 +105,189 @@ QDBusArgument &operator<<(QDBusArgument &argument, NodeIntrospectionData const&
 // Retrieve the NodeIntrospectionData data from the D-Bus argument
 const QDBusArgument &operator>>(QDBusArgument const& argument, NodeIntrospectionData& node_data)
 {
+    QVariantMap state;
     argument.beginStructure();
-    argument >> node_data.object_path >> node_data.state;
+    argument >> node_data.object_path >> state;
     argument.endStructure();
+    node_data.state = PropertyRecord::FromVariantMap(state);
     return argument;
 }
 
+DBusNode::DBusNode(DBusNode::Ptr const& parent, NodeArena* arena)
+    : parent_(parent.get())
+    , arena_(arena)
+{
+    if (parent && (!arena || parent->GetArena() != arena))
+        parent_owner_ = parent;
+}
+
+xpathselect::Node::Ptr DBusNode::GetParent() const
+{
+    if (!parent_ || parent_owner_)
+        return parent_owner_;
+    return DBusNode::Ptr(arena_->shared_from_this(), parent_);
+}
+
+std::string DBusNode::GetPath() const
+{
+    // Only the nodes that end up in a reply need a path, so paths are built
+    // from the parent links on demand instead of being stored in every node.
+    std::string path = parent_ ? parent_->GetPath() : std::string();
+    path += '/';
+    path += GetName();
+    return path;
+}
+
+DBusNode::Ptr DBusNode::Self() const
+{
+    if (arena_)
+        return DBusNode::Ptr(arena_->shared_from_this(), this);
+    // Not arena allocated (e.g. on the stack), so the children created for
+    // this node cannot keep it alive:
+    return DBusNode::Ptr(DBusNode::Ptr(), this);
+}
+
 void GetDataElementChildren(QTableWidget *table, xpathselect::NodeVector& children, DBusNode::Ptr parent)
 {
-    QList<QTableWidgetItem *> tablewidgetitems = table->findItems("*", Qt::MatchWildcard|Qt::MatchRecursive);
-    foreach (QTableWidgetItem *item, tablewidgetitems){
-        children.push_back(
-            std::make_shared<QTableWidgetItemNode>(item, parent)
-            );
+    // Column by column, like findItems() used to return them, but without
+    // matching a wildcard against every cell:
+    bool visible_only = CurrentTraversalOptions().visible_only;
+    int row_count = table->rowCount();
+    int column_count = table->columnCount();
+    for (int c = 0; c < column_count; ++c) {
+        if (visible_only && table->isColumnHidden(c))
+            continue;
+        for (int r = 0; r < row_count; ++r) {
+            if (visible_only && table->isRowHidden(r))
+                continue;
+            if (QTableWidgetItem *item = table->item(r, c))
+                children.push_back(MakeChildNode<QTableWidgetItemNode>(parent, item));
+        }
     }
 }
 
 void CollectAllIndices(QModelIndex index, QAbstractItemModel *model, QModelIndexList &collection)
 {
-    for(int c=0; c < model->columnCount(index); ++c) {
-        for(int r=0; r < model->rowCount(index); ++r) {
+    CollectAllIndices(index, model, nullptr, collection);
+}
+
+// If 'shown_in' is set, indices that view doesn't show are left out, along with
+// everything below them (see ShowsIndex and ShowsChildIndices).
+void CollectAllIndices(QModelIndex index, QAbstractItemModel *model, QAbstractItemView* shown_in, QModelIndexList &collection)
+{
+    int row_count = model->rowCount(index);
+    int column_count = model->columnCount(index);
+    for(int c=0; c < column_count; ++c) {
+        for(int r=0; r < row_count; ++r) {
             QModelIndex new_index = model->index(r, c, index);
+            if(shown_in && !ShowsIndex(shown_in, new_index))
+                continue;
             collection.push_back(new_index);
-            if(new_index.isValid() && qHash(new_index) != qHash(index)) {
-                CollectAllIndices(new_index, model, collection);
+            // Children hang off the first column. Recursing from every column
+            // would visit each subtree once per column.
+            if(c == 0 && new_index.isValid() && new_index != index && model->hasChildren(new_index)
+               && (!shown_in || ShowsChildIndices(shown_in, new_index))) {
+                CollectAllIndices(new_index, model, shown_in, collection);
+            }
+        }
+    }
+}
+
+// Collect the indices of all rows and columns directly below 'index'.
+void CollectChildIndices(QModelIndex index, QAbstractItemModel *model, QAbstractItemView* shown_in, QModelIndexList &collection)
+{
+    int row_count = model->rowCount(index);
+    int column_count = model->columnCount(index);
+    for(int c=0; c < column_count; ++c) {
+        for(int r=0; r < row_count; ++r) {
+            QModelIndex new_index = model->index(r, c, index);
+            if(!shown_in || ShowsIndex(shown_in, new_index))
+                collection.push_back(new_index);
+        }
+    }
+}
+
+// Like CollectAllIndices, but only collects the indices whose data matches all
+// (role, value) pairs in 'filters'.
+void CollectMatchingIndices(QModelIndex index, QAbstractItemModel *model, QVector<QPair<int, QVariant> > const& filters, QAbstractItemView* shown_in, QModelIndexList &collection)
+{
+    int row_count = model->rowCount(index);
+    int column_count = model->columnCount(index);
+    for(int c=0; c < column_count; ++c) {
+        for(int r=0; r < row_count; ++r) {
+            QModelIndex new_index = model->index(r, c, index);
+            if(shown_in && !ShowsIndex(shown_in, new_index))
+                continue;
+            if(MatchesRoleFilters(new_index, filters)) {
+                collection.push_back(new_index);
+            }
+            if(c == 0 && new_index.isValid() && new_index != index && model->hasChildren(new_index)
+               && (!shown_in || ShowsChildIndices(shown_in, new_index))) {
+                CollectMatchingIndices(new_index, model, filters, shown_in, collection);
             }
         }
     }
 }
 
+// Return true if CollectAllIndices(root_index, model, shown_in, ...) collects
+// 'index'.
+bool IsEnumeratedBelow(QModelIndex const& index, QModelIndex const& root_index, QAbstractItemView* shown_in)
+{
+    if (shown_in && !ShowsIndex(shown_in, index))
+        return false;
+    QModelIndex parent = index.parent();
+    while (parent.isValid() && parent != root_index)
+    {
+        // only the first column is recursed into:
+        if (parent.column() != 0)
+            return false;
+        if (shown_in && !(ShowsIndex(shown_in, parent) && ShowsChildIndices(shown_in, parent)))
+            return false;
+        parent = parent.parent();
+    }
+    return parent == root_index;
+}
+
+// Return true if 'view' shows the row and column of 'index'.
+bool ShowsIndex(QAbstractItemView* view, QModelIndex const& index)
+{
+    if (QTreeView* tree_view = qobject_cast<QTreeView*>(view))
+        return !tree_view->isRowHidden(index.row(), index.parent()) && !tree_view->isColumnHidden(index.column());
+    if (QListView* list_view = qobject_cast<QListView*>(view))
+        return !list_view->isRowHidden(index.row()) && index.column() == list_view->modelColumn();
+    return true;
+}
+
+// Return true if 'view' shows the children of 'index' (which it shows itself).
+// Tree views show those of expanded indices, list views show the rows of
+// their root index only.
+bool ShowsChildIndices(QAbstractItemView* view, QModelIndex const& index)
+{
+    if (QTreeView* tree_view = qobject_cast<QTreeView*>(view))
+        return index.column() == 0 && tree_view->isExpanded(index);
+    if (qobject_cast<QListView*>(view))
+        return false;
+    return true;
+}
+
+// Return 'view' if only the indices it shows are to be collected for the
+// current request, nullptr otherwise.
+QAbstractItemView* ShownIn(QAbstractItemView* view)
+{
+    return CurrentTraversalOptions().visible_only ? view : nullptr;
+}
+
+bool MatchesRoleFilters(QModelIndex const& index, QVector<QPair<int, QVariant> > const& filters)
+{
+    // Compared the same way QModelIndexNode compares its properties:
+    for (QPair<int, QVariant> const& filter : filters)
+    {
+        if (!MatchPackedProperty(SafePackProperty(index.data(filter.first)), filter.second))
+            return false;
+    }
+    return true;
+}
+
 // Pack property, but return a default blank if the packed property is invalid.
 QVariant SafePackProperty(QVariant const& prop)
 {
@@ -106,8 +306,16 @@ bool MatchProperty(QVariantMap const& packed_properties, std::string const& name
     if (! packed_properties.contains(qname))
         return false;
 
+    return MatchPackedProperty(packed_properties[qname], value);
+}
+
+bool MatchPackedProperty(QVariant const& packed_property, QVariant value)
+{
+    if (! packed_property.isValid())
+        return false;
+
     // Because the properties are packed, we need the value, not the type.
-    QVariant object_value = qvariant_cast<QVariantList>(packed_properties[qname]).at(1);
+    QVariant object_value = qvariant_cast<QVariantList>(packed_property).at(1);
     if (value.canConvert(object_value.type()))
     {
         value.convert(object_value.type());
@@ -128,36 +336,167 @@ void GetDataElementChildren(QTreeView* tree_view, xpathselect::NodeVector& child
         return;
     }
 
-    QModelIndexList all_indices;
-    for(int c=0; c < abstract_model->columnCount(); ++c) {
-        for(int r=0; r < abstract_model->rowCount(); ++r) {
-            QModelIndex index = abstract_model->index(r, c);
-            all_indices.push_back(index);
-            CollectAllIndices(index, abstract_model, all_indices);
-        }
-    }
+    // The top level rows, their children are the children of their nodes:
+    QModelIndexList top_level_indices;
+    CollectChildIndices(QModelIndex(), abstract_model, ShownIn(tree_view), top_level_indices);
 
-    foreach(QModelIndex index, all_indices)
+    foreach(QModelIndex index, top_level_indices)
     {
         if(index.isValid())
         {
             children.push_back(
-                std::make_shared<QModelIndexNode>(
+                MakeChildNode<QModelIndexNode>(
+                    parent,
                     index,
-                    tree_view,
-                    parent)
+                    tree_view)
                 );
         }
     }
 }
 
+void GetMatchingDataElementChildren(QTreeView* tree_view, xpathselect::XPathQueryPart const& part, xpathselect::NodeVector& children, DBusNode::Ptr parent)
+{
+    GetMatchingModelIndexChildren(tree_view, QModelIndex(), part, children, parent);
+}
+
+void GetMatchingDataElementChildren(QListView* list_view, xpathselect::XPathQueryPart const& part, xpathselect::NodeVector& children, DBusNode::Ptr parent)
+{
+    GetMatchingModelIndexChildren(list_view, list_view->rootIndex(), part, children, parent);
+}
+
+// Only wrap the indices that may match 'part', see CollectIndicesFor.
+void GetMatchingModelIndexChildren(QAbstractItemView* view, QModelIndex root_index, xpathselect::XPathQueryPart const& part, xpathselect::NodeVector& children, DBusNode::Ptr parent)
+{
+    QAbstractItemModel* model = view->model();
+    if(! model)
+        return;
+
+    QModelIndexList indices;
+    CollectIndicesFor(model, root_index, &part, ShowsModelAsTree(view), ShownIn(view), indices);
+    foreach(QModelIndex index, indices)
+    {
+        if(index.isValid())
+            children.push_back(MakeChildNode<QModelIndexNode>(parent, index, view));
+    }
+}
+
+// Add the indices below 'parent_index' that may match 'part' (all of them if
+// 'part' is null) to 'indices'. The role predicates of 'part' (text="..." and
+// xyzRole=...) are evaluated against the model, and id predicates are looked
+// up in the ModelCache. The remaining predicates are left to the query engine.
+//
+// With 'hierarchical', the indices are nodes in a tree: only the children of
+// 'parent_index' are added. If 'part' is searched for in whole subtrees, those
+// that match or that have descendants that match, otherwise only those that
+// match. Without 'hierarchical', all matching indices in the subtree are added.
+//
+// With 'shown_in', only the indices that view shows are added.
+void CollectIndicesFor(QAbstractItemModel* model, QModelIndex parent_index, xpathselect::XPathQueryPart const* part, bool hierarchical, QAbstractItemView* shown_in, QModelIndexList& indices)
+{
+    QVector<QPair<int, QVariant> > filters;
+    bool by_id = false;
+    QModelIndex index_with_id;
+    static const xpathselect::ParamList no_parameters;
+    for (xpathselect::XPathQueryParam const& param : part ? part->parameter : no_parameters)
+    {
+        // Ids are looked up directly. They belong to a single index, and that
+        // index may be one of ours:
+        if (param.param_name == "id" && param.param_value.which() == 2)
+        {
+            by_id = true;
+            index_with_id = ModelCache::Instance().FindIndex(boost::get<int>(param.param_value));
+            continue;
+        }
+
+        int role = ModelCache::Instance().RoleForProperty(model, QByteArray::fromStdString(param.param_name));
+        if (role < 0)
+            continue;
+        switch (param.param_value.which())
+        {
+        case 0:
+            filters.append(qMakePair(role, QVariant(QString::fromStdString(boost::get<std::string>(param.param_value)))));
+            break;
+        case 1:
+            filters.append(qMakePair(role, QVariant(boost::get<bool>(param.param_value))));
+            break;
+        case 2:
+            filters.append(qMakePair(role, QVariant(boost::get<int>(param.param_value))));
+            break;
+        }
+    }
+
+    if (!by_id && filters.isEmpty())
+    {
+        if (hierarchical)
+            CollectChildIndices(parent_index, model, shown_in, indices);
+        else
+            CollectAllIndices(parent_index, model, shown_in, indices);
+        return;
+    }
+
+    // A direct child step only needs the children, not their subtrees:
+    if (hierarchical && !part->SearchesDescendants())
+    {
+        QModelIndexList children;
+        CollectChildIndices(parent_index, model, shown_in, children);
+        foreach (QModelIndex child, children)
+        {
+            if (by_id ? child == index_with_id : MatchesRoleFilters(child, filters))
+                indices.append(child);
+        }
+        return;
+    }
+
+    QModelIndexList matches;
+    if (by_id)
+    {
+        if (index_with_id.isValid() && index_with_id.model() == model && IsEnumeratedBelow(index_with_id, parent_index, shown_in))
+            matches.append(index_with_id);
+    }
+    else
+    {
+        CollectMatchingIndices(parent_index, model, filters, shown_in, matches);
+    }
+    if (!hierarchical)
+    {
+        indices += matches;
+        return;
+    }
+
+    // The children of 'parent_index' on the way to the matches, in model order:
+    QSet<QModelIndex> on_the_way;
+    foreach (QModelIndex match, matches)
+    {
+        while (match.parent() != parent_index)
+            match = match.parent();
+        on_the_way.insert(match);
+    }
+    QModelIndexList children;
+    CollectChildIndices(parent_index, model, shown_in, children);
+    foreach (QModelIndex child, children)
+    {
+        if (on_the_way.contains(child))
+            indices.append(child);
+    }
+}
+
+// Return true if 'view' shows its model as a tree. The indices of such views
+// are nested nodes, those of other views are all children of the view.
+bool ShowsModelAsTree(QAbstractItemView* view)
+{
+    return qobject_cast<QTreeView*>(view) != nullptr;
+}
+
 void GetDataElementChildren(QTreeWidget* tree_widget, xpathselect::NodeVector& children, DBusNode::Ptr parent)
 {
+    bool visible_only = CurrentTraversalOptions().visible_only;
     for(int i=0; i < tree_widget->topLevelItemCount(); ++i) {
+        if (visible_only && tree_widget->topLevelItem(i)->isHidden())
+            continue;
         children.push_back(
-            std::make_shared<QTreeWidgetItemNode>(
-                tree_widget->topLevelItem(i),
-                parent)
+            MakeChildNode<QTreeWidgetItemNode>(
+                parent,
+                tree_widget->topLevelItem(i))
             );
     }
 }
@@ -174,46 +513,28 @@ void GetDataElementChildren(QListView* list_view, xpathselect::NodeVector& child
     }
 
     QModelIndexList all_indices;
-    QModelIndex root_index = list_view->rootIndex();
-    if(root_index.isValid()) {
-        // The root item is the parent item to the view's toplevel items
-        CollectAllIndices(root_index, abstract_model, all_indices);
-    }
-    else {
-        for(int c=0; c < abstract_model->columnCount(); ++c) {
-            for(int r=0; r < abstract_model->rowCount(); ++r) {
-                QModelIndex index = abstract_model->index(r, c);
-                all_indices.push_back(index);
-                CollectAllIndices(index, abstract_model, all_indices);
-            }
-        }
-    }
+    // The root item is the parent item to the view's toplevel items. It is
+    // invalid if the view shows the whole model.
+    CollectAllIndices(list_view->rootIndex(), abstract_model, ShownIn(list_view), all_indices);
 
     foreach(QModelIndex index, all_indices) {
         if(index.isValid())
         {
             children.push_back(
-                std::make_shared<QModelIndexNode>(
+                MakeChildNode<QModelIndexNode>(
+                    parent,
                     index,
-                    list_view,
-                    parent)
+                    list_view)
                 );
         }
     }
 }
 
-QObjectNode::QObjectNode(QObject *obj, DBusNode::Ptr parent)
-: object_(obj)
-, parent_(parent)
-{
-    std::string parent_path = parent ? parent->GetPath() : "";
-    full_path_ = parent_path + "/" + GetName();
-}
-
-QObjectNode::QObjectNode(QObject* obj)
-: object_(obj)
+QObjectNode::QObjectNode(QObject *obj, DBusNode::Ptr const& parent, NodeArena* arena)
+: DBusNode(parent, arena)
+, object_(obj)
+, children_prefetched_(false)
 {
-    full_path_ = "/" + GetName();
 }
 
 QObject* QObjectNode::getWrappedObject() const
@@ -222,48 +543,122 @@ QObject* QObjectNode::getWrappedObject() const
 }
 
 NodeIntrospectionData QObjectNode::GetIntrospectionData() const
+{
+    PropertyRecord properties;
+    if (ThreadBatches::IsForeign(object_))
+    {
+        // Objects of other threads are neither widgets nor items, so there is
+        // no globalRect to pass on.
+        QObject* object = object_;
+        bool available = RunInThreadOf(object, [object, &properties] { ReadNodeProperties(object, properties); });
+        return GetIntrospectionDataFrom(properties, available);
+    }
+
+    QRect global_rect;
+    bool has_global_rect = GetGlobalRect(global_rect);
+    ReadNodeProperties(object_, properties, has_global_rect ? &global_rect : nullptr);
+    return GetIntrospectionDataFrom(properties);
+}
+
+NodeIntrospectionData QObjectNode::GetIntrospectionDataFrom(PropertyRecord const& properties, bool available) const
 {
     NodeIntrospectionData data;
     data.object_path = QString::fromStdString(GetPath());
-    data.state = GetNodeProperties(object_);
-    data.state["id"] = PackProperty(GetId());
+    data.state = properties;
+    QStringList children = GetChildNames();
+    if (!children.empty())
+        data.state.Set("Children", children);
+    // Ids live in a table of their own, so this doesn't touch the object:
+    data.state.Set("id", GetId());
+    if (!available)
+        data.state.Set("unavailable", true);
     return data;
 }
 
 std::string QObjectNode::GetName() const
 {
-    QString name = object_->metaObject()->className();
+    // Names are demangled once per class, see NodeTypeRegistry.
+    return NodeTypeRegistry::Instance().Handlers(object_->metaObject()).name;
+}
+
+std::size_t QObjectNode::GetNameHash() const
+{
+    return NodeTypeRegistry::Instance().Handlers(object_->metaObject()).name_hash;
+}
 
-    // QML type names get mangled by Qt - they get _QML_N or _QMLTYPE_N appended.
-    if (name.contains('_'))
-        name = name.split('_').front();
-    return name.toStdString();
+int32_t AllocateNodeId()
+{
+    static int32_t next_id=0;
+    return ++next_id;
 }
 
-std::string QObjectNode::GetPath() const
+namespace
 {
-    return full_path_;
+    /// Ids of the objects wrapped so far. Kept out of the objects themselves:
+    /// a dynamic property would send each one a DynamicPropertyChange event,
+    /// across threads for objects living elsewhere.
+    class ObjectIds
+    {
+    public:
+        int32_t IdFor(QObject* object)
+        {
+            QMutexLocker lock(&mutex_);
+            auto id = ids_.constFind(object);
+            if (id != ids_.constEnd())
+                return id.value();
+
+            int32_t new_id = AllocateNodeId();
+            ids_.insert(object, new_id);
+            // Runs in the thread the object is destroyed in, hence the mutex:
+            QObject::connect(object, &QObject::destroyed, [this, object] {
+                QMutexLocker lock(&mutex_);
+                ids_.remove(object);
+            });
+            return new_id;
+        }
+
+    private:
+        QMutex mutex_;
+        QHash<QObject*, int32_t> ids_;
+    };
+
+    ObjectIds& GetObjectIds()
+    {
+        static ObjectIds object_ids;
+        return object_ids;
+    }
 }
 
 int32_t QObjectNode::GetId() const
 {
     // Note: This method is used to assign ids to both the root node (with a QApplication object) and
     // child nodes. This used to be separate code, but now that we export QApplication properties,
-    // we can use this one method everywhere.
-    static int32_t next_id=0;
+    // we can use this one method everywhere. Ids are handed out on first use.
+    return GetObjectIds().IdFor(object_);
+}
 
-    QList<QByteArray> property_names = object_->dynamicPropertyNames();
-    if (!property_names.contains(AP_ID_NAME))
-    {
-        int32_t new_id = ++next_id;
-        object_->setProperty(AP_ID_NAME, QVariant(new_id));
-    }
-    return qvariant_cast<int32_t>(object_->property(AP_ID_NAME));
+bool QObjectNode::IsOfType(std::string const& type_name, std::size_t type_name_hash) const
+{
+    // Resolving the handlers hands out the bits for all base classes, so the
+    // lookup below can't miss one of them.
+    NodeTypeRegistry& registry = NodeTypeRegistry::Instance();
+    QBitArray const& ancestry = registry.Handlers(object_->metaObject()).ancestry;
+    int bit = registry.TypeBit(type_name, type_name_hash);
+    return bit >= 0 && bit < ancestry.size() && ancestry.testBit(bit);
 }
 
 bool QObjectNode::MatchStringProperty(std::string const& name, std::string const& value) const
 {
-    return MatchProperty(GetNodeProperties(object_), name, QString::fromStdString(value));
+    // "x,y,width,height" in global coordinates, matches the widgets and items
+    // shown on screen whose globalRect intersects it:
+    if (name == "intersects")
+    {
+        QRect rect, global_rect;
+        return ParseRect(value, rect) && IsOnScreen(object_) && GetGlobalRect(global_rect)
+            && global_rect.intersects(rect);
+    }
+
+    return MatchPackedProperty(ReadProperty(name), QString::fromStdString(value));
 }
 
 bool QObjectNode::MatchIntegerProperty(std::string const& name, int32_t value) const
@@ -271,221 +666,1094 @@ bool QObjectNode::MatchIntegerProperty(std::string const& name, int32_t value) c
     if (name == "id")
         return value == GetId();
 
-    return MatchProperty(GetNodeProperties(object_), name, value);
+    return MatchPackedProperty(ReadProperty(name), value);
 }
 
 bool QObjectNode::MatchBooleanProperty(std::string const& name, bool value) const
 {
-    return MatchProperty(GetNodeProperties(object_), name, value);
+    return MatchPackedProperty(ReadProperty(name), value);
 }
 
-template <class T>
-bool AttemptGetSpecialChildren(QObject* object, xpathselect::NodeVector& children, DBusNode::Ptr parent)
+QVariant QObjectNode::ReadProperty(std::string const& name) const
 {
-    auto className = T::staticMetaObject.className();
-    if(object->inherits(className))
-    {
-        T* table = qobject_cast<T *>(object);
-        if(table) {
-            GetDataElementChildren(table, children, parent);
-        }
-        else {
-            qDebug() << "Casting object (with objectName: " << object->objectName() << ") "
-                     << "to " << className
-                     << "failed. Unable to retrieve children.";
-            return false;
-        }
-        return true;
-    }
-    return false;
+    QByteArray property_name(name.c_str());
+    if (!ThreadBatches::IsForeign(object_))
+        return GetNodeProperty(object_, property_name);
+
+    auto prefetched = prefetched_properties_.constFind(property_name);
+    if (prefetched != prefetched_properties_.constEnd())
+        return prefetched.value();
+
+    QVariant value;
+    QObject* object = object_;
+    RunInThreadOf(object, [object, &property_name, &value] { value = GetNodeProperty(object, property_name); });
+    return value;
 }
 
-void CollectSpecialChildren(QObject* object, xpathselect::NodeVector& children, DBusNode::Ptr parent)
+quint64 geometry_pass = 1;
+
+void BeginGeometryPass()
 {
-    // Need to make sure to make these checks in the correct order.
-    // i.e. Because QTreeWidget inherits from QTreeView do it first otherwise
-    // we would never reach the specific QTreeWidget code.
-    AttemptGetSpecialChildren<QTableWidget>(object, children, parent)
-        || AttemptGetSpecialChildren<QTreeWidget>(object, children, parent)
-        || AttemptGetSpecialChildren<QTreeView>(object, children, parent)
-        || AttemptGetSpecialChildren<QListView>(object, children, parent);
+    ++geometry_pass;
 }
 
-xpathselect::NodeVector QObjectNode::Children() const
-{
-    xpathselect::NodeVector children;
+TraversalOptions current_traversal_options;
 
-    CollectSpecialChildren(object_, children, shared_from_this());
+TraversalOptions const& CurrentTraversalOptions()
+{
+    return current_traversal_options;
+}
 
-    // Qt5's hierarchy for QML has changed a bit:
-    // - On top there's a QQuickView which holds all the QQuick items
-    // - QQuickItems don't always follow the QObject type hierarchy (e.g. QQuickListView does not), therefore we use the QQuickItem's childItems()
-    // - In case it is not a QQuickItem, fall back to the standard QObject hierarchy
+ScopedTraversalOptions::ScopedTraversalOptions(TraversalOptions const& options)
+    : previous_(current_traversal_options)
+{
+    current_traversal_options = options;
+}
 
-    QQuickView *view = qobject_cast<QQuickView*>(object_);
-    if (view && view->rootObject() != 0) {
-        children.push_back(std::make_shared<QObjectNode>(view->rootObject(), shared_from_this()));
-    }
+ScopedTraversalOptions::~ScopedTraversalOptions()
+{
+    current_traversal_options = previous_;
+}
 
-    QQuickWidget *wview = qobject_cast<QQuickWidget*>(object_);
-    if (wview && wview->rootObject() != 0) {
-        qDebug() << "Collect QQuickWidget childrens";
-        children.push_back(std::make_shared<QObjectNode>(wview->rootObject(), shared_from_this()));
-    }
+// Return false for hidden widgets, items, windows and graphics objects. Other
+// objects aren't shown or hidden themselves.
+bool IsShown(QObject* object)
+{
+    if (object->isWidgetType())
+        return static_cast<QWidget*>(object)->isVisible();
+    if (object->isWindowType())
+        return static_cast<QWindow*>(object)->isVisible();
+    if (QQuickItem* item = qobject_cast<QQuickItem*>(object))
+        return item->isVisible();
+    if (QGraphicsObject* graphics_object = qobject_cast<QGraphicsObject*>(object))
+        return graphics_object->isVisible();
+    return true;
+}
 
-    QQuickWindow *quickWindow = qobject_cast<QQuickWindow*>(object_);
-    if (quickWindow) {
-        //children.push_back(std::make_shared<QObjectNode>(quickWindow->contentItem(), shared_from_this()));
+void RemoveHiddenChildren(xpathselect::NodeVector& children)
+{
+    auto hidden = std::remove_if(children.begin(), children.end(), [](xpathselect::Node::Ptr const& child) {
+        const QObjectNode* object_node = dynamic_cast<const QObjectNode*>(child.get());
+        return object_node && !IsShown(object_node->getWrappedObject());
+    });
+    children.erase(hidden, children.end());
+}
 
-        // Process data property
-        if (quickWindow->property("data").isValid()) {
-            QQmlListProperty<QObject> data = qvariant_cast<QQmlListProperty<QObject>>(quickWindow->property("data"));
+QObjectNode::GlobalGeometry const& QObjectNode::GetGlobalGeometry() const
+{
+    if (geometry_.pass == geometry_pass)
+        return geometry_;
+    geometry_.pass = geometry_pass;
+    geometry_.valid = false;
 
-            for (int index = 0; index < data.count(&data); index++) {
-                QObject* item = data.at(&data, index);
+    // The parent node wraps the parent widget or item, unless the child was
+    // added by some other provider (e.g. the root object of a QQuickView).
+    const QObjectNode* parent_node = dynamic_cast<const QObjectNode*>(GetParentNode());
+    QObject* parent_object = parent_node ? parent_node->object_ : nullptr;
 
-                children.push_back(std::make_shared<QObjectNode>(item, shared_from_this()));
+    if (object_->isWidgetType())
+    {
+        QWidget* widget = static_cast<QWidget*>(object_);
+        if (!widget->isWindow() && parent_object && parent_object == widget->parentWidget())
+        {
+            GlobalGeometry const& parent_geometry = parent_node->GetGlobalGeometry();
+            if (parent_geometry.valid)
+            {
+                geometry_.to_window = parent_geometry.to_window;
+                geometry_.to_window.translate(widget->x(), widget->y());
+                geometry_.window_origin = parent_geometry.window_origin;
+                geometry_.valid = true;
+                return geometry_;
             }
         }
+        geometry_.to_window.reset();
+        geometry_.window_origin = widget->mapToGlobal(QPoint(0, 0));
+        geometry_.valid = true;
     }
+    else if (QQuickItem* item = qobject_cast<QQuickItem*>(object_))
+    {
+        QQuickWindow* window = item->window();
+        if (!window)
+            return geometry_;
 
-    QQuickItem* item = qobject_cast<QQuickItem*>(object_);
-    if (item) {
-        foreach (QQuickItem *childItem, item->childItems()) {
-            if (childItem->parentItem() == item) {
-                children.push_back(std::make_shared<QObjectNode>(childItem, shared_from_this()));
-            }
-        }
-    } else {
-        foreach (QObject *child, object_->children())
+        QQuickItemPrivate* item_private = QQuickItemPrivate::get(item);
+        if (parent_object && parent_object == item->parentItem())
         {
-            if (child->parent() == object_)
-                children.push_back(std::make_shared<QObjectNode>(child, shared_from_this()));
+            GlobalGeometry const& parent_geometry = parent_node->GetGlobalGeometry();
+            if (parent_geometry.valid)
+            {
+                // Same as QQuickItemPrivate::itemToWindowTransform, but with
+                // the parent's part already worked out:
+                geometry_.to_window = parent_geometry.to_window;
+                item_private->itemToParentTransform(geometry_.to_window);
+                geometry_.window_origin = parent_geometry.window_origin;
+                geometry_.valid = true;
+                return geometry_;
+            }
         }
+        geometry_.to_window = item_private->itemToWindowTransform();
+        geometry_.window_origin = window->mapToGlobal(QPoint(0, 0));
+        geometry_.valid = true;
     }
+    return geometry_;
+}
 
-    return children;
+bool QObjectNode::GetGlobalRect(QRect& rect) const
+{
+    GlobalGeometry const& geometry = GetGlobalGeometry();
+    if (!geometry.valid)
+        return false;
+
+    // Rounded the same way as the globalRect fast properties:
+    if (object_->isWidgetType())
+    {
+        QWidget* widget = static_cast<QWidget*>(object_);
+        rect = QRect(geometry.window_origin + geometry.to_window.map(QPoint(0, 0)), widget->size());
+    }
+    else
+    {
+        QQuickItem* item = static_cast<QQuickItem*>(object_);
+        QRectF window_rect = geometry.to_window.mapRect(item->boundingRect());
+        rect = QRect(geometry.window_origin + window_rect.toRect().topLeft(), window_rect.size().toSize());
+    }
+    return true;
 }
 
+template <class T>
+void GetSpecialChildren(QObject* object, xpathselect::NodeVector& children, DBusNode::Ptr parent)
+{
+    // The registry only hands us objects that inherit T:
+    GetDataElementChildren(static_cast<T*>(object), children, parent);
+}
 
-xpathselect::Node::Ptr QObjectNode::GetParent() const
+template <class T>
+void GetMatchingSpecialChildren(QObject* object, xpathselect::XPathQueryPart const& part,
+                                xpathselect::NodeVector& children, DBusNode::Ptr parent)
 {
-    return parent_;
+    GetMatchingDataElementChildren(static_cast<T*>(object), part, children, parent);
 }
 
-// QModelIndexNode
-QModelIndexNode::QModelIndexNode(QModelIndex index, QAbstractItemView* parent_view, DBusNode::Ptr parent)
-    : index_(index)
-    , parent_view_(parent_view)
-    , parent_(parent)
+void GetQuickViewRootObject(QObject* object, xpathselect::NodeVector& children, DBusNode::Ptr parent)
 {
-    std::string parent_path = parent ? parent->GetPath() : "";
-    full_path_ = parent_path + "/" + GetName();
+    QQuickView *view = static_cast<QQuickView*>(object);
+    if (view->rootObject() != 0) {
+        children.push_back(MakeChildNode<QObjectNode>(parent, view->rootObject()));
+    }
 }
 
-NodeIntrospectionData QModelIndexNode::GetIntrospectionData() const
+void GetQuickWidgetRootObject(QObject* object, xpathselect::NodeVector& children, DBusNode::Ptr parent)
 {
-    NodeIntrospectionData data;
-    data.object_path = QString::fromStdString(GetPath());
-    data.state = GetProperties();
-    data.state["id"] = PackProperty(GetId());
-    return data;
+    QQuickWidget *wview = static_cast<QQuickWidget*>(object);
+    if (wview->rootObject() != 0) {
+        children.push_back(MakeChildNode<QObjectNode>(parent, wview->rootObject()));
+    }
 }
 
-QVariantMap QModelIndexNode::GetProperties() const
+void GetQuickWindowData(QObject* object, xpathselect::NodeVector& children, DBusNode::Ptr parent)
 {
-    QVariantMap properties;
-    const QAbstractItemModel* model = index_.model();
-    if(model)
-    {
-        // Make an attempt to store the 'text' of a node to be user friendly-ish.
-        properties["text"] = SafePackProperty(model->data(index_));
+    QQuickWindow *quickWindow = static_cast<QQuickWindow*>(object);
+    //children.push_back(std::make_shared<QObjectNode>(quickWindow->contentItem(), parent));
 
-        // Include any Role data (mung the role name with added "Role")
-        const QHash<int, QByteArray> role_names = model->roleNames();
-        QMap<int, QVariant> item_data = model->itemData(index_);
-        foreach(int name, role_names.keys())
-        {
-            if(item_data.contains(name)) {
-                properties[role_names[name]+"Role"] = SafePackProperty(item_data[name]);
-            }
-            else {
-                properties[role_names[name]+"Role"] = PackProperty("");
-            }
-        }
-    }
+    // Process data property
+    if (quickWindow->property("data").isValid()) {
+        QQmlListProperty<QObject> data = qvariant_cast<QQmlListProperty<QObject>>(quickWindow->property("data"));
 
-    QRect rect = parent_view_->visualRect(index_);
-    QRect global_rect(
-        parent_view_->viewport()->mapToGlobal(rect.topLeft()),
-        rect.size());
-    QRect viewport_contents = parent_view_->viewport()->contentsRect();
-    properties["onScreen"] = PackProperty(viewport_contents.contains(rect));
-    properties["globalRect"] = PackProperty(global_rect);
+        for (int index = 0; index < data.count(&data); index++) {
+            QObject* item = data.at(&data, index);
 
-    return properties;
+            children.push_back(MakeChildNode<QObjectNode>(parent, item));
+        }
+    }
 }
 
-xpathselect::Node::Ptr QModelIndexNode::GetParent() const
+void GetQmlModelRows(QObject* view, xpathselect::NodeVector& children, DBusNode::Ptr parent)
 {
-    return parent_;
+    CollectQmlModelRows(view, nullptr, children, parent);
 }
 
-std::string QModelIndexNode::GetName() const
+void GetMatchingQmlModelRows(QObject* view, xpathselect::XPathQueryPart const& part, xpathselect::NodeVector& children, DBusNode::Ptr parent)
 {
-    return "QModelIndex";
+    CollectQmlModelRows(view, &part, children, parent);
 }
 
-std::string QModelIndexNode::GetPath() const
+// Add a node for each row of the model of 'view' that may match 'part' (all
+// rows if 'part' is null). No delegates get created.
+void CollectQmlModelRows(QObject* view, xpathselect::XPathQueryPart const* part, xpathselect::NodeVector& children, DBusNode::Ptr parent)
 {
-    return full_path_;
+    QVariant model_value;
+    if (QAbstractItemModel* model = GetQmlViewModel(view, model_value))
+    {
+        // QML views show the top level rows, and only the first column:
+        QModelIndexList indices;
+        CollectIndicesFor(model, QModelIndex(), part, true, nullptr, indices);
+        foreach (QModelIndex index, indices)
+        {
+            if (index.isValid() && index.column() == 0)
+                children.push_back(MakeChildNode<QmlModelRowNode>(parent, view, index));
+        }
+        return;
+    }
+
+    if (model_value.type() == QVariant::List || model_value.type() == QVariant::StringList)
+    {
+        QVariantList values = model_value.toList();
+        for (int row = 0; row < values.size(); ++row)
+            children.push_back(MakeChildNode<QmlModelRowNode>(parent, view, row, values.at(row)));
+    }
+    else if (model_value.type() == QVariant::Int || model_value.type() == QVariant::Double)
+    {
+        // A row count, modelData is the row:
+        int count = model_value.toInt();
+        for (int row = 0; row < count; ++row)
+            children.push_back(MakeChildNode<QmlModelRowNode>(parent, view, row, QVariant(row)));
+    }
 }
 
-int32_t QModelIndexNode::GetId() const
+bool HasQmlModelRows(QObject* view)
 {
-    return calculate_ap_id(static_cast<quint64>(qHash(index_)));
+    QVariant model_value;
+    if (QAbstractItemModel* model = GetQmlViewModel(view, model_value))
+        return model->rowCount() > 0;
+    if (model_value.type() == QVariant::List || model_value.type() == QVariant::StringList)
+        return !model_value.toList().isEmpty();
+    if (model_value.type() == QVariant::Int || model_value.type() == QVariant::Double)
+        return model_value.toInt() > 0;
+    return false;
 }
 
-bool QModelIndexNode::MatchStringProperty(std::string const& name, std::string const& value) const
+// Return the item model shown by the QML view 'view', or null if the model is
+// something else. 'model_value' is set to the value of the view's model.
+QAbstractItemModel* GetQmlViewModel(QObject* view, QVariant& model_value)
 {
-    return MatchProperty(GetProperties(), name, QString::fromStdString(value));
+    model_value = view->property("model");
+    if (model_value.userType() == qMetaTypeId<QJSValue>())
+        model_value = model_value.value<QJSValue>().toVariant();
+
+    QObject* model_object = qvariant_cast<QObject*>(model_value);
+    if (QAbstractItemModel* model = qobject_cast<QAbstractItemModel*>(model_object))
+        return model;
+    // A DelegateModel, which wraps the actual model:
+    if (model_object && model_object->metaObject()->indexOfProperty("model") >= 0)
+        return GetQmlViewModel(model_object, model_value);
+    return nullptr;
 }
 
-bool QModelIndexNode::MatchIntegerProperty(std::string const& name, int32_t value) const
+// The node name of 'item', see QGraphicsItemNode.
+std::string const& GetGraphicsItemName(QGraphicsItem const* item)
 {
-    if (name == "id")
-        return value == GetId();
-
-    return MatchProperty(GetProperties(), name, value);
+    // indexed by QGraphicsItem::type():
+    static const std::string names[] = {
+        "QGraphicsItem", "QGraphicsItem", "QGraphicsPathItem", "QGraphicsRectItem",
+        "QGraphicsEllipseItem", "QGraphicsPolygonItem", "QGraphicsLineItem", "QGraphicsPixmapItem",
+        "QGraphicsTextItem", "QGraphicsSimpleTextItem", "QGraphicsItemGroup" };
+    int type = item->type();
+    if (type < 0 || type >= int(sizeof(names) / sizeof(names[0])))
+        return names[0];
+    return names[type];
 }
 
-bool QModelIndexNode::MatchBooleanProperty(std::string const& name, bool value) const
+// Add nodes for 'items', which are shown by 'view', to 'children'.
+void AddGraphicsItemNodes(QList<QGraphicsItem*> const& items, QGraphicsView* view, xpathselect::NodeVector& children, DBusNode::Ptr parent)
 {
-    return MatchProperty(GetProperties(), name, value);
+    bool visible_only = CurrentTraversalOptions().visible_only;
+    foreach (QGraphicsItem* item, items)
+    {
+        if (visible_only && !item->isVisible())
+            continue;
+        if (QGraphicsObject* object = item->toGraphicsObject())
+            children.push_back(MakeChildNode<QObjectNode>(parent, object));
+        else
+            children.push_back(MakeChildNode<QGraphicsItemNode>(parent, item, view));
+    }
 }
 
-xpathselect::NodeVector QModelIndexNode::Children() const
+// Return the top level items of 'scene', bottom-most first like
+// QGraphicsItem::childItems().
+QList<QGraphicsItem*> GetTopLevelItems(QGraphicsScene* scene)
 {
-    // Doesn't have any children.
-    xpathselect::NodeVector children;
-    return children;
+    QList<QGraphicsItem*> items;
+    foreach (QGraphicsItem* item, scene->items(Qt::AscendingOrder))
+    {
+        if (!item->parentItem())
+            items.append(item);
+    }
+    return items;
 }
 
-// QTableWidgetItemNode
-QTableWidgetItemNode::QTableWidgetItemNode(QTableWidgetItem *item, DBusNode::Ptr parent)
-    : item_(item)
-    , parent_(parent)
+std::string const& GetGraphicsItemNodeName(QGraphicsItem* item)
 {
-    std::string parent_path = parent ? parent->GetPath() : "";
-    full_path_ = parent_path + "/" + GetName();
+    QGraphicsObject* object = item->toGraphicsObject();
+    return object
+        ? NodeTypeRegistry::Instance().Handlers(object->metaObject()).name
+        : GetGraphicsItemName(item);
 }
 
-NodeIntrospectionData QTableWidgetItemNode::GetIntrospectionData() const
+// Return true if 'item' or any of its child items may match 'part', without
+// creating nodes for them.
+bool GraphicsItemTreeMayMatch(QGraphicsItem* item, xpathselect::XPathQueryPart const& part)
+{
+    if (part.MayMatchName(GetGraphicsItemNodeName(item)))
+        return true;
+    foreach (QGraphicsItem* child, item->childItems())
+    {
+        if (GraphicsItemTreeMayMatch(child, part))
+            return true;
+    }
+    return false;
+}
+
+// Add nodes for those of 'items' that may match 'part' to 'children'. When
+// 'part' is searched for, the 'top_level' items whose child items may match
+// are added as well. Below the top level, all items of a searched subtree are
+// added: looking into the subtree of each of them again would make searches
+// quadratic in the depth of the scene.
+void AddMatchingGraphicsItemNodes(QList<QGraphicsItem*> const& items, QGraphicsView* view, xpathselect::XPathQueryPart const& part,
+                                  bool top_level, xpathselect::NodeVector& children, DBusNode::Ptr parent)
+{
+    // Type tests match base classes too, and any item may be one:
+    if (part.node_name_ == "*" || part.IsTypeTest() || (part.SearchesDescendants() && !top_level))
+    {
+        AddGraphicsItemNodes(items, view, children, parent);
+        return;
+    }
+
+    QList<QGraphicsItem*> matching;
+    foreach (QGraphicsItem* item, items)
+    {
+        if (part.SearchesDescendants() ? GraphicsItemTreeMayMatch(item, part) : part.MayMatchName(GetGraphicsItemNodeName(item)))
+            matching.append(item);
+    }
+    AddGraphicsItemNodes(matching, view, children, parent);
+}
+
+void GetDataElementChildren(QGraphicsView* view, xpathselect::NodeVector& children, DBusNode::Ptr parent)
+{
+    QGraphicsScene* scene = view->scene();
+    if (scene)
+        AddGraphicsItemNodes(GetTopLevelItems(scene), view, children, parent);
+}
+
+void GetMatchingDataElementChildren(QGraphicsView* view, xpathselect::XPathQueryPart const& part, xpathselect::NodeVector& children, DBusNode::Ptr parent)
+{
+    // Scenes can hold many items, and most queries are for other nodes:
+    QGraphicsScene* scene = view->scene();
+    if (scene)
+        AddMatchingGraphicsItemNodes(GetTopLevelItems(scene), view, part, true, children, parent);
+}
+
+void GetGraphicsObjectChildItems(QObject* object, xpathselect::NodeVector& children, DBusNode::Ptr parent)
+{
+    QGraphicsObject* graphics_object = static_cast<QGraphicsObject*>(object);
+    QGraphicsScene* scene = graphics_object->scene();
+    if (!scene || scene->views().isEmpty())
+        return;
+
+    // Same view as for the globalRect of QGraphicsObjects:
+    AddGraphicsItemNodes(graphics_object->childItems(), scene->views().last(), children, parent);
+}
+
+DBusNode::Ptr GetGraphicsItemNode(QGraphicsItem* item, QGraphicsView* view, DBusNode::Ptr const& view_node,
+                                  QHash<QGraphicsItem*, DBusNode::Ptr>& item_nodes)
+{
+    auto found = item_nodes.constFind(item);
+    if (found != item_nodes.constEnd())
+        return found.value();
+
+    DBusNode::Ptr parent = item->parentItem() ? GetGraphicsItemNode(item->parentItem(), view, view_node, item_nodes) : view_node;
+    DBusNode::Ptr node;
+    if (QGraphicsObject* object = item->toGraphicsObject())
+        node = MakeChildNode<QObjectNode>(parent, object);
+    else
+        node = MakeChildNode<QGraphicsItemNode>(parent, item, view);
+    item_nodes.insert(item, node);
+    return node;
+}
+
+void GetGraphicsItemNodesIn(DBusNode::Ptr const& view_node, QGraphicsView* view, QRect const& global_rect, xpathselect::NodeVector& nodes)
+{
+    // The reverse of GetGraphicsItemGlobalRect. QGraphicsView::items() looks
+    // the items up in the scene's BSP tree.
+    QRect view_rect(view->mapFromGlobal(global_rect.topLeft()), global_rect.size());
+    QList<QGraphicsItem*> items = view->items(view_rect, Qt::IntersectsItemBoundingRect);
+
+    // Items only become nodes along with their parent items, which may share
+    // ancestors:
+    QHash<QGraphicsItem*, DBusNode::Ptr> item_nodes;
+    bool visible_only = CurrentTraversalOptions().visible_only;
+    foreach (QGraphicsItem* item, items)
+    {
+        if (!visible_only || item->isVisible())
+            nodes.push_back(GetGraphicsItemNode(item, view, view_node, item_nodes));
+    }
+}
+
+void GetQuickItemChildItems(QObject* object, xpathselect::NodeVector& children, DBusNode::Ptr parent)
+{
+    QQuickItem* item = static_cast<QQuickItem*>(object);
+    foreach (QQuickItem *childItem, item->childItems()) {
+        if (childItem->parentItem() == item) {
+            children.push_back(MakeChildNode<QObjectNode>(parent, childItem));
+        }
+    }
+}
+
+void GetObjectChildren(QObject* object, xpathselect::NodeVector& children, DBusNode::Ptr parent)
+{
+    foreach (QObject *child, object->children())
+    {
+        if (child->parent() == object)
+            children.push_back(MakeChildNode<QObjectNode>(parent, child));
+    }
+}
+
+bool HasTableWidgetItems(QObject* object)
+{
+    QTableWidget* table = static_cast<QTableWidget*>(object);
+    return table->rowCount() > 0 && table->columnCount() > 0;
+}
+
+bool HasTreeWidgetItems(QObject* object)
+{
+    return static_cast<QTreeWidget*>(object)->topLevelItemCount() > 0;
+}
+
+bool HasModelRows(QObject* object)
+{
+    QAbstractItemView* view = static_cast<QAbstractItemView*>(object);
+    return view->model() && view->model()->rowCount(view->rootIndex()) > 0;
+}
+
+void RegisterBuiltinChildrenProviders(NodeTypeRegistry& registry)
+{
+    // Only the provider registered for the most derived class is used for data
+    // children, so a QTreeWidget gets the QTreeWidget code, not the QTreeView one.
+    registry.RegisterDataChildren(&QTableWidget::staticMetaObject, GetSpecialChildren<QTableWidget>, { "QTableWidgetItem" },
+                                  HasTableWidgetItems);
+    registry.RegisterDataChildren(&QTreeWidget::staticMetaObject, GetSpecialChildren<QTreeWidget>, { "QTreeWidgetItem" },
+                                  HasTreeWidgetItems);
+    registry.RegisterDataChildren(&QTreeView::staticMetaObject, GetSpecialChildren<QTreeView>, { "QModelIndex" }, HasModelRows);
+    registry.RegisterDataChildren(&QListView::staticMetaObject, GetSpecialChildren<QListView>, { "QModelIndex" }, HasModelRows);
+    // Scene items may be QGraphicsObjects of any class, so there are no names.
+    // Queries only get the items whose subtrees may match instead:
+    registry.RegisterDataChildren(&QGraphicsView::staticMetaObject, GetSpecialChildren<QGraphicsView>);
+    registry.RegisterMatchingDataChildren(&QTreeView::staticMetaObject, GetMatchingSpecialChildren<QTreeView>);
+    registry.RegisterMatchingDataChildren(&QListView::staticMetaObject, GetMatchingSpecialChildren<QListView>);
+    registry.RegisterMatchingDataChildren(&QGraphicsView::staticMetaObject, GetMatchingSpecialChildren<QGraphicsView>);
+
+    // Qt5's hierarchy for QML has changed a bit:
+    // - On top there's a QQuickView which holds all the QQuick items
+    // - QQuickItems don't always follow the QObject type hierarchy (e.g. QQuickListView does not), therefore we use the QQuickItem's childItems()
+    // - In case it is not a QQuickItem, fall back to the standard QObject hierarchy
+    registry.RegisterExtraChildren(&QQuickView::staticMetaObject, GetQuickViewRootObject);
+    registry.RegisterExtraChildren(&QQuickWidget::staticMetaObject, GetQuickWidgetRootObject);
+    registry.RegisterExtraChildren(&QQuickWindow::staticMetaObject, GetQuickWindowData);
+    // Child items aren't QObject children, even if they are QObjects:
+    registry.RegisterExtraChildren(&QGraphicsObject::staticMetaObject, GetGraphicsObjectChildItems);
+
+    // QML views create their delegates lazily, so their rows are read from
+    // the model. The view classes are private, hence the registration by name:
+    const char* qml_views[] = { "QQuickListView", "QQuickGridView", "QQuickPathView", "QQuickRepeater" };
+    for (const char* qml_view : qml_views)
+    {
+        registry.RegisterDataChildren(QByteArray(qml_view), GetQmlModelRows, { "QmlModelRow" }, HasQmlModelRows);
+        registry.RegisterMatchingDataChildren(QByteArray(qml_view), GetMatchingQmlModelRows);
+    }
+
+    registry.RegisterObjectChildren(&QObject::staticMetaObject, GetObjectChildren);
+    registry.RegisterObjectChildren(&QQuickItem::staticMetaObject, GetQuickItemChildItems);
+}
+
+void CollectSpecialChildren(QObject* object, xpathselect::NodeVector& children, DBusNode::Ptr parent)
+{
+    NodeTypeHandlers const& handlers = NodeTypeRegistry::Instance().Handlers(object->metaObject());
+    if (handlers.data_children)
+        handlers.data_children(object, children, parent);
+}
+
+xpathselect::NodeVector QObjectNode::Children() const
+{
+    return CollectChildren(nullptr);
+}
+
+xpathselect::NodeVector QObjectNode::ChildrenFor(xpathselect::XPathQueryPart const& part) const
+{
+    return CollectChildren(&part);
+}
+
+xpathselect::NodeVector QObjectNode::ObjectChildren() const
+{
+    return CollectChildren(nullptr, false);
+}
+
+xpathselect::NodeVector QObjectNode::CollectChildren(xpathselect::XPathQueryPart const* part, bool data_children_wanted) const
+{
+    if (ThreadBatches::IsForeign(object_))
+        return CollectForeignChildren(part);
+
+    xpathselect::NodeVector children;
+
+    NodeTypeHandlers const& handlers = NodeTypeRegistry::Instance().Handlers(object_->metaObject());
+    // Data children can be many (one per model index), and they only have
+    // children of their own kind. Queries for other names skip them.
+    bool data_children = data_children_wanted && handlers.data_children;
+    if (data_children && part && !handlers.data_children_names.empty())
+    {
+        data_children = false;
+        for (std::string const& name : handlers.data_children_names)
+            data_children = data_children || part->MayMatchName(name);
+    }
+    if (data_children || !handlers.extra_children.isEmpty())
+    {
+        // These depend on more than the object tree (item models, loaded QML
+        // components), so they are created anew every time.
+        DBusNode::Ptr self = Self();
+        if (data_children && part && handlers.matching_data_children)
+            handlers.matching_data_children(object_, *part, children, self);
+        else if (data_children)
+            handlers.data_children(object_, children, self);
+        foreach (ChildrenProvider provider, handlers.extra_children)
+            provider(object_, children, self);
+    }
+    bool visible_only = CurrentTraversalOptions().visible_only;
+    if (visible_only)
+        RemoveHiddenChildren(children);
+
+    if (handlers.object_children)
+    {
+        NodeCache& cache = NodeCache::Instance();
+        QObjectList const* cached = cache.Find(object_);
+        xpathselect::NodeVector object_children;
+        if (cached)
+        {
+            DBusNode::Ptr self = Self();
+            object_children.reserve(cached->size());
+            foreach (QObject* child, *cached)
+                object_children.push_back(MakeChildNode<QObjectNode>(self, child));
+        }
+        else
+        {
+            handlers.object_children(object_, object_children, Self());
+            // Only the objects are kept, see NodeCache:
+            QObjectList child_objects;
+            bool all_objects = true;
+            for (xpathselect::Node::Ptr const& child : object_children)
+            {
+                auto object_node = std::dynamic_pointer_cast<const QObjectNode>(child);
+                if (!object_node)
+                {
+                    all_objects = false;
+                    break;
+                }
+                child_objects.append(object_node->getWrappedObject());
+            }
+            if (all_objects)
+                cache.Insert(object_, child_objects);
+        }
+        // The cache holds all children, whatever the request's options:
+        if (visible_only)
+            RemoveHiddenChildren(object_children);
+        children.insert(children.end(), object_children.begin(), object_children.end());
+    }
+
+    return children;
+}
+
+xpathselect::NodeVector QObjectNode::CollectForeignChildren(xpathselect::XPathQueryPart const* part) const
+{
+    // Objects of other threads are neither widgets nor items, so they have
+    // no data or extra children, and nothing to hide. They aren't cached
+    // either (see NodeCache::IsCacheable).
+    QObjectList child_objects;
+    if (children_prefetched_)
+        child_objects = prefetched_children_;
+    else
+    {
+        QObject* object = object_;
+        RunInThreadOf(object, [object, &child_objects] {
+            foreach (QObject* child, object->children())
+            {
+                if (child->parent() == object)
+                    child_objects.append(child);
+            }
+        });
+    }
+
+    xpathselect::NodeVector children;
+    DBusNode::Ptr self = Self();
+    foreach (QObject* child, child_objects)
+        children.push_back(MakeChildNode<QObjectNode>(self, child));
+    if (part)
+        PrefetchForeign(children, *part);
+    return children;
+}
+
+void QObjectNode::PrefetchForeign(xpathselect::NodeVector const& nodes, xpathselect::XPathQueryPart const& part)
+{
+    // Ids are handed out here, and intersects is worked out here as well:
+    QList<QByteArray> names;
+    for (xpathselect::XPathQueryParam const& param : part.parameter)
+    {
+        QByteArray name = QByteArray::fromStdString(param.param_name);
+        if (name != "id" && name != "intersects" && !names.contains(name))
+            names.append(name);
+    }
+
+    struct Prefetch
+    {
+        explicit Prefetch(const QObjectNode* node) : node(node), read(false) {}
+
+        const QObjectNode* node;
+        QVariantList values;
+        QObjectList children;
+        bool read;
+    };
+    std::vector<Prefetch> prefetches;
+    for (xpathselect::Node::Ptr const& node : nodes)
+    {
+        // Direct child steps only go on from the nodes that match by name:
+        const QObjectNode* object_node = dynamic_cast<const QObjectNode*>(node.get());
+        if (object_node && ThreadBatches::IsForeign(object_node->object_)
+            && (part.SearchesDescendants() || part.MatchesName(node)))
+            prefetches.push_back(Prefetch(object_node));
+    }
+    if (prefetches.empty())
+        return;
+
+    ThreadBatches batches;
+    for (Prefetch& prefetch : prefetches)
+    {
+        QObject* object = prefetch.node->object_;
+        Prefetch* result = &prefetch;
+        batches.Add(object, [object, &names, result] {
+            foreach (QByteArray const& name, names)
+                result->values.append(GetNodeProperty(object, name));
+            foreach (QObject* child, object->children())
+            {
+                if (child->parent() == object)
+                    result->children.append(child);
+            }
+            result->read = true;
+        });
+    }
+    batches.Run();
+
+    // Objects of threads that didn't get to it are read one by one as before:
+    for (Prefetch const& prefetch : prefetches)
+    {
+        if (!prefetch.read)
+            continue;
+        for (int i = 0; i < names.size(); ++i)
+            prefetch.node->prefetched_properties_.insert(names.at(i), prefetch.values.at(i));
+        prefetch.node->prefetched_children_ = prefetch.children;
+        prefetch.node->children_prefetched_ = true;
+    }
+}
+
+QStringList QObjectNode::GetChildNames() const
+{
+    NodeTypeHandlers const& handlers = NodeTypeRegistry::Instance().Handlers(object_->metaObject());
+    QStringList names;
+    // Data children can be many (one per model index or scene item), so each
+    // kind is named once instead, if there are any:
+    if (handlers.data_children && (!handlers.has_data_children || handlers.has_data_children(object_)))
+    {
+        for (std::string const& name : handlers.data_children_names)
+            names.append(QString::fromStdString(name));
+    }
+
+    // The other children are the ones the query engine sees, mostly cached:
+    xpathselect::NodeVector object_children = ObjectChildren();
+    names += GetChildNodeNames(object_children);
+
+    // A Loader's item, in case it isn't one of the Loader's child items
+    // (yet):
+    if (handlers.name.compare(0, 12, "QQuickLoader") == 0)
+    {
+        QObject* item = qvariant_cast<QObject*>(object_->property("item"));
+        bool listed = !item;
+        for (xpathselect::Node::Ptr const& child : object_children)
+        {
+            const QObjectNode* child_node = dynamic_cast<const QObjectNode*>(child.get());
+            listed = listed || (child_node && child_node->getWrappedObject() == item);
+        }
+        if (!listed)
+            names.append(NodeTypeRegistry::Instance().Handlers(item->metaObject()).name_string);
+    }
+    return names;
+}
+
+QStringList GetChildNodeNames(xpathselect::NodeVector const& children)
+{
+    QStringList names;
+    names.reserve(children.size());
+    for (xpathselect::Node::Ptr const& child : children)
+    {
+        // QObject nodes share one copy of the name per class:
+        if (const QObjectNode* object_node = dynamic_cast<const QObjectNode*>(child.get()))
+            names.append(NodeTypeRegistry::Instance().Handlers(object_node->getWrappedObject()->metaObject()).name_string);
+        else
+            names.append(QString::fromStdString(child->GetName()));
+    }
+    return names;
+}
+
+
+// QModelIndexNode
+QModelIndexNode::QModelIndexNode(QModelIndex index, QAbstractItemView* parent_view, DBusNode::Ptr const& parent, NodeArena* arena)
+    : DBusNode(parent, arena)
+    , index_(index)
+    , parent_view_(parent_view)
+{
+}
+
+NodeIntrospectionData QModelIndexNode::GetIntrospectionData() const
+{
+    NodeIntrospectionData data;
+    data.object_path = QString::fromStdString(GetPath());
+    data.state = PropertyRecord::FromVariantMap(GetProperties());
+    data.state.Set("id", GetId());
+    return data;
+}
+
+QVariantMap QModelIndexNode::GetProperties() const
+{
+    QVariantMap properties;
+    const QAbstractItemModel* model = index_.model();
+    if(model)
+    {
+        // Make an attempt to store the 'text' of a node to be user friendly-ish.
+        properties["text"] = SafePackProperty(model->data(index_));
+
+        // Include any Role data (mung the role name with added "Role")
+        QHash<int, QByteArray> const& role_names = ModelCache::Instance().RoleNames(model);
+        for (auto role = role_names.constBegin(); role != role_names.constEnd(); ++role)
+            properties[role.value() + "Role"] = SafePackProperty(model->data(index_, role.key()));
+    }
+
+    properties["onScreen"] = GetProperty("onScreen");
+    properties["globalRect"] = GetProperty("globalRect");
+
+    return properties;
+}
+
+QVariant QModelIndexNode::GetProperty(QByteArray const& name) const
+{
+    if (name == "onScreen" || name == "globalRect")
+    {
+        QRect rect = parent_view_->visualRect(index_);
+        if (name == "onScreen")
+        {
+            QRect viewport_contents = parent_view_->viewport()->contentsRect();
+            return PackProperty(viewport_contents.contains(rect));
+        }
+        QRect global_rect(
+            parent_view_->viewport()->mapToGlobal(rect.topLeft()),
+            rect.size());
+        return PackProperty(global_rect);
+    }
+
+    const QAbstractItemModel* model = index_.model();
+    int role = model ? ModelCache::Instance().RoleForProperty(model, name) : -1;
+    if (role < 0)
+        return QVariant();
+    return SafePackProperty(model->data(index_, role));
+}
+
+std::string QModelIndexNode::GetName() const
+{
+    return "QModelIndex";
+}
+
+std::size_t QModelIndexNode::GetNameHash() const
+{
+    static const std::size_t name_hash = std::hash<std::string>()("QModelIndex");
+    return name_hash;
+}
+
+int32_t QModelIndexNode::GetId() const
+{
+    // Ids stick to the item, not to its row (see ModelCache):
+    return ModelCache::Instance().IdForIndex(index_, parent_view_);
+}
+
+bool QModelIndexNode::MatchStringProperty(std::string const& name, std::string const& value) const
+{
+    return MatchPackedProperty(GetProperty(QByteArray::fromStdString(name)), QString::fromStdString(value));
+}
+
+bool QModelIndexNode::MatchIntegerProperty(std::string const& name, int32_t value) const
+{
+    // Indices that haven't been given an id yet can't have the one asked for,
+    // no need to hand them one:
+    if (name == "id")
+        return value != 0 && value == ModelCache::Instance().FindId(index_, parent_view_);
+
+    return MatchPackedProperty(GetProperty(QByteArray::fromStdString(name)), value);
+}
+
+bool QModelIndexNode::MatchBooleanProperty(std::string const& name, bool value) const
+{
+    return MatchPackedProperty(GetProperty(QByteArray::fromStdString(name)), value);
+}
+
+xpathselect::NodeVector QModelIndexNode::Children() const
+{
+    return CollectChildren(nullptr);
+}
+
+xpathselect::NodeVector QModelIndexNode::ChildrenFor(xpathselect::XPathQueryPart const& part) const
+{
+    // There is nothing but model indices below:
+    if (!part.MayMatchName(GetName()))
+        return xpathselect::NodeVector();
+    return CollectChildren(&part);
+}
+
+xpathselect::NodeVector QModelIndexNode::CollectChildren(xpathselect::XPathQueryPart const* part) const
+{
+    xpathselect::NodeVector children;
+    // In views that flatten the model, all indices are children of the view.
+    // Children hang off the first column.
+    QAbstractItemModel* model = const_cast<QAbstractItemModel*>(index_.model());
+    if (!model || !ShowsModelAsTree(parent_view_) || index_.column() != 0)
+        return children;
+    QAbstractItemView* shown_in = ShownIn(parent_view_);
+    if (shown_in && !ShowsChildIndices(shown_in, index_))
+        return children;
+
+    QModelIndexList indices;
+    CollectIndicesFor(model, index_, part, true, shown_in, indices);
+    DBusNode::Ptr self = Self();
+    foreach(QModelIndex index, indices)
+    {
+        if(index.isValid())
+            children.push_back(MakeChildNode<QModelIndexNode>(self, index, parent_view_));
+    }
+    return children;
+}
+
+// QmlModelRowNode
+QmlModelRowNode::QmlModelRowNode(QObject* view, QModelIndex index, DBusNode::Ptr const& parent, NodeArena* arena)
+    : DBusNode(parent, arena)
+    , view_(view)
+    , index_(index)
+    , row_(index.row())
+{
+}
+
+QmlModelRowNode::QmlModelRowNode(QObject* view, int row, QVariant model_data, DBusNode::Ptr const& parent, NodeArena* arena)
+    : DBusNode(parent, arena)
+    , view_(view)
+    , row_(row)
+    , model_data_(model_data)
+{
+}
+
+NodeIntrospectionData QmlModelRowNode::GetIntrospectionData() const
+{
+    NodeIntrospectionData data;
+    data.object_path = QString::fromStdString(GetPath());
+    data.state = PropertyRecord::FromVariantMap(GetProperties());
+    data.state.Set("id", GetId());
+    return data;
+}
+
+QVariantMap QmlModelRowNode::GetProperties() const
+{
+    QVariantMap properties;
+    properties["row"] = PackProperty(row_);
+
+    const QAbstractItemModel* model = index_.model();
+    if (model)
+    {
+        properties["text"] = SafePackProperty(model->data(index_));
+        QHash<int, QByteArray> const& role_names = ModelCache::Instance().RoleNames(model);
+        for (auto role = role_names.constBegin(); role != role_names.constEnd(); ++role)
+            properties[role.value() + "Role"] = SafePackProperty(model->data(index_, role.key()));
+    }
+    else
+    {
+        properties["modelData"] = SafePackProperty(model_data_);
+    }
+    return properties;
+}
+
+QVariant QmlModelRowNode::GetProperty(QByteArray const& name) const
+{
+    if (name == "row")
+        return PackProperty(row_);
+
+    const QAbstractItemModel* model = index_.model();
+    if (!model)
+        return name == "modelData" ? SafePackProperty(model_data_) : QVariant();
+
+    int role = ModelCache::Instance().RoleForProperty(model, name);
+    if (role < 0)
+        return QVariant();
+    return SafePackProperty(model->data(index_, role));
+}
+
+std::string QmlModelRowNode::GetName() const
+{
+    return "QmlModelRow";
+}
+
+std::size_t QmlModelRowNode::GetNameHash() const
+{
+    static const std::size_t name_hash = std::hash<std::string>()("QmlModelRow");
+    return name_hash;
+}
+
+int32_t QmlModelRowNode::GetId() const
+{
+    if (index_.isValid())
+        return ModelCache::Instance().IdForIndex(index_, view_);
+    return calculate_ap_id((static_cast<quint64>(reinterpret_cast<quintptr>(view_)) << 16) + row_);
+}
+
+bool QmlModelRowNode::MatchStringProperty(std::string const& name, std::string const& value) const
+{
+    return MatchPackedProperty(GetProperty(QByteArray::fromStdString(name)), QString::fromStdString(value));
+}
+
+bool QmlModelRowNode::MatchIntegerProperty(std::string const& name, int32_t value) const
+{
+    if (name == "id")
+    {
+        if (index_.isValid())
+            return value != 0 && value == ModelCache::Instance().FindId(index_, view_);
+        return value == GetId();
+    }
+
+    return MatchPackedProperty(GetProperty(QByteArray::fromStdString(name)), value);
+}
+
+bool QmlModelRowNode::MatchBooleanProperty(std::string const& name, bool value) const
+{
+    return MatchPackedProperty(GetProperty(QByteArray::fromStdString(name)), value);
+}
+
+xpathselect::NodeVector QmlModelRowNode::Children() const
+{
+    // The delegate, if there is one, is a child of the view's content item.
+    return xpathselect::NodeVector();
+}
+
+// QGraphicsItemNode
+QGraphicsItemNode::QGraphicsItemNode(QGraphicsItem* item, QGraphicsView* view, DBusNode::Ptr const& parent, NodeArena* arena)
+    : DBusNode(parent, arena)
+    , item_(item)
+    , view_(view)
+{
+}
+
+NodeIntrospectionData QGraphicsItemNode::GetIntrospectionData() const
 {
     NodeIntrospectionData data;
     data.object_path = QString::fromStdString(GetPath());
-    data.state = GetProperties();
-    data.state["id"] = PackProperty(GetId());
+    data.state = PropertyRecord::FromVariantMap(GetProperties());
+    QStringList children = GetChildNodeNames(Children());
+    if (!children.empty())
+        data.state.Set("Children", children);
+    data.state.Set("id", GetId());
+    return data;
+}
+
+QVariantMap QGraphicsItemNode::GetProperties() const
+{
+    QVariantMap properties;
+    properties["x"] = SafePackProperty(item_->x());
+    properties["y"] = SafePackProperty(item_->y());
+    properties["z"] = SafePackProperty(item_->zValue());
+    properties["opacity"] = SafePackProperty(item_->opacity());
+    properties["visible"] = SafePackProperty(item_->isVisible());
+    properties["enabled"] = SafePackProperty(item_->isEnabled());
+    properties["selected"] = SafePackProperty(item_->isSelected());
+    properties["toolTip"] = SafePackProperty(item_->toolTip());
+    if (view_)
+        properties["globalRect"] = PackProperty(GetGraphicsItemGlobalRect(item_, view_));
+    return properties;
+}
+
+std::string QGraphicsItemNode::GetName() const
+{
+    return GetGraphicsItemName(item_);
+}
+
+std::size_t QGraphicsItemNode::GetNameHash() const
+{
+    return std::hash<std::string>()(GetGraphicsItemName(item_));
+}
+
+int32_t QGraphicsItemNode::GetId() const
+{
+    return calculate_ap_id(static_cast<quint64>(reinterpret_cast<quintptr>(item_)));
+}
+
+bool QGraphicsItemNode::MatchStringProperty(std::string const& name, std::string const& value) const
+{
+    return MatchProperty(GetProperties(), name, QString::fromStdString(value));
+}
+
+bool QGraphicsItemNode::MatchIntegerProperty(std::string const& name, int32_t value) const
+{
+    if (name == "id")
+        return value == GetId();
+
+    return MatchProperty(GetProperties(), name, value);
+}
+
+bool QGraphicsItemNode::MatchBooleanProperty(std::string const& name, bool value) const
+{
+    return MatchProperty(GetProperties(), name, value);
+}
+
+xpathselect::NodeVector QGraphicsItemNode::Children() const
+{
+    xpathselect::NodeVector children;
+    AddGraphicsItemNodes(item_->childItems(), view_, children, Self());
+    return children;
+}
+
+xpathselect::NodeVector QGraphicsItemNode::ChildrenFor(xpathselect::XPathQueryPart const& part) const
+{
+    xpathselect::NodeVector children;
+    AddMatchingGraphicsItemNodes(item_->childItems(), view_, part, false, children, Self());
+    return children;
+}
+
+bool QGraphicsItemNode::IsOfType(std::string const& type_name, std::size_t /*type_name_hash*/) const
+{
+    if (type_name == "QGraphicsItem" || type_name == GetGraphicsItemName(item_))
+        return true;
+    if (type_name != "QAbstractGraphicsShapeItem")
+        return false;
+    switch (item_->type())
+    {
+    case QGraphicsPathItem::Type:
+    case QGraphicsRectItem::Type:
+    case QGraphicsEllipseItem::Type:
+    case QGraphicsPolygonItem::Type:
+    case QGraphicsSimpleTextItem::Type:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// QTableWidgetItemNode
+QTableWidgetItemNode::QTableWidgetItemNode(QTableWidgetItem *item, DBusNode::Ptr const& parent, NodeArena* arena)
+    : DBusNode(parent, arena)
+    , item_(item)
+{
+}
+
+NodeIntrospectionData QTableWidgetItemNode::GetIntrospectionData() const
+{
+    NodeIntrospectionData data;
+    data.object_path = QString::fromStdString(GetPath());
+    data.state = PropertyRecord::FromVariantMap(GetProperties());
+    data.state.Set("id", GetId());
     return data;
 }
 
@@ -509,19 +1777,15 @@ QVariantMap QTableWidgetItemNode::GetProperties() const
     return properties;
 }
 
-xpathselect::Node::Ptr QTableWidgetItemNode::GetParent() const
-{
-    return parent_;
-}
-
 std::string QTableWidgetItemNode::GetName() const
 {
     return "QTableWidgetItem";
 }
 
-std::string QTableWidgetItemNode::GetPath() const
+std::size_t QTableWidgetItemNode::GetNameHash() const
 {
-    return full_path_;
+    static const std::size_t name_hash = std::hash<std::string>()("QTableWidgetItem");
+    return name_hash;
 }
 
 int32_t QTableWidgetItemNode::GetId() const
@@ -555,20 +1819,18 @@ xpathselect::NodeVector QTableWidgetItemNode::Children() const
 }
 
 // QTreeWidgetItemNode
-QTreeWidgetItemNode::QTreeWidgetItemNode(QTreeWidgetItem *item, DBusNode::Ptr parent)
-    : item_(item)
-    , parent_(parent)
+QTreeWidgetItemNode::QTreeWidgetItemNode(QTreeWidgetItem *item, DBusNode::Ptr const& parent, NodeArena* arena)
+    : DBusNode(parent, arena)
+    , item_(item)
 {
-    std::string parent_path = parent ? parent->GetPath() : "";
-    full_path_ = parent_path + "/" + GetName();
 }
 
 NodeIntrospectionData QTreeWidgetItemNode::GetIntrospectionData() const
 {
     NodeIntrospectionData data;
     data.object_path = QString::fromStdString(GetPath());
-    data.state = GetProperties();
-    data.state["id"] = PackProperty(GetId());
+    data.state = PropertyRecord::FromVariantMap(GetProperties());
+    data.state.Set("id", GetId());
     return data;
 }
 
@@ -593,19 +1855,15 @@ QVariantMap QTreeWidgetItemNode::GetProperties() const
     return properties;
 }
 
-xpathselect::Node::Ptr QTreeWidgetItemNode::GetParent() const
-{
-    return parent_;
-}
-
 std::string QTreeWidgetItemNode::GetName() const
 {
     return "QTreeWidgetItem";
 }
 
-std::string QTreeWidgetItemNode::GetPath() const
+std::size_t QTreeWidgetItemNode::GetNameHash() const
 {
-    return full_path_;
+    static const std::size_t name_hash = std::hash<std::string>()("QTreeWidgetItem");
+    return name_hash;
 }
 
 int32_t QTreeWidgetItemNode::GetId() const
@@ -634,10 +1892,16 @@ bool QTreeWidgetItemNode::MatchBooleanProperty(std::string const& name, bool val
 xpathselect::NodeVector QTreeWidgetItemNode::Children() const
 {
     xpathselect::NodeVector children;
+    DBusNode::Ptr self = Self();
 
+    bool visible_only = CurrentTraversalOptions().visible_only;
+    if (visible_only && !item_->isExpanded())
+        return children;
     for(int i=0; i < item_->childCount(); ++i) {
+        if (visible_only && item_->child(i)->isHidden())
+            continue;
         children.push_back(
-            std::make_shared<QTreeWidgetItemNode>(item_->child(i),shared_from_this())
+            MakeChildNode<QTreeWidgetItemNode>(self, item_->child(i))
             );
     }
 
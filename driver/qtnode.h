@@ -2,13 +2,24 @@
 #define QTNODE_H
 
 #include <cstdint>
+#include <QStringList>
 #include <QVariant>
 #include <QDBusArgument>
 #include <xpathselect/node.h>
 
+#include "propertyrecord.h"
+
+#include <QHash>
 #include <QModelIndex>
+#include <QObject>
+#include <QPoint>
+#include <QRect>
+#include <QTransform>
 
+class NodeArena;
 class QAbstractItemView;
+class QGraphicsItem;
+class QGraphicsView;
 class QTableWidgetItem;
 class QTreeView;
 class QTreeWidgetItem;
@@ -17,7 +28,7 @@ class QTreeWidgetItem;
 struct NodeIntrospectionData
 {
     QString object_path;
-    QVariantMap state;
+    PropertyRecord state;
 };
 
 Q_DECLARE_METATYPE(NodeIntrospectionData);
@@ -32,10 +43,30 @@ class DBusNode : public xpathselect::Node
 public:
     typedef std::shared_ptr<const DBusNode> Ptr;
 
-    DBusNode() {}
+    DBusNode(DBusNode::Ptr const& parent, NodeArena* arena);
     virtual ~DBusNode() {}
 
     virtual NodeIntrospectionData GetIntrospectionData() const=0;
+
+    // xpathselect::Node
+    virtual xpathselect::Node::Ptr GetParent() const;
+    virtual std::string GetPath() const;
+
+    /// The arena this node was allocated in, see NodeArena.
+    NodeArena* GetArena() const { return arena_; }
+
+protected:
+    /// Return a pointer to this node to hand to its children as their parent.
+    DBusNode::Ptr Self() const;
+    /// Like GetParent, but without taking a reference to the parent.
+    const DBusNode* GetParentNode() const { return parent_; }
+
+private:
+    const DBusNode* parent_;
+    // Only set when the parent lives outside of this node's arena. Within an
+    // arena, the arena keeps the parent alive.
+    DBusNode::Ptr parent_owner_;
+    NodeArena* arena_;
 };
 
 /// Specialist class for all QObject object nodes.
@@ -43,15 +74,14 @@ public:
 /// out to specialist classes for a couple of minor edge-cases (i.e. QModelIndex)
 ///
 /// QObjectNode wraps a single QObject pointer. It derives from
-/// xpathselect::Node (DBusNode) and, like that class, is designed to be
-/// allocated on the heap and stored in a std::shared_ptr.
-class QObjectNode : public DBusNode, public std::enable_shared_from_this<QObjectNode>
+/// xpathselect::Node (DBusNode) and, like all nodes, is designed to be
+/// allocated in a NodeArena and stored in a std::shared_ptr.
+class QObjectNode : public DBusNode
 {
 public:
     typedef std::shared_ptr<const QObjectNode> Ptr;
 
-    QObjectNode(QObject* object, DBusNode::Ptr parent);
-    explicit QObjectNode(QObject* object);
+    explicit QObjectNode(QObject* object, DBusNode::Ptr const& parent = DBusNode::Ptr(), NodeArena* arena = nullptr);
 
     QObject* getWrappedObject() const;
 
@@ -59,60 +89,192 @@ public:
     virtual NodeIntrospectionData GetIntrospectionData() const;
 
     // xpathselect::Node
-    xpathselect::Node::Ptr GetParent() const;
     virtual std::string GetName() const;
-    virtual std::string GetPath() const;
+    virtual std::size_t GetNameHash() const;
     virtual int32_t GetId() const;
     virtual bool MatchStringProperty(std::string const& name, std::string const& value) const;
     virtual bool MatchIntegerProperty(std::string const& name, int32_t value) const;
     virtual bool MatchBooleanProperty(std::string const& name, bool value) const;
     virtual xpathselect::NodeVector Children() const;
+    virtual xpathselect::NodeVector ChildrenFor(xpathselect::XPathQueryPart const& part) const;
+    virtual bool IsOfType(std::string const& type_name, std::size_t type_name_hash) const;
+
+    /// Set 'rect' to the bounding rectangle of the wrapped widget or item in
+    /// global coordinates. Return false if the object is neither, or if it
+    /// isn't shown in a window.
+    ///
+    /// The mapping to global coordinates is derived from the one of the parent
+    /// node where possible, so the rectangles of a whole subtree take a single
+    /// walk down the tree instead of one walk up per node.
+    bool GetGlobalRect(QRect& rect) const;
+
+    /// Return the children that wrap QObjects, without the data children
+    /// (e.g. without the model indices of an item view).
+    xpathselect::NodeVector ObjectChildren() const;
+
+    /// Read what a query needs from those of 'nodes' that wrap objects of
+    /// other threads, in one batch per thread: the properties named in the
+    /// predicates of 'part' and the objects' children. Saves the query a
+    /// round trip to each object's thread per predicate and per child list.
+    /// Only nodes that 'part' may match are read, unless it is searched for.
+    static void PrefetchForeign(xpathselect::NodeVector const& nodes, xpathselect::XPathQueryPart const& part);
+
+    /// Return the state of this node, given the properties of the wrapped
+    /// object as read by ReadNodeProperties. Lets the properties of objects
+    /// in other threads be read in those threads (see GetNodesIntrospectionData),
+    /// while the node itself is only used in this one. If 'available' is
+    /// false, the object's thread didn't get to reading them, and the state
+    /// says so with an 'unavailable' property.
+    NodeIntrospectionData GetIntrospectionDataFrom(PropertyRecord const& properties, bool available = true) const;
 
 private:
+    /// Maps the wrapped object's coordinates to global ones: first to window
+    /// coordinates, then by the position of the window on the screen.
+    struct GlobalGeometry
+    {
+        GlobalGeometry() : pass(0), valid(false) {}
+
+        quint64 pass;
+        bool valid;
+        QTransform to_window;
+        QPoint window_origin;
+    };
+
+    /// Return all children if 'part' is null, otherwise see ChildrenFor. The
+    /// data children are left out if 'data_children_wanted' is false.
+    xpathselect::NodeVector CollectChildren(xpathselect::XPathQueryPart const* part, bool data_children_wanted = true) const;
+    /// Return the children of an object of another thread, listed in that
+    /// thread unless they were prefetched. None if the thread doesn't get to
+    /// it. If 'part' is not null, see PrefetchForeign.
+    xpathselect::NodeVector CollectForeignChildren(xpathselect::XPathQueryPart const* part) const;
+    /// Return the names for the 'Children' pseudo-property. Data children
+    /// are listed by their registered names, without creating them.
+    QStringList GetChildNames() const;
+    /// Return the geometry of this node for the current geometry pass, see
+    /// BeginGeometryPass.
+    GlobalGeometry const& GetGlobalGeometry() const;
+    /// Return the packed value of the property 'name', read in the thread
+    /// the object lives in.
+    QVariant ReadProperty(std::string const& name) const;
+
     QObject *object_;
-    std::string full_path_;
-    DBusNode::Ptr parent_;
+    mutable GlobalGeometry geometry_;
+    // Read ahead for objects of other threads, see PrefetchForeign:
+    mutable QHash<QByteArray, QVariant> prefetched_properties_;
+    mutable QObjectList prefetched_children_;
+    mutable bool children_prefetched_;
 };
 
-class QModelIndexNode : public DBusNode, public std::enable_shared_from_this<QModelIndexNode>
+class QModelIndexNode : public DBusNode
 {
 public:
-    QModelIndexNode(QModelIndex index, QAbstractItemView* parent_view, DBusNode::Ptr parent);
+    QModelIndexNode(QModelIndex index, QAbstractItemView* parent_view, DBusNode::Ptr const& parent, NodeArena* arena = nullptr);
 
     // DBusNode
     virtual NodeIntrospectionData GetIntrospectionData() const;
 
     // xpathselect::Node
-    xpathselect::Node::Ptr GetParent() const;
     virtual std::string GetName() const;
-    virtual std::string GetPath() const;
+    virtual std::size_t GetNameHash() const;
     virtual int32_t GetId() const;
     virtual bool MatchStringProperty(std::string const& name, std::string const& value) const;
     virtual bool MatchIntegerProperty(std::string const& name, int32_t value) const;
     virtual bool MatchBooleanProperty(std::string const& name, bool value) const;
     virtual xpathselect::NodeVector Children() const;
+    virtual xpathselect::NodeVector ChildrenFor(xpathselect::XPathQueryPart const& part) const;
 
 private:
+    /// Return all children if 'part' is null, otherwise see ChildrenFor.
+    xpathselect::NodeVector CollectChildren(xpathselect::XPathQueryPart const* part) const;
     QVariantMap GetProperties() const;
+    /// Return the packed value of the single property 'name', or an invalid
+    /// QVariant if there is no such property.
+    QVariant GetProperty(QByteArray const& name) const;
 
     QModelIndex index_;
     QAbstractItemView* parent_view_;
-    std::string full_path_;
-    DBusNode::Ptr parent_;
 };
 
-class QTableWidgetItemNode : public DBusNode, public std::enable_shared_from_this<QTableWidgetItemNode>
+/// A row of the model of a QML ListView, GridView, PathView or Repeater.
+///
+/// These views only create delegates for the rows that are (nearly) visible,
+/// so the rows are read from the model instead: an item model, a JS array
+/// or a row count.
+class QmlModelRowNode : public DBusNode
 {
 public:
-    QTableWidgetItemNode(QTableWidgetItem *item, DBusNode::Ptr parent);
+    /// A row of an item model.
+    QmlModelRowNode(QObject* view, QModelIndex index, DBusNode::Ptr const& parent, NodeArena* arena = nullptr);
+    /// A row of a JS array or of a row count, with the given 'modelData'.
+    QmlModelRowNode(QObject* view, int row, QVariant model_data, DBusNode::Ptr const& parent, NodeArena* arena = nullptr);
 
     // DBusNode
     virtual NodeIntrospectionData GetIntrospectionData() const;
 
     // xpathselect::Node
-    xpathselect::Node::Ptr GetParent() const;
     virtual std::string GetName() const;
-    virtual std::string GetPath() const;
+    virtual std::size_t GetNameHash() const;
+    virtual int32_t GetId() const;
+    virtual bool MatchStringProperty(std::string const& name, std::string const& value) const;
+    virtual bool MatchIntegerProperty(std::string const& name, int32_t value) const;
+    virtual bool MatchBooleanProperty(std::string const& name, bool value) const;
+    virtual xpathselect::NodeVector Children() const;
+
+private:
+    QVariantMap GetProperties() const;
+    QVariant GetProperty(QByteArray const& name) const;
+
+    QObject* view_;
+    QModelIndex index_;
+    int row_;
+    QVariant model_data_;
+};
+
+/// A QGraphicsItem that isn't a QGraphicsObject (those are QObjectNodes).
+///
+/// The items of a QGraphicsView's scene are children of the view, and child
+/// items are children of their parent item, whether they are QObjects or not.
+/// Nodes are named after the item's class for the standard item types (e.g.
+/// QGraphicsRectItem), and QGraphicsItem otherwise.
+class QGraphicsItemNode : public DBusNode
+{
+public:
+    QGraphicsItemNode(QGraphicsItem* item, QGraphicsView* view, DBusNode::Ptr const& parent, NodeArena* arena = nullptr);
+
+    // DBusNode
+    virtual NodeIntrospectionData GetIntrospectionData() const;
+
+    // xpathselect::Node
+    virtual std::string GetName() const;
+    virtual std::size_t GetNameHash() const;
+    virtual int32_t GetId() const;
+    virtual bool MatchStringProperty(std::string const& name, std::string const& value) const;
+    virtual bool MatchIntegerProperty(std::string const& name, int32_t value) const;
+    virtual bool MatchBooleanProperty(std::string const& name, bool value) const;
+    virtual xpathselect::NodeVector Children() const;
+    virtual xpathselect::NodeVector ChildrenFor(xpathselect::XPathQueryPart const& part) const;
+    virtual bool IsOfType(std::string const& type_name, std::size_t type_name_hash) const;
+
+    QGraphicsItem* GetItem() const { return item_; }
+
+private:
+    QVariantMap GetProperties() const;
+
+    QGraphicsItem* item_;
+    QGraphicsView* view_;
+};
+
+class QTableWidgetItemNode : public DBusNode
+{
+public:
+    QTableWidgetItemNode(QTableWidgetItem *item, DBusNode::Ptr const& parent, NodeArena* arena = nullptr);
+
+    // DBusNode
+    virtual NodeIntrospectionData GetIntrospectionData() const;
+
+    // xpathselect::Node
+    virtual std::string GetName() const;
+    virtual std::size_t GetNameHash() const;
     virtual int32_t GetId() const;
     virtual bool MatchStringProperty(std::string const& name, std::string const& value) const;
     virtual bool MatchIntegerProperty(std::string const& name, int32_t value) const;
@@ -123,22 +285,19 @@ private:
     QVariantMap GetProperties() const;
 
     QTableWidgetItem *item_;
-    std::string full_path_;
-    DBusNode::Ptr parent_;
 };
 
-class QTreeWidgetItemNode : public DBusNode, public std::enable_shared_from_this<QTreeWidgetItemNode>
+class QTreeWidgetItemNode : public DBusNode
 {
 public:
-    QTreeWidgetItemNode(QTreeWidgetItem *item, DBusNode::Ptr parent);
+    QTreeWidgetItemNode(QTreeWidgetItem *item, DBusNode::Ptr const& parent, NodeArena* arena = nullptr);
 
     // DBusNode
     virtual NodeIntrospectionData GetIntrospectionData() const;
 
     // xpathselect::Node
-    xpathselect::Node::Ptr GetParent() const;
     virtual std::string GetName() const;
-    virtual std::string GetPath() const;
+    virtual std::size_t GetNameHash() const;
     virtual int32_t GetId() const;
     virtual bool MatchStringProperty(std::string const& name, std::string const& value) const;
     virtual bool MatchIntegerProperty(std::string const& name, int32_t value) const;
@@ -149,8 +308,63 @@ private:
     QVariantMap GetProperties() const;
 
     QTreeWidgetItem *item_;
-    std::string full_path_;
-    DBusNode::Ptr parent_;
 };
 
+/// Add the nodes for the items of the scene shown by 'view' that intersect
+/// 'global_rect' to 'nodes', top-most first. The items are looked up in the
+/// scene's index instead of visiting every item. 'view_node' is the node of
+/// 'view', the nodes of the parent items on the way are created as needed.
+void GetGraphicsItemNodesIn(DBusNode::Ptr const& view_node, QGraphicsView* view, QRect const& global_rect, xpathselect::NodeVector& nodes);
+
+/// Return a new node id. QObject nodes and model index nodes share the ids.
+int32_t AllocateNodeId();
+
+/// Options that apply to the nodes of a single request.
+struct TraversalOptions
+{
+    TraversalOptions() : visible_only(false), max_value_size(0) {}
+
+    /// Leave out hidden widgets, items and windows, hidden rows and the
+    /// children of collapsed tree items and indices, along with everything
+    /// below them. Hidden rows and collapsed children are not even created.
+    /// Hidden widgets, items and windows are removed from the children lists
+    /// (see RemoveHiddenChildren), as the cached lists they come from are
+    /// shared with requests that want them (see NodeCache), but nothing below
+    /// them is visited.
+    bool visible_only;
+    /// Send strings, byte arrays and string lists longer than this many
+    /// characters as TYPE_TRUNCATED values, see TruncateLargeValues. 0 sends
+    /// everything.
+    int max_value_size;
+};
+
+/// Return the options of the request that is being answered.
+TraversalOptions const& CurrentTraversalOptions();
+
+/// Makes 'options' the current traversal options for as long as it exists.
+class ScopedTraversalOptions
+{
+public:
+    explicit ScopedTraversalOptions(TraversalOptions const& options);
+    ~ScopedTraversalOptions();
+
+private:
+    ScopedTraversalOptions(ScopedTraversalOptions const&);
+    ScopedTraversalOptions& operator=(ScopedTraversalOptions const&);
+
+    TraversalOptions previous_;
+};
+
+/// Remove the nodes of hidden widgets, items and windows from 'children'.
+void RemoveHiddenChildren(xpathselect::NodeVector& children);
+
+/// Start a new geometry pass. Nodes may outlive queries (e.g. the root node) while
+/// widgets and items move, so the global geometry a node derived during an
+/// earlier pass is recomputed when first asked for in this one.
+void BeginGeometryPass();
+
+/// Return the names of 'children' as they appear in query paths, for the
+/// 'Children' pseudo-property.
+QStringList GetChildNodeNames(xpathselect::NodeVector const& children);
+
 #endif // QTNODE_H
@@ -10,6 +10,7 @@ by the Free Software Foundation.
 #include "dbus_adaptor.h"
 #include "dbus_adaptor_qt.h"
 #include "dbus_object.h"
+#include "objectindex.h"
 #include "qtnode.h"
 
 #include <QCoreApplication>
@@ -27,6 +28,10 @@ void qt_testability_init(void)
     qDBusRegisterMetaType<NodeIntrospectionData>();
     qDBusRegisterMetaType<QList<NodeIntrospectionData> >();
 
+    // Install the object creation hooks as early as possible, so that the
+    // index sees objects as they are created:
+    ObjectIndex::Instance();
+
     DBusObject* obj = new DBusObject;
     new AutopilotAdaptor(obj);
     new AutopilotQtSpecificAdaptor(obj);
@@ -1,45 +1,102 @@
 #include "rootnode.h"
 #include "introspection.h"
+#include "nodearena.h"
+#include "objectindex.h"
+#include "propertyprofiler.h"
 
 #include <QObject>
 #include <QCoreApplication>
+#include <QEvent>
+#include <QMetaProperty>
 #include <QStringList>
 #include <QDebug>
 
-RootNode::RootNode(QCoreApplication* application)
-    : QObjectNode(application)
+PropertyChangeWatcher::PropertyChangeWatcher(QObject* object)
+    : changed_(true)
+{
+    const QMetaObject* meta = object->metaObject();
+    int on_property_changed = metaObject()->indexOfSlot("OnPropertyChanged()");
+    for (int i = 0; i < meta->propertyCount(); ++i)
+    {
+        QMetaProperty prop = meta->property(i);
+        if (prop.hasNotifySignal())
+            QMetaObject::connect(object, prop.notifySignalIndex(), this, on_property_changed);
+        else if (!prop.isConstant())
+            unnotified_properties_.append(prop.name());
+    }
+    object->installEventFilter(this);
+}
+
+bool PropertyChangeWatcher::TakeChanged()
+{
+    bool changed = changed_;
+    changed_ = false;
+    return changed;
+}
+
+bool PropertyChangeWatcher::eventFilter(QObject* /*watched*/, QEvent* event)
+{
+    if (event->type() == QEvent::DynamicPropertyChange)
+        changed_ = true;
+    return false;
+}
+
+void PropertyChangeWatcher::OnPropertyChanged()
+{
+    changed_ = true;
+}
+
+
+RootNode::RootNode(QCoreApplication* application, NodeArena* arena)
+    : QObjectNode(application, DBusNode::Ptr(), arena)
     , application_(application)
+    , state_watcher_(new PropertyChangeWatcher(application))
+    , exclusions_version_(0)
 {
 }
 
+RootNode::~RootNode()
+{
+    delete state_watcher_;
+}
 
 NodeIntrospectionData RootNode::GetIntrospectionData() const
 {
+    PropertyProfiler& profiler = PropertyProfiler::Instance();
+    if (state_watcher_->TakeChanged() || exclusions_version_ != profiler.ExclusionsVersion())
+    {
+        application_state_ = PropertyRecord();
+        ReadNodeProperties(application_, application_state_);
+        exclusions_version_ = profiler.ExclusionsVersion();
+    }
+
     NodeIntrospectionData data;
     data.object_path = QString::fromStdString(GetPath());
-    data.state = GetNodeProperties(application_);
-    QStringList child_names;
-    foreach(QObject* child, children_)
+    data.state = application_state_;
+    // Properties without a change signal may have changed silently:
+    foreach (QByteArray const& name, state_watcher_->UnnotifiedProperties())
     {
-        child_names.append(child->metaObject()->className());
+        int index = data.state.Find(QString::fromLatin1(name));
+        if (index >= 0)
+            data.state.SetPacked(index, GetNodeProperty(application_, name));
     }
 
-    data.state["Children"] = PackProperty(child_names);
-    data.state["id"] = PackProperty(GetId());
+    data.state.Set("Children", GetChildNodeNames(Children()));
+    data.state.Set("id", GetId());
     return data;
 }
 
-void RootNode::AddChild(QObject* child)
-{
-    children_.append(child);
-}
-
 std::string RootNode::GetName() const
 {
     QString appName = application_->applicationName().remove(' ').remove('.');
     return appName.isEmpty() ? "Root" : appName.toStdString();
 }
 
+std::size_t RootNode::GetNameHash() const
+{
+    return std::hash<std::string>()(GetName());
+}
+
 std::string RootNode::GetPath() const
 {
     return "/" + GetName();
@@ -47,8 +104,40 @@ std::string RootNode::GetPath() const
 
 xpathselect::NodeVector RootNode::Children() const
 {
+    quint64 version;
+    QList<QObject*> top_level = ObjectIndex::Instance().TopLevelObjects(&version);
+    // Wrapped anew every time: the root node lives as long as the
+    // application, and holding on to its children would keep the arena of
+    // the query that created them alive, with everything else in it.
+    DBusNode::Ptr self = Self();
     xpathselect::NodeVector children;
-    foreach(QObject* child, children_)
-        children.push_back(std::make_shared<QObjectNode>(child, shared_from_this()));
+    foreach(QObject* child, top_level)
+        children.push_back(MakeChildNode<QObjectNode>(self, child));
+
+    if (CurrentTraversalOptions().visible_only)
+        RemoveHiddenChildren(children);
+    return children;
+}
+
+xpathselect::NodeVector RootNode::ChildrenFor(xpathselect::XPathQueryPart const& part) const
+{
+    // Not the children of the application object, which QObjectNode would
+    // collect:
+    xpathselect::NodeVector children = Children();
+    // Top level objects may live in other threads:
+    QObjectNode::PrefetchForeign(children, part);
     return children;
 }
+
+bool RootNode::FindDescendants(xpathselect::XPathQueryPart const& part, xpathselect::NodeList& matches) const
+{
+    // Leading '//Name' and '//*[objectName=...]' steps are answered by the
+    // object index rather than by visiting the whole tree:
+    return FindIndexedDescendants(Self(), part, matches);
+}
+
+std::shared_ptr<RootNode> GetRootNode()
+{
+    static std::shared_ptr<RootNode> root = NodeArena::Create()->Make<RootNode>(QCoreApplication::instance());
+    return root;
+}
@@ -4,25 +4,64 @@
 #include "qtnode.h"
 
 #include <QList>
+#include <QObject>
 class QCoreApplication;
-class QObject;
+class QEvent;
 
 
+/// Tells whether any property of an object may have changed, through the
+/// properties' change signals and dynamic property change events.
+class PropertyChangeWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PropertyChangeWatcher(QObject* object);
+
+    /// Return true if a property may have changed since the last call.
+    bool TakeChanged();
+
+    /// The properties that can change without a signal. Their values can't be
+    /// kept.
+    QList<QByteArray> const& UnnotifiedProperties() const { return unnotified_properties_; }
+
+protected:
+    bool eventFilter(QObject* watched, QEvent* event);
+
+private slots:
+    void OnPropertyChanged();
+
+private:
+    bool changed_;
+    QList<QByteArray> unnotified_properties_;
+};
+
+
+/// The root of the tree. Its children are the top level widgets and windows of
+/// the application, as tracked by the ObjectIndex. The root node is kept
+/// across queries (see GetRootNode), and so is the application's state, until
+/// it changes.
 class RootNode: public QObjectNode
 {
 public:
-    RootNode(QCoreApplication* application);
+    explicit RootNode(QCoreApplication* application, NodeArena* arena = nullptr);
+    ~RootNode();
 
     virtual NodeIntrospectionData GetIntrospectionData() const;
 
-    void AddChild(QObject* child);
-
     virtual std::string GetName() const;
+    virtual std::size_t GetNameHash() const;
     virtual std::string GetPath() const;
     virtual xpathselect::NodeVector Children() const;
+    virtual xpathselect::NodeVector ChildrenFor(xpathselect::XPathQueryPart const& part) const;
+    virtual bool FindDescendants(xpathselect::XPathQueryPart const& part, xpathselect::NodeList& matches) const;
 private:
     QCoreApplication* application_;
-    QList<QObject*> children_;
+    PropertyChangeWatcher* state_watcher_;
+    mutable PropertyRecord application_state_;
+    mutable quint64 exclusions_version_;
 };
 
+/// Return the root node, which is created on first use.
+std::shared_ptr<RootNode> GetRootNode();
+
 #endif // ROOTNODE_H
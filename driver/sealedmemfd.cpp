@@ -0,0 +1,89 @@
+#include "sealedmemfd.h"
+
+#include <QDBusConnection>
+#include <QDebug>
+
+#ifdef Q_OS_LINUX
+  #include <cerrno>
+  #include <cstring>
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <unistd.h>
+#endif
+
+#if defined(Q_OS_LINUX) && defined(MFD_ALLOW_SEALING) && defined(F_ADD_SEALS)
+  #define HAVE_SEALED_MEMFD
+#endif
+
+namespace
+{
+    bool ProbeSealedMemfd()
+    {
+#ifdef HAVE_SEALED_MEMFD
+        if (!QDBusUnixFileDescriptor::isSupported())
+            return false;
+        if (!(QDBusConnection::sessionBus().connectionCapabilities() & QDBusConnection::UnixFileDescriptorPassing))
+            return false;
+
+        // The headers may be newer than the kernel:
+        int fd = memfd_create("autopilot-qt-probe", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (fd < 0)
+            return false;
+        close(fd);
+        return true;
+#else
+        return false;
+#endif
+    }
+}
+
+bool SealedMemfdSupported()
+{
+    // Neither the kernel nor the bus connection change while we run:
+    static const bool supported = ProbeSealedMemfd();
+    return supported;
+}
+
+QDBusUnixFileDescriptor CreateSealedMemfd(QByteArray const& data)
+{
+#ifdef HAVE_SEALED_MEMFD
+    int fd = memfd_create("autopilot-qt-state", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+    {
+        qWarning() << "Unable to create a memfd:" << std::strerror(errno);
+        return QDBusUnixFileDescriptor();
+    }
+
+    const char* begin = data.constData();
+    const char* end = begin + data.size();
+    while (begin != end)
+    {
+        ssize_t written = write(fd, begin, end - begin);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+        {
+            qWarning() << "Unable to write to a memfd:" << std::strerror(errno);
+            close(fd);
+            return QDBusUnixFileDescriptor();
+        }
+        begin += written;
+    }
+
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) < 0)
+    {
+        qWarning() << "Unable to seal a memfd:" << std::strerror(errno);
+        close(fd);
+        return QDBusUnixFileDescriptor();
+    }
+
+    // The descriptor keeps a duplicate:
+    QDBusUnixFileDescriptor descriptor(fd);
+    close(fd);
+    return descriptor;
+#else
+    Q_UNUSED(data);
+    qWarning() << "Sealed memfds are not supported on this platform.";
+    return QDBusUnixFileDescriptor();
+#endif
+}
@@ -0,0 +1,16 @@
+#ifndef SEALEDMEMFD_H
+#define SEALEDMEMFD_H
+
+#include <QByteArray>
+#include <QDBusUnixFileDescriptor>
+
+/// Return true if sealed memfds can be created here (Linux 3.17 and later)
+/// and file descriptors can be sent over the session bus.
+bool SealedMemfdSupported();
+
+/// Write 'data' into a new memfd and seal it against writing, growing and
+/// shrinking, so that clients can mmap it without copying or checking. Return
+/// an invalid descriptor if that fails.
+QDBusUnixFileDescriptor CreateSealedMemfd(QByteArray const& data);
+
+#endif // SEALEDMEMFD_H
@@ -0,0 +1,581 @@
+#include "spatialindex.h"
+#include "objectindex.h"
+
+#include <QCoreApplication>
+#include <QEvent>
+#include <QStringList>
+#include <QVariant>
+#include <QtGui/QWindow>
+#include <QtWidgets/QWidget>
+#include <QtQuick/QQuickItem>
+#include <QtQuick/QQuickWindow>
+
+#include <algorithm>
+#include <cstdlib>
+
+// Node capacity of the R-tree. The index holds a few thousand rectangles at
+// most, small nodes keep splits cheap.
+const std::size_t MAX_ENTRIES = 8;
+const std::size_t MIN_ENTRIES = 3;
+
+QVariant ReadWidgetGlobalRect(QObject* object);
+QVariant ReadQuickItemGlobalRect(QObject* object);
+
+qint64 Area(QRect const& rect);
+qint64 Enlargement(QRect const& rect, QRect const& added);
+
+qint64 Area(QRect const& rect)
+{
+    return qint64(rect.width()) * rect.height();
+}
+
+// How much 'rect' grows if 'added' is merged into it.
+qint64 Enlargement(QRect const& rect, QRect const& added)
+{
+    return Area(rect.united(added)) - Area(rect);
+}
+
+RTree::RTree()
+    : root_(new Node(true))
+    , size_(0)
+{
+}
+
+RTree::~RTree()
+{
+    Delete(root_);
+}
+
+void RTree::Insert(QRect const& rect, QObject* object)
+{
+    if (rect.isEmpty())
+        return;
+
+    Node* leaf = ChooseLeaf(rect);
+    Entry entry = { rect, nullptr, object };
+    leaf->entries.push_back(entry);
+    ++size_;
+    AdjustTree(leaf, leaf->entries.size() > MAX_ENTRIES ? Split(leaf) : nullptr);
+}
+
+bool RTree::Remove(QRect const& rect, QObject* object)
+{
+    if (rect.isEmpty())
+        return false;
+
+    Node* leaf = FindLeaf(root_, rect, object);
+    if (!leaf)
+        return false;
+
+    auto entry = std::find_if(leaf->entries.begin(), leaf->entries.end(), [object](Entry const& e) {
+        return e.object == object;
+    });
+    leaf->entries.erase(entry);
+    --size_;
+    CondenseTree(leaf);
+
+    // A root with a single child is a level too many:
+    if (!root_->leaf && root_->entries.size() == 1)
+    {
+        Node* old_root = root_;
+        root_ = old_root->entries.front().child;
+        root_->parent = nullptr;
+        delete old_root;
+    }
+    return true;
+}
+
+void RTree::Search(QRect const& rect, QList<QObject*>& found) const
+{
+    if (!rect.isEmpty())
+        Search(root_, rect, found);
+}
+
+void RTree::Clear()
+{
+    Delete(root_);
+    root_ = new Node(true);
+    size_ = 0;
+}
+
+RTree::Node* RTree::ChooseLeaf(QRect const& rect) const
+{
+    Node* node = root_;
+    while (!node->leaf)
+    {
+        // The child that needs to grow least, or the smallest one on a tie:
+        Entry* best = nullptr;
+        qint64 best_enlargement = 0;
+        for (Entry& entry : node->entries)
+        {
+            qint64 enlargement = Enlargement(entry.rect, rect);
+            if (!best || enlargement < best_enlargement
+                || (enlargement == best_enlargement && Area(entry.rect) < Area(best->rect)))
+            {
+                best = &entry;
+                best_enlargement = enlargement;
+            }
+        }
+        node = best->child;
+    }
+    return node;
+}
+
+RTree::Node* RTree::FindLeaf(Node* node, QRect const& rect, QObject* object) const
+{
+    for (Entry const& entry : node->entries)
+    {
+        if (node->leaf)
+        {
+            if (entry.object == object)
+                return node;
+        }
+        else if (entry.rect.contains(rect))
+        {
+            if (Node* leaf = FindLeaf(entry.child, rect, object))
+                return leaf;
+        }
+    }
+    return nullptr;
+}
+
+// Guttman's quadratic split: start both groups with the two entries that
+// would waste the most area together, then hand out the others, the one with
+// the strongest preference for either group first.
+RTree::Node* RTree::Split(Node* node)
+{
+    std::vector<Entry> entries;
+    entries.swap(node->entries);
+    Node* sibling = new Node(node->leaf);
+
+    std::size_t seed_a = 0, seed_b = 1;
+    qint64 worst_waste = -1;
+    for (std::size_t i = 0; i < entries.size(); ++i)
+    {
+        for (std::size_t j = i + 1; j < entries.size(); ++j)
+        {
+            qint64 waste = Area(entries[i].rect.united(entries[j].rect))
+                - Area(entries[i].rect) - Area(entries[j].rect);
+            if (waste > worst_waste)
+            {
+                worst_waste = waste;
+                seed_a = i;
+                seed_b = j;
+            }
+        }
+    }
+
+    QRect bounds_a = entries[seed_a].rect, bounds_b = entries[seed_b].rect;
+    node->entries.push_back(entries[seed_a]);
+    sibling->entries.push_back(entries[seed_b]);
+    entries.erase(entries.begin() + seed_b);
+    entries.erase(entries.begin() + seed_a);
+
+    while (!entries.empty())
+    {
+        // A group that needs all the remaining entries to be full enough
+        // gets them:
+        if (node->entries.size() + entries.size() <= MIN_ENTRIES)
+        {
+            node->entries.insert(node->entries.end(), entries.begin(), entries.end());
+            break;
+        }
+        if (sibling->entries.size() + entries.size() <= MIN_ENTRIES)
+        {
+            sibling->entries.insert(sibling->entries.end(), entries.begin(), entries.end());
+            break;
+        }
+
+        std::size_t next = 0;
+        qint64 strongest_preference = -1;
+        for (std::size_t i = 0; i < entries.size(); ++i)
+        {
+            qint64 preference = std::llabs(Enlargement(bounds_a, entries[i].rect)
+                                           - Enlargement(bounds_b, entries[i].rect));
+            if (preference > strongest_preference)
+            {
+                strongest_preference = preference;
+                next = i;
+            }
+        }
+
+        Entry entry = entries[next];
+        entries.erase(entries.begin() + next);
+        qint64 enlargement_a = Enlargement(bounds_a, entry.rect);
+        qint64 enlargement_b = Enlargement(bounds_b, entry.rect);
+        bool to_a = enlargement_a != enlargement_b ? enlargement_a < enlargement_b
+            : Area(bounds_a) != Area(bounds_b) ? Area(bounds_a) < Area(bounds_b)
+            : node->entries.size() <= sibling->entries.size();
+        if (to_a)
+        {
+            node->entries.push_back(entry);
+            bounds_a |= entry.rect;
+        }
+        else
+        {
+            sibling->entries.push_back(entry);
+            bounds_b |= entry.rect;
+        }
+    }
+
+    if (!node->leaf)
+    {
+        for (Entry& entry : node->entries)
+            entry.child->parent = node;
+        for (Entry& entry : sibling->entries)
+            entry.child->parent = sibling;
+    }
+    return sibling;
+}
+
+// Update the bounds on the path from 'node' to the root, and add 'split' (the
+// node split off 'node', if any) to the parent, splitting further up as
+// needed.
+void RTree::AdjustTree(Node* node, Node* split)
+{
+    while (node != root_)
+    {
+        Node* parent = node->parent;
+        EntryFor(node).rect = Bounds(node);
+        if (split)
+        {
+            Entry entry = { Bounds(split), split, nullptr };
+            parent->entries.push_back(entry);
+            split->parent = parent;
+            split = parent->entries.size() > MAX_ENTRIES ? Split(parent) : nullptr;
+        }
+        node = parent;
+    }
+
+    if (split)
+    {
+        Node* root = new Node(false);
+        Entry old_root_entry = { Bounds(root_), root_, nullptr };
+        Entry split_entry = { Bounds(split), split, nullptr };
+        root->entries.push_back(old_root_entry);
+        root->entries.push_back(split_entry);
+        root_->parent = root;
+        split->parent = root;
+        root_ = root;
+    }
+}
+
+// Drop the nodes on the path from 'leaf' to the root that have too few
+// entries left, and insert their entries again.
+void RTree::CondenseTree(Node* leaf)
+{
+    std::vector<Entry> orphans;
+    Node* node = leaf;
+    while (node != root_)
+    {
+        Node* parent = node->parent;
+        if (node->entries.size() < MIN_ENTRIES)
+        {
+            auto entry = std::find_if(parent->entries.begin(), parent->entries.end(), [node](Entry const& e) {
+                return e.child == node;
+            });
+            parent->entries.erase(entry);
+            CollectEntries(node, orphans);
+        }
+        else
+            EntryFor(node).rect = Bounds(node);
+        node = parent;
+    }
+
+    size_ -= int(orphans.size());
+    for (Entry const& orphan : orphans)
+        Insert(orphan.rect, orphan.object);
+}
+
+// Move the leaf entries below 'node' to 'entries', and delete the nodes.
+void RTree::CollectEntries(Node* node, std::vector<Entry>& entries)
+{
+    if (node->leaf)
+        entries.insert(entries.end(), node->entries.begin(), node->entries.end());
+    else
+    {
+        for (Entry const& entry : node->entries)
+            CollectEntries(entry.child, entries);
+    }
+    delete node;
+}
+
+void RTree::Search(Node* node, QRect const& rect, QList<QObject*>& found) const
+{
+    for (Entry const& entry : node->entries)
+    {
+        if (!entry.rect.intersects(rect))
+            continue;
+        if (node->leaf)
+            found.append(entry.object);
+        else
+            Search(entry.child, rect, found);
+    }
+}
+
+void RTree::Delete(Node* node)
+{
+    if (!node->leaf)
+    {
+        for (Entry const& entry : node->entries)
+            Delete(entry.child);
+    }
+    delete node;
+}
+
+QRect RTree::Bounds(Node* node)
+{
+    QRect bounds;
+    for (Entry const& entry : node->entries)
+        bounds |= entry.rect;
+    return bounds;
+}
+
+RTree::Entry& RTree::EntryFor(Node* node)
+{
+    std::vector<Entry>& siblings = node->parent->entries;
+    return *std::find_if(siblings.begin(), siblings.end(), [node](Entry const& e) {
+        return e.child == node;
+    });
+}
+
+SpatialIndex& SpatialIndex::Instance()
+{
+    static SpatialIndex index;
+    return index;
+}
+
+SpatialIndex::SpatialIndex()
+    : enabled_(false)
+    , built_(false)
+{
+}
+
+void SpatialIndex::SetEnabled(bool enabled)
+{
+    if (enabled == enabled_ || !QCoreApplication::instance())
+        return;
+
+    enabled_ = enabled;
+    if (enabled)
+    {
+        // Built on first use:
+        QCoreApplication::instance()->installEventFilter(this);
+        return;
+    }
+
+    QCoreApplication::instance()->removeEventFilter(this);
+    foreach (QObject* object, watched_)
+        disconnect(object, 0, this, 0);
+    watched_.clear();
+    tree_.Clear();
+    rects_.clear();
+    dirty_.clear();
+    built_ = false;
+}
+
+QSet<QObject*> SpatialIndex::FindIntersecting(QRect const& rect)
+{
+    if (!enabled_)
+        return QSet<QObject*>();
+
+    Update();
+    QList<QObject*> found;
+    tree_.Search(rect, found);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    return QSet<QObject*>(found.begin(), found.end());
+#else
+    return found.toSet();
+#endif
+}
+
+bool SpatialIndex::eventFilter(QObject* watched, QEvent* event)
+{
+    switch (event->type())
+    {
+    case QEvent::Move:
+    case QEvent::Resize:
+    case QEvent::Show:
+    case QEvent::Hide:
+    case QEvent::ParentChange:
+        // Until the index is built there's nothing to update:
+        if (built_ && (watched->isWidgetType() || watched->isWindowType()))
+        {
+            Watch(watched);
+            dirty_.insert(watched);
+        }
+        break;
+    default:
+        break;
+    }
+    return false;
+}
+
+void SpatialIndex::OnItemChanged()
+{
+    dirty_.insert(sender());
+}
+
+void SpatialIndex::OnObjectDestroyed(QObject* object)
+{
+    auto rect = rects_.find(object);
+    if (rect != rects_.end())
+    {
+        tree_.Remove(*rect, object);
+        rects_.erase(rect);
+    }
+    dirty_.remove(object);
+    watched_.remove(object);
+}
+
+void SpatialIndex::Update()
+{
+    QSet<QObject*> refreshed;
+    if (!built_)
+    {
+        quint64 version;
+        foreach (QObject* object, ObjectIndex::Instance().TopLevelObjects(&version))
+            Refresh(object, refreshed);
+        dirty_.clear();
+        built_ = true;
+        return;
+    }
+
+    // Refreshing may mark more objects (e.g. as items get watched), those are
+    // dealt with next time.
+    QSet<QObject*> dirty;
+    dirty.swap(dirty_);
+    foreach (QObject* object, dirty)
+        Refresh(object, refreshed);
+}
+
+// Bring the rectangles of 'object' and its descendants up to date. Widgets and
+// items that aren't shown are removed from the index, along with everything
+// below them.
+void SpatialIndex::Refresh(QObject* object, QSet<QObject*>& refreshed)
+{
+    if (refreshed.contains(object))
+        return;
+    refreshed.insert(object);
+
+    if (QQuickWindow* window = qobject_cast<QQuickWindow*>(object))
+    {
+        if (window->contentItem())
+            Refresh(window->contentItem(), refreshed);
+        return;
+    }
+    if (!object->isWidgetType() && !qobject_cast<QQuickItem*>(object))
+        return;
+
+    Watch(object);
+    if (!IsOnScreen(object))
+    {
+        RemoveSubtree(object);
+        return;
+    }
+
+    if (object->isWidgetType())
+    {
+        SetRect(object, ReadWidgetGlobalRect(object).toRect());
+        foreach (QObject* child, object->children())
+        {
+            if (child->isWidgetType())
+                Refresh(child, refreshed);
+        }
+    }
+    else
+    {
+        QQuickItem* item = static_cast<QQuickItem*>(object);
+        SetRect(object, ReadQuickItemGlobalRect(object).toRect());
+        foreach (QQuickItem* child, item->childItems())
+            Refresh(child, refreshed);
+    }
+}
+
+void SpatialIndex::SetRect(QObject* object, QRect const& rect)
+{
+    auto old_rect = rects_.find(object);
+    if (old_rect != rects_.end())
+    {
+        if (*old_rect == rect)
+            return;
+        tree_.Remove(*old_rect, object);
+        *old_rect = rect;
+    }
+    else
+        rects_.insert(object, rect);
+    tree_.Insert(rect, object);
+}
+
+// Hidden items are still watched, so that they are put back once shown.
+void SpatialIndex::RemoveSubtree(QObject* object)
+{
+    Watch(object);
+    auto rect = rects_.find(object);
+    if (rect != rects_.end())
+    {
+        tree_.Remove(*rect, object);
+        rects_.erase(rect);
+    }
+
+    if (object->isWidgetType())
+    {
+        foreach (QObject* child, object->children())
+        {
+            if (child->isWidgetType())
+                RemoveSubtree(child);
+        }
+    }
+    else if (QQuickItem* item = qobject_cast<QQuickItem*>(object))
+    {
+        foreach (QQuickItem* child, item->childItems())
+            RemoveSubtree(child);
+    }
+}
+
+void SpatialIndex::Watch(QObject* object)
+{
+    if (watched_.contains(object))
+        return;
+
+    watched_.insert(object);
+    connect(object, SIGNAL(destroyed(QObject*)), this, SLOT(OnObjectDestroyed(QObject*)));
+    // Widgets report their changes through the event filter.
+    if (qobject_cast<QQuickItem*>(object))
+    {
+        connect(object, SIGNAL(xChanged()), this, SLOT(OnItemChanged()));
+        connect(object, SIGNAL(yChanged()), this, SLOT(OnItemChanged()));
+        connect(object, SIGNAL(widthChanged()), this, SLOT(OnItemChanged()));
+        connect(object, SIGNAL(heightChanged()), this, SLOT(OnItemChanged()));
+        connect(object, SIGNAL(visibleChanged()), this, SLOT(OnItemChanged()));
+        connect(object, SIGNAL(parentChanged(QQuickItem*)), this, SLOT(OnItemChanged()));
+        connect(object, SIGNAL(childrenChanged()), this, SLOT(OnItemChanged()));
+    }
+}
+
+bool IsOnScreen(QObject* object)
+{
+    if (object->isWidgetType())
+        return static_cast<QWidget*>(object)->isVisible();
+    if (QQuickItem* item = qobject_cast<QQuickItem*>(object))
+        return item->isVisible() && item->window() && item->window()->isVisible();
+    return false;
+}
+
+bool ParseRect(std::string const& value, QRect& rect)
+{
+    QStringList parts = QString::fromStdString(value).split(',');
+    if (parts.size() != 4)
+        return false;
+
+    int numbers[4];
+    for (int i = 0; i < 4; ++i)
+    {
+        bool ok = false;
+        numbers[i] = parts.at(i).trimmed().toInt(&ok);
+        if (!ok)
+            return false;
+    }
+    rect = QRect(numbers[0], numbers[1], numbers[2], numbers[3]);
+    return true;
+}
@@ -0,0 +1,126 @@
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QRect>
+#include <QSet>
+
+#include <string>
+#include <vector>
+
+class QEvent;
+
+/// An R-tree (Guttman, with quadratic splits) of rectangles that each stand
+/// for an object. Empty rectangles can't be stored, they intersect nothing.
+class RTree
+{
+public:
+    RTree();
+    ~RTree();
+
+    void Insert(QRect const& rect, QObject* object);
+    /// Remove the entry for 'object', which must have been inserted with
+    /// 'rect'. Return false if there is no such entry.
+    bool Remove(QRect const& rect, QObject* object);
+    /// Add the objects whose rectangles intersect 'rect' to 'found'.
+    void Search(QRect const& rect, QList<QObject*>& found) const;
+    void Clear();
+    int Size() const { return size_; }
+
+private:
+    RTree(RTree const&);
+    RTree& operator=(RTree const&);
+
+    struct Node;
+    struct Entry
+    {
+        QRect rect;
+        Node* child;
+        QObject* object;
+    };
+    struct Node
+    {
+        Node(bool leaf) : leaf(leaf), parent(nullptr) {}
+
+        bool leaf;
+        Node* parent;
+        std::vector<Entry> entries;
+    };
+
+    Node* ChooseLeaf(QRect const& rect) const;
+    Node* FindLeaf(Node* node, QRect const& rect, QObject* object) const;
+    Node* Split(Node* node);
+    void AdjustTree(Node* node, Node* split);
+    void CondenseTree(Node* leaf);
+    void CollectEntries(Node* node, std::vector<Entry>& entries);
+    void Search(Node* node, QRect const& rect, QList<QObject*>& found) const;
+    void Delete(Node* node);
+    static QRect Bounds(Node* node);
+    static Entry& EntryFor(Node* node);
+
+    Node* root_;
+    int size_;
+};
+
+/// An optional index of the global rectangles of the shown widgets and items,
+/// for queries by area (see the 'intersects' query predicate).
+///
+/// The index is built on first use once enabled, and kept up to date from
+/// then on: widgets report moves, resizes, showing and hiding through an
+/// application-wide event filter, and items through their geometry and
+/// visibility change signals. Changed objects are only marked, their
+/// rectangles and those of their descendants are updated before the next
+/// lookup.
+///
+/// Geometry changes that neither send events nor signals (e.g. the transform
+/// of an item) aren't picked up. Only objects living in the main thread are
+/// indexed, and items only if their window is shown, which leaves out the
+/// items of a QQuickWidget.
+class SpatialIndex : public QObject
+{
+    Q_OBJECT
+public:
+    static SpatialIndex& Instance();
+
+    bool IsEnabled() const { return enabled_; }
+    void SetEnabled(bool enabled);
+
+    /// Return the shown widgets and items whose global rectangle intersects
+    /// 'rect'.
+    QSet<QObject*> FindIntersecting(QRect const& rect);
+
+protected:
+    bool eventFilter(QObject* watched, QEvent* event);
+
+private slots:
+    void OnItemChanged();
+    void OnObjectDestroyed(QObject* object);
+
+private:
+    SpatialIndex();
+
+    void Update();
+    void Refresh(QObject* object, QSet<QObject*>& refreshed);
+    void SetRect(QObject* object, QRect const& rect);
+    void RemoveSubtree(QObject* object);
+    void Watch(QObject* object);
+
+    RTree tree_;
+    QHash<QObject*, QRect> rects_;
+    QSet<QObject*> dirty_;
+    QSet<QObject*> watched_;
+    bool enabled_;
+    bool built_;
+};
+
+/// Return whether 'object' is a widget or item that is shown on screen, see
+/// SpatialIndex.
+bool IsOnScreen(QObject* object);
+
+/// Parse the value of an 'intersects' predicate, "x,y,width,height" in global
+/// coordinates. Return false if it isn't one.
+bool ParseRect(std::string const& value, QRect& rect);
+
+#endif // SPATIALINDEX_H
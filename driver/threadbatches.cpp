@@ -0,0 +1,178 @@
+#include "threadbatches.h"
+#include "nodetyperegistry.h"
+
+#include <QAbstractEventDispatcher>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QEvent>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QObject>
+#include <QSemaphore>
+#include <QThread>
+
+#include <memory>
+
+// How long other threads get to run their batch:
+const int BATCH_TIMEOUT_MS = 1000;
+// How long threads that didn't are left alone, unless they get to their batch
+// in the meantime:
+const qint64 SKIP_THREAD_MS = 10000;
+
+QMutex skipped_threads_mutex;
+QHash<QThread*, qint64> skipped_threads;
+
+bool IsSkipped(QThread* thread);
+void SetSkipped(QThread* thread, bool skipped);
+
+struct Batch
+{
+    Batch() : thread(nullptr), runner(nullptr), finished(false), abandoned(false) {}
+
+    QThread* thread;
+    QList<std::function<void()> > tasks;
+    std::shared_ptr<QSemaphore> done;
+    // Deletes itself once it's done, or once the batch is abandoned:
+    QObject* runner;
+    // Held while the tasks run. Once 'abandoned' is set the tasks must not
+    // run any more, the waiting thread has moved on.
+    QMutex mutex;
+    bool finished;
+    bool abandoned;
+};
+
+// Runs a batch in the thread it has been moved to, once it gets the event
+// posted to it.
+class BatchRunner : public QObject
+{
+public:
+    explicit BatchRunner(std::shared_ptr<Batch> const& batch)
+        : batch_(batch)
+    {}
+
+    bool event(QEvent* event)
+    {
+        if (event->type() != QEvent::User)
+            return QObject::event(event);
+
+        {
+            QMutexLocker lock(&batch_->mutex);
+            if (batch_->abandoned)
+                SetSkipped(batch_->thread, false);
+            else
+            {
+                foreach (std::function<void()> const& task, batch_->tasks)
+                    task();
+                batch_->finished = true;
+            }
+        }
+        batch_->done->release();
+        deleteLater();
+        return true;
+    }
+
+private:
+    std::shared_ptr<Batch> batch_;
+};
+
+ThreadBatches::ThreadBatches()
+{
+}
+
+bool ThreadBatches::IsForeign(QObject* object)
+{
+    QThread* thread = object->thread();
+    return thread && thread != QThread::currentThread() && thread->isRunning();
+}
+
+void ThreadBatches::Add(QObject* object, std::function<void()> const& task, bool uses_registry)
+{
+    if (!IsForeign(object))
+    {
+        local_.append(task);
+        return;
+    }
+
+    // Tasks read properties, which looks up the handlers for the object's
+    // class. Resolving them here leaves the other threads with lookups only.
+    if (uses_registry)
+        NodeTypeRegistry::Instance().Handlers(object->metaObject());
+    batches_[object->thread()].append(task);
+}
+
+void ThreadBatches::Run()
+{
+    std::shared_ptr<QSemaphore> done(new QSemaphore);
+    QList<std::shared_ptr<Batch> > posted;
+    for (auto tasks = batches_.constBegin(); tasks != batches_.constEnd(); ++tasks)
+    {
+        // Threads without an event dispatcher never get to a posted batch:
+        if (IsSkipped(tasks.key()) || !QAbstractEventDispatcher::instance(tasks.key()))
+            continue;
+
+        std::shared_ptr<Batch> batch(new Batch);
+        batch->thread = tasks.key();
+        batch->tasks = tasks.value();
+        batch->done = done;
+        BatchRunner* runner = new BatchRunner(batch);
+        batch->runner = runner;
+        runner->moveToThread(batch->thread);
+        QCoreApplication::postEvent(runner, new QEvent(QEvent::User));
+        posted.append(batch);
+    }
+    batches_.clear();
+
+    if (!posted.isEmpty() && !done->tryAcquire(posted.size(), BATCH_TIMEOUT_MS))
+    {
+        foreach (std::shared_ptr<Batch> const& batch, posted)
+        {
+            // Waits for batches that are running right now:
+            QMutexLocker lock(&batch->mutex);
+            if (batch->finished)
+                continue;
+
+            qWarning() << "Thread" << batch->thread << "didn't get to introspection in time, its"
+                       << "objects are unavailable.";
+            batch->abandoned = true;
+            SetSkipped(batch->thread, true);
+            // Not done yet, so still there. If the thread never gets to it,
+            // it goes when the thread finishes:
+            batch->runner->deleteLater();
+        }
+    }
+
+    foreach (std::function<void()> const& task, local_)
+        task();
+    local_.clear();
+}
+
+bool RunInThreadOf(QObject* object, std::function<void()> const& task)
+{
+    bool ran = false;
+    ThreadBatches batches;
+    batches.Add(object, [&task, &ran] { task(); ran = true; });
+    batches.Run();
+    return ran;
+}
+
+bool IsSkipped(QThread* thread)
+{
+    QMutexLocker lock(&skipped_threads_mutex);
+    auto skipped = skipped_threads.find(thread);
+    if (skipped == skipped_threads.end())
+        return false;
+    if (QDateTime::currentMSecsSinceEpoch() - *skipped < SKIP_THREAD_MS)
+        return true;
+    skipped_threads.erase(skipped);
+    return false;
+}
+
+void SetSkipped(QThread* thread, bool skipped)
+{
+    QMutexLocker lock(&skipped_threads_mutex);
+    if (skipped)
+        skipped_threads.insert(thread, QDateTime::currentMSecsSinceEpoch());
+    else
+        skipped_threads.remove(thread);
+}
@@ -0,0 +1,53 @@
+#ifndef THREADBATCHES_H
+#define THREADBATCHES_H
+
+#include <QHash>
+#include <QList>
+
+#include <functional>
+
+class QObject;
+class QThread;
+
+/// Runs work on objects that live in other threads in the threads they live
+/// in, so that their properties aren't read while their own thread changes
+/// them.
+///
+/// Tasks are grouped per thread. The batches for all threads are posted at
+/// once and run in parallel, while the calling thread waits for them. Tasks
+/// for objects of the calling thread, or of threads that aren't running, run
+/// in the calling thread afterwards. The tasks of threads that don't get to
+/// them in time, e.g. because they are blocked, are not run at all: reading
+/// the objects of a thread from another one races with that thread. Those
+/// threads are then skipped for a while. Threads without an event dispatcher,
+/// which would never get to their batch, are skipped right away. Callers
+/// report the objects of skipped threads as unavailable.
+///
+/// Tasks may read properties through the NodeTypeRegistry, but must not
+/// create nodes or touch other state of the driver.
+class ThreadBatches
+{
+public:
+    ThreadBatches();
+
+    /// Add 'task', to be run in the thread 'object' lives in. Pass false for
+    /// 'uses_registry' if the task doesn't read through the NodeTypeRegistry,
+    /// so that the object's class isn't looked at from this thread.
+    void Add(QObject* object, std::function<void()> const& task, bool uses_registry = true);
+    /// Run all tasks added so far and wait for them to finish.
+    void Run();
+
+    /// Return true if 'object' lives in a running thread other than the
+    /// current one.
+    static bool IsForeign(QObject* object);
+
+private:
+    QHash<QThread*, QList<std::function<void()> > > batches_;
+    QList<std::function<void()> > local_;
+};
+
+/// Run 'task' in the thread of 'object' and wait for it, see ThreadBatches.
+/// Return false if the thread didn't get to it.
+bool RunInThreadOf(QObject* object, std::function<void()> const& task);
+
+#endif // THREADBATCHES_H
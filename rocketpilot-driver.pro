@@ -1,3 +1,6 @@
 TEMPLATE = subdirs
 
-SUBDIRS += lib driver
+SUBDIRS += lib xpathselect driver
+
+xpathselect.subdir = 3rdparty/xpathselect
+driver.depends = xpathselect
@@ -18,17 +18,41 @@
  *
  */
 
+#include <QCryptographicHash>
 #include <QStringList>
 #include <QtTest>
 #include <QMainWindow>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QGridLayout>
+#include <QPolygon>
 #include <QPushButton>
+#include <QSemaphore>
+#include <QStandardItemModel>
+#include <QTimer>
+#include <QTreeView>
+#include <QTreeWidget>
+#include <QWindow>
+
+#ifdef Q_OS_LINUX
+  #include <unistd.h>
+#endif
 
 #include "tst_introspection.h"
 
+#include "autopilot_types.h"
+#include "binarystate.h"
+#include "fastproperties.h"
 #include "introspection.h"
+#include "nodearena.h"
+#include "objectindex.h"
+#include "propertyprofiler.h"
+#include "propertyrecord.h"
 #include "qtnode.h"
+#include "sealedmemfd.h"
+#include "spatialindex.h"
+
+#include <xpathselect/xpathquerypart.h>
 
 QVariant IntrospectNode(QObject* obj);
 
@@ -488,3 +512,574 @@ void tst_Introspection::test_property_matching()
     QVERIFY(n.MatchIntegerProperty("myUInt", 5) == true);
     QVERIFY(n.MatchBooleanProperty("visible", true) == true);
 }
+
+void tst_Introspection::test_fast_properties_match_meta_properties()
+{
+    FastPropertyTable table = GetFastProperties(m_object);
+    QVERIFY(table.begin != table.end);
+
+    for (const FastProperty* p = table.begin; p != table.end; ++p)
+    {
+        QVariant meta_value = m_object->property(p->name);
+        if (!meta_value.isValid())
+            continue; // pseudo-property, e.g. globalRect
+
+        QCOMPARE(PackProperty(p->read(m_object)), PackProperty(meta_value));
+    }
+
+    QVERIFY(FindFastProperty(table, "globalRect") != nullptr);
+    QVERIFY(FindFastProperty(table, "noSuchProperty") == nullptr);
+
+    QObjectNode n(m_object);
+    QVERIFY(n.MatchIntegerProperty("width", m_object->width()) == true);
+    QVERIFY(n.MatchStringProperty("objectName", "testWindow") == true);
+    QVERIFY(n.MatchStringProperty("objectName", "notTestWindow") == false);
+}
+
+void tst_Introspection::test_excluded_properties()
+{
+    PropertyProfiler& profiler = PropertyProfiler::Instance();
+    profiler.SetExcludedProperties("QWidget", QList<QByteArray>() << "maximumSize" << "width");
+
+    QVariantMap properties = GetNodeProperties(m_object);
+    QVERIFY(!properties.contains("maximumSize"));
+    QVERIFY(!properties.contains("width"));
+    QVERIFY(properties.contains("height"));
+
+    // Excluded properties can still be read by name:
+    QObjectNode n(m_object);
+    QVERIFY(n.MatchIntegerProperty("width", m_object->width()) == true);
+
+    profiler.SetExcludedProperties("QWidget", QList<QByteArray>());
+    properties = GetNodeProperties(m_object);
+    QVERIFY(properties.contains("maximumSize"));
+    QVERIFY(properties.contains("width"));
+}
+
+void tst_Introspection::test_excluded_properties_in_worker_threads()
+{
+    // Both threads resolve the exclusions of the same class at once:
+    QThread threads[2];
+    QList<ThreadRecorder*> recorders;
+    QList<DBusNode::Ptr> nodes;
+    std::shared_ptr<NodeArena> arena = NodeArena::Create();
+    for (QThread& thread : threads)
+    {
+        thread.start();
+        for (int i = 0; i < 50; ++i)
+        {
+            ThreadRecorder* recorder = new ThreadRecorder;
+            recorder->setObjectName("recorder");
+            recorder->moveToThread(&thread);
+            recorders.append(recorder);
+            nodes.append(arena->Make<QObjectNode>(recorder, DBusNode::Ptr()));
+        }
+    }
+
+    PropertyProfiler& profiler = PropertyProfiler::Instance();
+    for (int round = 0; round < 10; ++round)
+    {
+        profiler.SetExcludedProperties("QObject", QList<QByteArray>() << "objectName");
+        QList<NodeIntrospectionData> state = GetNodesIntrospectionData(nodes);
+        QCOMPARE(state.size(), nodes.size());
+        for (NodeIntrospectionData const& data : state)
+        {
+            QVERIFY(!data.state.contains("objectName"));
+            QCOMPARE(data.state["readInOwnThread"], PackProperty(true));
+        }
+    }
+    profiler.SetExcludedProperties("QObject", QList<QByteArray>());
+
+    for (QThread& thread : threads)
+    {
+        thread.quit();
+        thread.wait();
+    }
+    qDeleteAll(recorders);
+}
+
+void tst_Introspection::test_indexed_queries()
+{
+    QCOMPARE(GetNodesThatMatchQuery("//QPushButton").size(), 2);
+    QCOMPARE(GetNodesThatMatchQuery("//*[objectName=\"myButton1\"]").size(), 1);
+
+    QPushButton *button = m_object->findChild<QPushButton*>("myButton1");
+    button->setObjectName("renamedButton");
+    QCOMPARE(GetNodesThatMatchQuery("//*[objectName=\"myButton1\"]").size(), 0);
+    QCOMPARE(GetNodesThatMatchQuery("//QPushButton[objectName=\"renamedButton\"]").size(), 1);
+    button->setObjectName("myButton1");
+
+    QPushButton *added = new QPushButton("MyButton3", m_object->centralWidget());
+    QCOMPARE(GetNodesThatMatchQuery("//QPushButton").size(), 3);
+    delete added;
+    QCOMPARE(GetNodesThatMatchQuery("//QPushButton").size(), 2);
+}
+
+void tst_Introspection::test_indexed_queries_drop_unreachable_candidates()
+{
+    RowCountingModel model;
+    model.appendRow(new QStandardItem("row"));
+    QTreeView *view = new QTreeView(m_object->centralWidget());
+    view->setModel(&model);
+    QTimer orphan;
+    orphan.setObjectName("myButton1");
+
+    // The timer has no way into the tree, so it doesn't cost a full
+    // traversal, which would walk into the view:
+    model.row_count_calls = 0;
+    QCOMPARE(GetNodesThatMatchQuery("//*[objectName=\"myButton1\"]").size(), 1);
+    QCOMPARE(model.row_count_calls, 0);
+
+    delete view;
+}
+
+void tst_Introspection::test_type_test_queries()
+{
+    QCOMPARE(GetNodesThatMatchQuery("//is:QAbstractButton").size(), 2);
+    QCOMPARE(GetNodesThatMatchQuery("//is:QAbstractButton[objectName=\"myButton2\"]").size(), 1);
+    QCOMPARE(GetNodesThatMatchQuery("/tst_introspection/is:QMainWindow").size(), 1);
+    QCOMPARE(GetNodesThatMatchQuery("//is:QAbstractSlider").size(), 0);
+}
+
+void tst_Introspection::test_top_level_objects()
+{
+    QCOMPARE(GetNodesThatMatchQuery("/tst_introspection/QMainWindow").size(), 1);
+
+    QWidget *dialog = new QWidget;
+    dialog->setObjectName("topLevelDialog");
+    QCOMPARE(GetNodesThatMatchQuery("/tst_introspection/QWidget[objectName=\"topLevelDialog\"]").size(), 1);
+    QStringList children = Introspect("/").first().state["Children"].toList().at(1).toStringList();
+    QVERIFY(children.contains("QWidget"));
+
+    QWidget *child = new QWidget;
+    child->setObjectName("topLevelChild");
+    QCOMPARE(GetNodesThatMatchQuery("/tst_introspection/QWidget[objectName=\"topLevelChild\"]").size(), 1);
+    child->setParent(dialog);
+    QCOMPARE(GetNodesThatMatchQuery("/tst_introspection/QWidget[objectName=\"topLevelChild\"]").size(), 0);
+    QCOMPARE(GetNodesThatMatchQuery("/tst_introspection/QWidget/QWidget[objectName=\"topLevelChild\"]").size(), 1);
+
+    delete dialog;
+    QCOMPARE(GetNodesThatMatchQuery("/tst_introspection/QWidget[objectName=\"topLevelDialog\"]").size(), 0);
+    QCOMPARE(GetNodesThatMatchQuery("/tst_introspection/QMainWindow").size(), 1);
+}
+
+void tst_Introspection::test_root_child_steps()
+{
+    // Child steps from the root take its top level objects, not the QObject
+    // children of the application:
+    QWindow window;
+    window.setObjectName("topLevelWindow");
+    QCOMPARE(GetNodesThatMatchQuery("/tst_introspection/QWindow[objectName=\"topLevelWindow\"]").size(), 1);
+    QCOMPARE(GetNodesThatMatchQuery("/tst_introspection/QMainWindow").size(), 1);
+
+    QStringList names;
+    foreach (DBusNode::Ptr const& node, GetNodesThatMatchQuery("/tst_introspection/*"))
+        names.append(QString::fromStdString(node->GetName()));
+    QVERIFY(names.contains("QWindow"));
+    QVERIFY(names.contains("QMainWindow"));
+}
+
+void tst_Introspection::test_children_match_query_results()
+{
+    QList<NodeIntrospectionData> parent = Introspect("//QWidget[objectName=\"centralTestWidget\"]");
+    QCOMPARE(parent.size(), 1);
+    QStringList children = parent.first().state["Children"].toList().at(1).toStringList();
+
+    QStringList child_paths;
+    foreach (NodeIntrospectionData const& child, Introspect("//QWidget[objectName=\"centralTestWidget\"]/*"))
+        child_paths.append(child.object_path.section('/', -1));
+    QCOMPARE(children, child_paths);
+}
+
+void tst_Introspection::test_global_rects()
+{
+    QList<NodeIntrospectionData> geometry = IntrospectGeometry("/tst_introspection/QMainWindow");
+    QVERIFY(geometry.size() > 3);
+    QCOMPARE(geometry.first().object_path, QString("/tst_introspection/QMainWindow"));
+
+    foreach (NodeIntrospectionData const& data, geometry)
+    {
+        int id = data.state["id"].toList().at(1).toInt();
+        QList<DBusNode::Ptr> nodes = GetNodesThatMatchQuery(QString("//*[id=%1]").arg(id));
+        QCOMPARE(nodes.size(), 1);
+        QCOMPARE(QString::fromStdString(nodes.first()->GetPath()), data.object_path);
+
+        // Same as mapping each object on its own:
+        QObject* object = std::dynamic_pointer_cast<const QObjectNode>(nodes.first())->getWrappedObject();
+        const FastProperty* global_rect = FindFastProperty(GetFastProperties(object), "globalRect");
+        QVERIFY(global_rect != nullptr);
+        QCOMPARE(data.state["globalRect"], PackProperty(global_rect->read(object)));
+        QCOMPARE(nodes.first()->GetIntrospectionData().state["globalRect"], data.state["globalRect"]);
+    }
+
+    // Nodes are kept across queries, their geometry is not:
+    QPushButton *button = m_object->findChild<QPushButton*>("myButton1");
+    QPoint position = button->pos();
+    button->move(position + QPoint(7, 5));
+    QList<NodeIntrospectionData> moved = Introspect("//QPushButton[objectName=\"myButton1\"]");
+    QCOMPARE(moved.size(), 1);
+    QCOMPARE(moved.first().state["globalRect"], PackProperty(QRect(button->mapToGlobal(QPoint(0, 0)), button->size())));
+    button->move(position);
+}
+
+void tst_Introspection::test_visible_only()
+{
+    QWidget *hidden = new QWidget(m_object->centralWidget());
+    hidden->setObjectName("hiddenPage");
+    QPushButton *hidden_button = new QPushButton("HiddenButton", hidden);
+    hidden_button->setObjectName("hiddenButton");
+    hidden->hide();
+
+    QTreeWidget *tree = new QTreeWidget(m_object->centralWidget());
+    QTreeWidgetItem *top = new QTreeWidgetItem(tree, QStringList() << "top");
+    new QTreeWidgetItem(top, QStringList() << "child");
+    tree->show();
+
+    QCOMPARE(GetNodesThatMatchQuery("//QWidget[objectName=\"hiddenPage\"]").size(), 1);
+    QCOMPARE(GetNodesThatMatchQuery("//QPushButton").size(), 3);
+    QCOMPARE(GetNodesThatMatchQuery("//QTreeWidgetItem").size(), 2);
+    {
+        TraversalOptions options;
+        options.visible_only = true;
+        ScopedTraversalOptions scoped_options(options);
+
+        QCOMPARE(GetNodesThatMatchQuery("//QWidget[objectName=\"hiddenPage\"]").size(), 0);
+        QCOMPARE(GetNodesThatMatchQuery("//QPushButton[objectName=\"hiddenButton\"]").size(), 0);
+        QCOMPARE(GetNodesThatMatchQuery("//QPushButton").size(), 2);
+        QCOMPARE(GetNodesThatMatchQuery("//QTreeWidgetItem").size(), 1);
+        top->setExpanded(true);
+        QCOMPARE(GetNodesThatMatchQuery("//QTreeWidgetItem").size(), 2);
+        top->setHidden(true);
+        QCOMPARE(GetNodesThatMatchQuery("//QTreeWidgetItem").size(), 0);
+    }
+    // The options only apply while they are in scope:
+    QCOMPARE(GetNodesThatMatchQuery("//QWidget[objectName=\"hiddenPage\"]").size(), 1);
+
+    delete tree;
+    delete hidden;
+}
+
+void tst_Introspection::test_nodes_at_and_in()
+{
+    QPushButton *button = m_object->findChild<QPushButton*>("myButton1");
+    QRect button_rect(button->mapToGlobal(QPoint(0, 0)), button->size());
+
+    // The button, then its parents up to the window:
+    QList<DBusNode::Ptr> stack = GetNodesAt(button_rect.center());
+    QVERIFY(stack.size() >= 3);
+    QCOMPARE(std::dynamic_pointer_cast<const QObjectNode>(stack.first())->getWrappedObject(), (QObject*)button);
+    QCOMPARE(std::dynamic_pointer_cast<const QObjectNode>(stack.last())->getWrappedObject(), (QObject*)m_object);
+    QCOMPARE(QString::fromStdString(stack.first()->GetPath()), QString("/tst_introspection/QMainWindow/QWidget/QPushButton"));
+
+    QList<NodeIntrospectionData> state = IntrospectNodesAt(button_rect.center());
+    QCOMPARE(state.size(), stack.size());
+    QCOMPARE(state.first().state["objectName"], PackProperty(QString("myButton1")));
+
+    QList<QObject*> objects;
+    foreach (DBusNode::Ptr node, GetNodesIn(button_rect))
+        objects.append(std::dynamic_pointer_cast<const QObjectNode>(node)->getWrappedObject());
+    QVERIFY(objects.contains(button));
+    QVERIFY(objects.contains(m_object->centralWidget()));
+    QVERIFY(!objects.contains(m_object->findChild<QPushButton*>("myButton2")));
+}
+
+void tst_Introspection::test_spatial_index()
+{
+    QPushButton *button = m_object->findChild<QPushButton*>("myButton1");
+    QRect button_rect(button->mapToGlobal(QPoint(0, 0)), button->size());
+    QString query = QString("//QPushButton[intersects=\"%1,%2,%3,%4\"]")
+        .arg(button_rect.x()).arg(button_rect.y()).arg(button_rect.width()).arg(button_rect.height());
+    QCOMPARE(GetNodesThatMatchQuery(query).size(), 1);
+    QString any_query = QString(query).replace("//QPushButton", "//*");
+    int overlapping = GetNodesThatMatchQuery(any_query).size();
+    QVERIFY(overlapping >= 3);
+
+    SpatialIndex& index = SpatialIndex::Instance();
+    index.SetEnabled(true);
+    QSet<QObject*> found = index.FindIntersecting(button_rect);
+    QVERIFY(found.contains(button));
+    QVERIFY(found.contains(m_object->centralWidget()));
+    QVERIFY(found.contains(m_object));
+    QVERIFY(!found.contains(m_object->findChild<QPushButton*>("myButton2")));
+    QCOMPARE(GetNodesThatMatchQuery(query).size(), 1);
+    QCOMPARE(GetNodesThatMatchQuery(any_query).size(), overlapping);
+
+    // Moves, hiding and showing are picked up:
+    QPoint position = button->pos();
+    button->move(position + QPoint(0, 1000));
+    QVERIFY(!index.FindIntersecting(button_rect).contains(button));
+    QVERIFY(index.FindIntersecting(button_rect.translated(0, 1000)).contains(button));
+    button->move(position);
+    QVERIFY(index.FindIntersecting(button_rect).contains(button));
+    button->hide();
+    QVERIFY(!index.FindIntersecting(button_rect).contains(button));
+    QCOMPARE(GetNodesThatMatchQuery("//QPushButton[objectName=\"myButton1\"]").size(), 1);
+    button->show();
+    QVERIFY(index.FindIntersecting(button_rect).contains(button));
+
+    index.SetEnabled(false);
+    QVERIFY(index.FindIntersecting(button_rect).isEmpty());
+    QCOMPARE(GetNodesThatMatchQuery(any_query).size(), overlapping);
+}
+
+void tst_Introspection::test_large_values_are_truncated()
+{
+    QString query("//QMainWindow[objectName=\"testWindow\"]");
+    QCOMPARE(Introspect(query).first().state["myStringList"],
+             PackProperty(QStringList() << "string1" << "string2" << "string3"));
+
+    TraversalOptions options;
+    options.max_value_size = 10;
+    PropertyRecord state;
+    {
+        ScopedTraversalOptions scoped_options(options);
+        state = Introspect(query).first().state;
+    }
+    QByteArray sha1 = QCryptographicHash::hash("string1\nstring2\nstring3", QCryptographicHash::Sha1).toHex();
+    QCOMPARE(state["myStringList"], QVariant(QVariantList() << TYPE_TRUNCATED << 3 << QString(sha1)));
+    QCOMPARE(state["objectName"], PackProperty(QString("testWindow")));
+    QCOMPARE(state["myByteArray"], PackProperty(QByteArray("0xDEADBEEF")));
+    QVERIFY(state["Children"].toList().at(0).toInt() != TYPE_TRUNCATED);
+
+    // The full values are still there, a chunk at a time:
+    DBusNode::Ptr node = GetNodesThatMatchQuery(query).first();
+    QCOMPARE(GetPropertyChunk(node, "myStringList", 1, 5), QVariant(QStringList() << "string2" << "string3"));
+    QCOMPARE(GetPropertyChunk(node, "objectName", 2, 3), QVariant(QString("stW")));
+    QVERIFY(!GetPropertyChunk(node, "myUInt", 0, 1).isValid());
+    QVERIFY(!GetPropertyChunk(node, "noSuchProperty", 0, 1).isValid());
+
+    // The values of data children come packed, and are truncated just the
+    // same:
+    QString long_text(20, 'x');
+    QStandardItemModel model;
+    model.appendRow(new QStandardItem(long_text));
+    QTreeView* view = new QTreeView(m_object->centralWidget());
+    view->setModel(&model);
+    {
+        ScopedTraversalOptions scoped_options(options);
+        state = Introspect("//QModelIndex").first().state;
+    }
+    QByteArray text_sha1 = QCryptographicHash::hash(long_text.toUtf8(), QCryptographicHash::Sha1).toHex();
+    QCOMPARE(state["text"], QVariant(QVariantList() << TYPE_TRUNCATED << 20 << QString(text_sha1)));
+    DBusNode::Ptr index_node = GetNodesThatMatchQuery("//QModelIndex").first();
+    QCOMPARE(GetPropertyChunk(index_node, "text", 15, 10), QVariant(QString(5, 'x')));
+    delete view;
+}
+
+void tst_Introspection::test_foreign_objects_are_read_in_their_thread()
+{
+    QThread thread;
+    thread.start();
+    ThreadRecorder recorder;
+    recorder.moveToThread(&thread);
+
+    QObjectNode::Ptr node = NodeArena::Create()->Make<QObjectNode>(&recorder, DBusNode::Ptr());
+    QList<DBusNode::Ptr> nodes = QList<DBusNode::Ptr>() << node << GetNodesThatMatchQuery("/tst_introspection/QMainWindow");
+    QList<NodeIntrospectionData> state = GetNodesIntrospectionData(nodes);
+    QCOMPARE(state.size(), 2);
+    QCOMPARE(state.at(0).state["readInOwnThread"], PackProperty(true));
+    QCOMPARE(state.at(1).state["objectName"], PackProperty(QString("testWindow")));
+    QCOMPARE(node->GetIntrospectionData().state["readInOwnThread"], PackProperty(true));
+    QVERIFY(node->MatchBooleanProperty("readInOwnThread", true));
+
+    // The objects of a blocked thread are unavailable, not read from here:
+    QSemaphore blocked, unblock;
+    QTimer::singleShot(0, &recorder, [&blocked, &unblock] { blocked.release(); unblock.acquire(); });
+    blocked.acquire();
+    NodeIntrospectionData unavailable = GetNodesIntrospectionData(QList<DBusNode::Ptr>() << node).first();
+    QCOMPARE(unavailable.state["unavailable"], PackProperty(true));
+    QVERIFY(!unavailable.state["readInOwnThread"].isValid());
+    QVERIFY(!node->MatchBooleanProperty("readInOwnThread", false));
+    unblock.release();
+    // Let the thread get to the batch it was too late for, so that it isn't
+    // skipped any more:
+    QSemaphore drained;
+    QTimer::singleShot(0, &recorder, [&drained] { drained.release(); });
+    drained.acquire();
+
+    // Objects of threads that have finished are read where they are needed:
+    thread.quit();
+    thread.wait();
+    QVERIFY(node->MatchBooleanProperty("readInOwnThread", false));
+}
+
+void tst_Introspection::test_foreign_names_are_read_when_changed()
+{
+    QThread thread;
+    thread.start();
+    ThreadRecorder recorder;
+    recorder.setObjectName("foreignRecorder");
+    recorder.moveToThread(&thread);
+
+    ObjectIndex& index = ObjectIndex::Instance();
+    QVERIFY(index.FindByObjectName("foreignRecorder").contains(&recorder));
+
+    // Nothing changed since, so a blocked thread doesn't hold the next lookup
+    // up:
+    QSemaphore blocked, unblock;
+    QTimer::singleShot(0, &recorder, [&blocked, &unblock] { blocked.release(); unblock.acquire(); });
+    blocked.acquire();
+    QElapsedTimer timer;
+    timer.start();
+    QVERIFY(index.FindByObjectName("foreignRecorder").contains(&recorder));
+    QVERIFY(timer.elapsed() < 500);
+    unblock.release();
+
+    // Renaming it has it read again:
+    QSemaphore renamed;
+    QTimer::singleShot(0, &recorder, [&recorder, &renamed] {
+        recorder.setObjectName("renamedRecorder");
+        renamed.release();
+    });
+    renamed.acquire();
+    QVERIFY(index.FindByObjectName("renamedRecorder").contains(&recorder));
+    QVERIFY(!index.FindByObjectName("foreignRecorder").contains(&recorder));
+
+    thread.quit();
+    thread.wait();
+}
+
+void tst_Introspection::test_foreign_predicates_are_read_ahead()
+{
+    QThread thread;
+    thread.start();
+    ThreadRecorder parent;
+    for (int i = 0; i < 5; ++i)
+        (new ThreadRecorder)->setParent(&parent);
+    parent.moveToThread(&thread);
+
+    xpathselect::XPathQueryPart part("ThreadRecorder");
+    part.PrepareNodeTest();
+    xpathselect::XPathQueryParam param;
+    param.param_name = "readInOwnThread";
+    param.param_value = true;
+    part.parameter.push_back(param);
+    QObjectNode::Ptr node = NodeArena::Create()->Make<QObjectNode>(&parent, DBusNode::Ptr());
+    xpathselect::NodeVector children = node->ChildrenFor(part);
+    QCOMPARE((int)children.size(), 5);
+
+    // The children's predicates and their own children were read along with
+    // them, so matching them doesn't wait for their blocked thread:
+    QSemaphore blocked, unblock;
+    QTimer::singleShot(0, &parent, [&blocked, &unblock] { blocked.release(); unblock.acquire(); });
+    blocked.acquire();
+    QElapsedTimer timer;
+    timer.start();
+    for (xpathselect::Node::Ptr const& child : children)
+    {
+        QVERIFY(part.Matches(child));
+        QVERIFY(child->ChildrenFor(part).empty());
+    }
+    QVERIFY(timer.elapsed() < 500);
+    unblock.release();
+
+    thread.quit();
+    thread.wait();
+}
+
+void tst_Introspection::test_property_record()
+{
+    QList<QVariant> values = QList<QVariant>()
+        << QVariant(true) << QVariant(-1) << QVariant(1u) << QVariant(Q_INT64_C(-1099511627776))
+        << QVariant(Q_UINT64_C(1099511627776)) << QVariant(0.5) << QVariant(0.25f)
+        << QVariant(QString("string")) << QVariant(QByteArray("bytes")) << QVariant(QUrl("file:///tmp"))
+        << QVariant(QStringList() << "a" << "b") << QVariant(QPoint(1, 2)) << QVariant(QRect(1, 2, 3, 4))
+        << QVariant(QSize(3, 4)) << QVariant(QColor(Qt::red)) << QVariant(QDateTime::currentDateTime())
+        << QVariant(QTime(1, 2, 3, 4));
+
+    PropertyRecord record;
+    for (int i = values.size() - 1; i >= 0; --i)
+        QVERIFY(record.Append(QByteArray::number(i).prepend("p").constData(), values.at(i)));
+    QVERIFY(!record.Append("unsupported", QVariant(QPolygon())));
+    QVERIFY(record.Append("p0", QVariant(false)));
+    record.Finish();
+
+    QCOMPARE(record.size(), values.size());
+    for (int i = 0; i < values.size(); ++i)
+        QCOMPARE(record.value(QString("p%1").arg(i)), PackProperty(values.at(i)));
+    for (int i = 1; i < record.size(); ++i)
+        QVERIFY(record.NameAt(i - 1) < record.NameAt(i));
+    QVERIFY(!record.value("unsupported").isValid());
+
+    // Replaced and added by name, in order:
+    QVERIFY(record.Set("p1", QVariant(2)));
+    QVERIFY(record.Set("a", QVariant(3)));
+    record.SetPacked("p2", QVariant(QVariantList() << TYPE_TRUNCATED << 1 << "sha1"));
+    QCOMPARE(record.value("p1"), PackProperty(2));
+    QCOMPARE(record.NameAt(0), QString("a"));
+    QCOMPARE(record.KindAt(record.Find("p2")), PropertyRecord::Packed);
+
+    QVariantMap packed_properties = record.ToVariantMap();
+    QCOMPARE(packed_properties.size(), record.size());
+    QCOMPARE(PropertyRecord::FromVariantMap(packed_properties).ToVariantMap(), packed_properties);
+
+    // Marshalled like the map it stands for:
+    QDBusArgument argument;
+    argument << record;
+    QCOMPARE(argument.currentSignature(), QString("a{sv}"));
+}
+
+void tst_Introspection::test_binary_state()
+{
+    TraversalOptions options;
+    options.max_value_size = 10;
+    QList<NodeIntrospectionData> state;
+    {
+        ScopedTraversalOptions scoped_options(options);
+        state = Introspect("//*");
+    }
+    QVERIFY(state.size() > 1);
+
+    QByteArray data = EncodeBinaryState(state);
+    QList<NodeIntrospectionData> decoded;
+    QVERIFY(DecodeBinaryState(data, decoded));
+    QCOMPARE(decoded.size(), state.size());
+    for (int i = 0; i < state.size(); ++i)
+    {
+        QCOMPARE(decoded.at(i).object_path, state.at(i).object_path);
+        QCOMPARE(decoded.at(i).state.ToVariantMap(), state.at(i).state.ToVariantMap());
+    }
+
+    // Truncated values are packed, and come back as they were:
+    int window = 0;
+    while (window < state.size() && state.at(window).state["objectName"] != PackProperty(QString("testWindow")))
+        ++window;
+    QVERIFY(window < state.size());
+    QCOMPARE(decoded.at(window).state["myStringList"].toList().at(0).toInt(), int(TYPE_TRUNCATED));
+
+    // Cut short, or another version:
+    QVERIFY(!DecodeBinaryState(data.left(data.size() - 1), decoded));
+    data[4] = char(BINARY_STATE_VERSION + 1);
+    QVERIFY(!DecodeBinaryState(data, decoded));
+    QVERIFY(!DecodeBinaryState(QByteArray(), decoded));
+}
+
+void tst_Introspection::test_sealed_memfd()
+{
+#ifdef Q_OS_LINUX
+    QByteArray data = EncodeBinaryState(Introspect("//*"));
+    QDBusUnixFileDescriptor fd = CreateSealedMemfd(data);
+    if (!fd.isValid())
+        QSKIP("Sealed memfds are not supported by this kernel");
+
+    QByteArray read_back(data.size() + 1, '\0');
+    QCOMPARE(int(pread(fd.fileDescriptor(), read_back.data(), read_back.size(), 0)), data.size());
+    read_back.chop(1);
+    QCOMPARE(read_back, data);
+    // Sealed, the client sees what was written and nothing else:
+    QVERIFY(pwrite(fd.fileDescriptor(), "x", 1, 0) < 0);
+#else
+    QSKIP("Sealed memfds are Linux only");
+#endif
+}
+
+void tst_Introspection::benchmark_introspect()
+{
+    // Run under a heap profiler to count the allocations per node. Slow, so
+    // only on request:
+    if (qEnvironmentVariableIsEmpty("AUTOPILOT_QT_BENCHMARK"))
+        QSKIP("Set AUTOPILOT_QT_BENCHMARK to run the benchmark");
+    QBENCHMARK {
+        Introspect("//*");
+    }
+}
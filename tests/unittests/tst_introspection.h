@@ -19,6 +19,36 @@
  */
 
 #include <QMainWindow>
+#include <QStandardItemModel>
+#include <QThread>
+
+/// Tells which thread its property is read in.
+class ThreadRecorder : public QObject
+{
+    Q_OBJECT
+    Q_PROPERTY(bool readInOwnThread READ readInOwnThread)
+
+public:
+    bool readInOwnThread() const { return QThread::currentThread() == thread(); }
+};
+
+/// Counts how often it is asked for its rows, i.e. how often something walks
+/// into the views that show it.
+class RowCountingModel : public QStandardItemModel
+{
+    Q_OBJECT
+
+public:
+    RowCountingModel() : row_count_calls(0) {}
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const
+    {
+        ++row_count_calls;
+        return QStandardItemModel::rowCount(parent);
+    }
+
+    mutable int row_count_calls;
+};
 
 class tst_Introspection : public QObject
 {
@@ -39,6 +69,30 @@ private slots:
 
     void test_property_matching();
 
+    void test_fast_properties_match_meta_properties();
+
+    void test_excluded_properties();
+    void test_excluded_properties_in_worker_threads();
+
+    void test_indexed_queries();
+    void test_indexed_queries_drop_unreachable_candidates();
+    void test_type_test_queries();
+    void test_top_level_objects();
+    void test_root_child_steps();
+    void test_children_match_query_results();
+    void test_global_rects();
+    void test_visible_only();
+    void test_nodes_at_and_in();
+    void test_spatial_index();
+    void test_large_values_are_truncated();
+    void test_foreign_objects_are_read_in_their_thread();
+    void test_foreign_names_are_read_when_changed();
+    void test_foreign_predicates_are_read_ahead();
+    void test_property_record();
+    void test_binary_state();
+    void test_sealed_memfd();
+    void benchmark_introspect();
+
 private:
     QMainWindow *m_object;
 };
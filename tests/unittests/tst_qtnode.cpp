@@ -24,13 +24,28 @@
 #include <QTreeWidget>
 #include <QTableWidget>
 #include <QListView>
+#include <QGraphicsItem>
+#include <QGraphicsScene>
+#include <QGraphicsView>
 #include <QModelIndex>
 #include <QStandardItemModel>
+#include <QStackedWidget>
+#include <QQuickItem>
+#include <QQmlComponent>
+#include <QQmlEngine>
 
 #include "tst_qtnode.h"
 
 #include "introspection.h"
+#include "modelcache.h"
+#include "nodearena.h"
+#include "nodecache.h"
+#include "nodetyperegistry.h"
 #include "qtnode.h"
+#include "spatialindex.h"
+
+#include <xpathselect/xpathquerypart.h>
+#include <xpathselect/xpathselect.h>
 
 int32_t calculate_ap_id(quint64 big_id);
 void CollectSpecialChildren(QObject* object, xpathselect::NodeVector& children, DBusNode::Ptr parent);
@@ -343,3 +358,452 @@ void tst_qtnode::test_CollectSpecialChildren_QObject_collects_nothing()
 
     QCOMPARE((int)children.size(), 0);
 }
+
+void tst_qtnode::test_NodeTypeRegistry_resolves_most_derived_handlers()
+{
+    NodeTypeRegistry& registry = NodeTypeRegistry::Instance();
+
+    QVERIFY(registry.Handlers(&QObject::staticMetaObject).data_children == nullptr);
+    QVERIFY(registry.Handlers(&QTreeView::staticMetaObject).data_children != nullptr);
+    QVERIFY(registry.Handlers(&QTreeWidget::staticMetaObject).data_children
+            != registry.Handlers(&QTreeView::staticMetaObject).data_children);
+
+    QVERIFY(registry.Handlers(&QObject::staticMetaObject).object_children != nullptr);
+    QVERIFY(registry.Handlers(&QQuickItem::staticMetaObject).object_children
+            != registry.Handlers(&QObject::staticMetaObject).object_children);
+}
+
+void AddStackedWidgetTestChild(QObject* object, xpathselect::NodeVector& children, DBusNode::Ptr parent)
+{
+    children.push_back(MakeChildNode<QObjectNode>(parent, object));
+}
+
+void tst_qtnode::test_NodeTypeRegistry_custom_children_provider()
+{
+    NodeTypeRegistry& registry = NodeTypeRegistry::Instance();
+    registry.RegisterDataChildren(&QStackedWidget::staticMetaObject, AddStackedWidgetTestChild);
+
+    xpathselect::NodeVector children;
+    DBusNode::Ptr parent;
+    QStackedWidget stackedWidget;
+
+    CollectSpecialChildren(&stackedWidget, children, parent);
+    // The provider refers to the widget itself, so later traversals of a
+    // QStackedWidget would never end:
+    registry.UnregisterDataChildren(&QStackedWidget::staticMetaObject);
+
+    QCOMPARE((int)children.size(), 1);
+    QVERIFY(registry.Handlers(&QStackedWidget::staticMetaObject).data_children != AddStackedWidgetTestChild);
+}
+
+void tst_qtnode::test_GetNameHash_matches_name()
+{
+    QTreeWidget widget;
+    QObjectNode::Ptr node = NodeArena::Create()->Make<QObjectNode>(&widget, DBusNode::Ptr());
+
+    QCOMPARE(node->GetName(), std::string("QTreeWidget"));
+    QCOMPARE(node->GetNameHash(), std::hash<std::string>()(node->GetName()));
+
+    QTreeWidgetItem item(QStringList() << "item");
+    QTreeWidgetItemNode item_node(&item, node);
+    QCOMPARE(item_node.GetNameHash(), std::hash<std::string>()(item_node.GetName()));
+}
+
+void tst_qtnode::test_NodeArena_keeps_parents_alive()
+{
+    QObject parent;
+    QObject child(&parent);
+
+    xpathselect::NodeVector children;
+    {
+        QObjectNode::Ptr root = NodeArena::Create()->Make<QObjectNode>(&parent, DBusNode::Ptr());
+        children = root->Children();
+    }
+
+    QCOMPARE((int)children.size(), 1);
+    // The arena, and with it the parent node, lives as long as any of its nodes:
+    QVERIFY(children[0]->GetParent() != nullptr);
+    QCOMPARE(children[0]->GetParent()->GetId(), NodeArena::Create()->Make<QObjectNode>(&parent, DBusNode::Ptr())->GetId());
+    QCOMPARE(children[0]->GetPath(), std::string("/QObject/QObject"));
+}
+
+void tst_qtnode::test_NodeArena_one_arena_per_query()
+{
+    QObject parent;
+    QObject child(&parent);
+    QObject grandchild(&child);
+
+    BeginQueryArena();
+    QObjectNode::Ptr root = NodeArena::Create()->Make<QObjectNode>(&parent, DBusNode::Ptr());
+    xpathselect::NodeVector children = root->Children();
+    QCOMPARE((int)children.size(), 1);
+    xpathselect::NodeVector grandchildren = children[0]->Children();
+    QCOMPARE((int)grandchildren.size(), 1);
+
+    // Children of different nodes share the arena of the query:
+    NodeArena* arena = std::static_pointer_cast<const DBusNode>(children[0])->GetArena();
+    QVERIFY(arena == QueryArena().get());
+    QVERIFY(std::static_pointer_cast<const DBusNode>(grandchildren[0])->GetArena() == arena);
+
+    BeginQueryArena();
+    QVERIFY(QueryArena().get() != arena);
+}
+
+void tst_qtnode::test_NodeCache_reuses_children_until_tree_changes()
+{
+    QObject parent;
+    new QObject(&parent);
+    QObjectNode::Ptr node = NodeArena::Create()->Make<QObjectNode>(&parent, DBusNode::Ptr());
+    NodeCache& cache = NodeCache::Instance();
+
+    QVERIFY(!cache.Find(&parent));
+    xpathselect::NodeVector first = node->Children();
+    QCOMPARE((int)first.size(), 1);
+    QVERIFY(cache.Find(&parent));
+    QCOMPARE(*cache.Find(&parent), parent.children());
+
+    new QObject(&parent);
+    QVERIFY(!cache.Find(&parent));
+    xpathselect::NodeVector second = node->Children();
+    QCOMPARE((int)second.size(), 2);
+    QCOMPARE(*cache.Find(&parent), parent.children());
+
+    delete parent.children().at(0);
+    QCOMPARE((int)node->Children().size(), 1);
+}
+
+void tst_qtnode::test_NodeCache_keeps_no_arena_alive()
+{
+    populate_QTreeView_with_data();
+    QObjectNode::Ptr node = NodeArena::Create()->Make<QObjectNode>(treeView.get(), DBusNode::Ptr());
+
+    // Model indices and cached object children alike go into the query's
+    // arena:
+    BeginQueryArena();
+    std::weak_ptr<NodeArena> first_arena;
+    {
+        xpathselect::NodeVector children = node->Children();
+        QVERIFY(!children.empty());
+        first_arena = QueryArena();
+    }
+    QVERIFY(NodeCache::Instance().Find(treeView.get()));
+
+    // Once its nodes are gone, a later query doesn't keep it alive, even if
+    // it is answered from the cache:
+    BeginQueryArena();
+    QVERIFY(!node->Children().empty());
+    QVERIFY(first_arena.expired());
+}
+
+void tst_qtnode::test_IsOfType_matches_base_classes()
+{
+    QTreeWidget widget;
+    QObjectNode::Ptr node = NodeArena::Create()->Make<QObjectNode>(&widget, DBusNode::Ptr());
+    auto is_of_type = [&node](std::string const& name) {
+        return node->IsOfType(name, std::hash<std::string>()(name));
+    };
+
+    QVERIFY(is_of_type("QTreeWidget"));
+    QVERIFY(is_of_type("QTreeView"));
+    QVERIFY(is_of_type("QAbstractItemView"));
+    QVERIFY(is_of_type("QObject"));
+    QVERIFY(!is_of_type("QTableWidget"));
+    QVERIFY(!is_of_type("NoSuchClass"));
+
+    // A hash collision doesn't make a class its own base class:
+    QVERIFY(node->IsOfType("QObject", 42));
+    QVERIFY(!node->IsOfType("QTableWidget", 42));
+}
+
+void tst_qtnode::test_ChildrenFor_skips_data_children_that_cannot_match()
+{
+    populate_QTreeView_with_data();
+    QObjectNode::Ptr node = NodeArena::Create()->Make<QObjectNode>(treeView.get(), DBusNode::Ptr());
+    auto count_model_indices = [&node](std::string const& name) {
+        xpathselect::XPathQueryPart part(name);
+        part.PrepareNodeTest();
+        int count = 0;
+        for (xpathselect::Node::Ptr const& child : node->ChildrenFor(part))
+        {
+            if (child->GetName() == "QModelIndex")
+                ++count;
+        }
+        return count;
+    };
+
+    QCOMPARE(count_model_indices("QModelIndex"), 5);
+    QCOMPARE(count_model_indices("is:QModelIndex"), 5);
+    QCOMPARE(count_model_indices("*"), 5);
+    QCOMPARE(count_model_indices("QPushButton"), 0);
+    // The object children are there either way:
+    xpathselect::XPathQueryPart part("QScrollBar");
+    part.PrepareNodeTest();
+    QVERIFY(!node->ChildrenFor(part).empty());
+}
+
+void tst_qtnode::test_Children_property_names_data_children_once()
+{
+    populate_QTreeView_with_data();
+    QObjectNode::Ptr node = NodeArena::Create()->Make<QObjectNode>(treeView.get(), DBusNode::Ptr());
+
+    QStringList children = node->GetIntrospectionData().state["Children"].toList().at(1).toStringList();
+    QCOMPARE(children.count("QModelIndex"), 1);
+    QVERIFY(children.contains("QHeaderView"));
+}
+
+void tst_qtnode::test_Children_property_leaves_out_missing_data_children()
+{
+    QTreeView view;
+    QObjectNode::Ptr node = NodeArena::Create()->Make<QObjectNode>(&view, DBusNode::Ptr());
+    QStringList children = node->GetIntrospectionData().state["Children"].toList().at(1).toStringList();
+    QVERIFY(!children.contains("QModelIndex"));
+
+    // An empty model has no rows either:
+    QStandardItemModel model;
+    view.setModel(&model);
+    children = node->GetIntrospectionData().state["Children"].toList().at(1).toStringList();
+    QVERIFY(!children.contains("QModelIndex"));
+
+    model.appendRow(new QStandardItem("row"));
+    children = node->GetIntrospectionData().state["Children"].toList().at(1).toStringList();
+    QVERIFY(children.contains("QModelIndex"));
+}
+
+void tst_qtnode::test_ChildrenFor_evaluates_role_predicates_on_the_model()
+{
+    populate_QTreeView_with_data();
+    QObjectNode::Ptr node = NodeArena::Create()->Make<QObjectNode>(treeView.get(), DBusNode::Ptr());
+    auto find_model_indices = [&node](std::string const& property, std::string const& value) {
+        xpathselect::XPathQueryPart part("QModelIndex");
+        part.PrepareNodeTest();
+        xpathselect::XPathQueryParam param;
+        param.param_name = property;
+        param.param_value = value;
+        part.parameter.push_back(param);
+        xpathselect::NodeVector matches;
+        for (xpathselect::Node::Ptr const& child : node->ChildrenFor(part))
+        {
+            if (part.Matches(child))
+                matches.push_back(child);
+        }
+        return matches;
+    };
+
+    xpathselect::NodeVector matches = find_model_indices("text", "test2");
+    QCOMPARE((int)matches.size(), 1);
+    QVERIFY(matches[0]->MatchStringProperty("displayRole", "test2"));
+    QCOMPARE((int)find_model_indices("displayRole", "test3").size(), 1);
+    QCOMPARE((int)find_model_indices("text", "no such item").size(), 0);
+    QCOMPARE((int)find_model_indices("noSuchRole", "test2").size(), 0);
+}
+
+void tst_qtnode::test_ModelCache_ids_follow_the_item()
+{
+    populate_QTreeView_with_data();
+    ModelCache& cache = ModelCache::Instance();
+
+    QModelIndexNode node(testModel->index(3, 0), treeView.get(), DBusNode::Ptr());
+    int32_t id = node.GetId();
+    QVERIFY(id != 0);
+    QCOMPARE(node.GetId(), id);
+    QCOMPARE(cache.FindIndex(id), testModel->index(3, 0));
+    QVERIFY(node.MatchIntegerProperty("id", id));
+
+    testModel->insertRow(0);
+    QCOMPARE(cache.FindIndex(id), testModel->index(4, 0));
+    QCOMPARE(cache.FindId(testModel->index(4, 0), treeView.get()), id);
+    QCOMPARE(cache.FindId(testModel->index(3, 0), treeView.get()), 0);
+
+    testModel->removeRow(4);
+    QVERIFY(!cache.FindIndex(id).isValid());
+}
+
+void tst_qtnode::test_ModelCache_ids_differ_between_views()
+{
+    populate_QTreeView_with_data();
+    QListView list_view;
+    list_view.setModel(testModel.get());
+    QObject qml_view;
+
+    QModelIndexNode tree_node(testModel->index(1, 0), treeView.get(), DBusNode::Ptr());
+    QModelIndexNode list_node(testModel->index(1, 0), &list_view, DBusNode::Ptr());
+    QmlModelRowNode row_node(&qml_view, testModel->index(1, 0), DBusNode::Ptr());
+
+    QSet<int32_t> ids;
+    ids << tree_node.GetId() << list_node.GetId() << row_node.GetId();
+    QCOMPARE(ids.size(), 3);
+    QVERIFY(!tree_node.MatchIntegerProperty("id", list_node.GetId()));
+    QVERIFY(row_node.MatchIntegerProperty("id", row_node.GetId()));
+}
+
+void tst_qtnode::test_QTreeView_indices_are_nested()
+{
+    testModel = std::make_shared<QStandardItemModel>();
+    QStandardItem *projects = new QStandardItem("Projects");
+    projects->appendRow(new QStandardItem("rocketpilot"));
+    projects->appendRow(new QStandardItem("xpathselect"));
+    testModel->appendRow(projects);
+    testModel->appendRow(new QStandardItem("Documents"));
+    treeView = std::make_shared<QTreeView>();
+    treeView->setModel(testModel.get());
+
+    QObjectNode::Ptr node = NodeArena::Create()->Make<QObjectNode>(treeView.get(), DBusNode::Ptr());
+    QCOMPARE((int)xpathselect::SelectNodes(node, "/QTreeView/QModelIndex").size(), 2);
+    QCOMPARE((int)xpathselect::SelectNodes(node, "/QTreeView/QModelIndex[text=\"Projects\"]/QModelIndex").size(), 2);
+    QCOMPARE((int)xpathselect::SelectNodes(node, "/QTreeView/QModelIndex[text=\"Documents\"]/QModelIndex").size(), 0);
+    QCOMPARE((int)xpathselect::SelectNodes(node, "//QModelIndex").size(), 4);
+
+    xpathselect::NodeVector found = xpathselect::SelectNodes(node, "//QModelIndex[text=\"xpathselect\"]");
+    QCOMPARE((int)found.size(), 1);
+    QCOMPARE(found[0]->GetPath(), std::string("/QTreeView/QModelIndex/QModelIndex"));
+}
+
+void tst_qtnode::test_QTreeView_child_steps_read_only_the_children()
+{
+    // Two top level rows, one of them with a long chain of rows below:
+    const int depth = 200;
+    DataCountingModel model;
+    QStandardItem *item = new QStandardItem("level0");
+    model.appendRow(item);
+    model.appendRow(new QStandardItem("other"));
+    for (int level = 1; level < depth; ++level)
+    {
+        QStandardItem *child = new QStandardItem(QString("level%1").arg(level));
+        item->appendRow(child);
+        item = child;
+    }
+    QTreeView view;
+    view.setModel(&model);
+    QObjectNode::Ptr node = NodeArena::Create()->Make<QObjectNode>(&view, DBusNode::Ptr());
+
+    model.data_calls = 0;
+    QCOMPARE((int)xpathselect::SelectNodes(node, "/QTreeView/QModelIndex[text=\"level0\"]").size(), 1);
+    QVERIFY(model.data_calls < depth);
+
+    // Searches still look below the children:
+    xpathselect::NodeVector found = xpathselect::SelectNodes(node, QString("//QModelIndex[text=\"level%1\"]").arg(depth - 1).toStdString());
+    QCOMPARE((int)found.size(), 1);
+}
+
+void tst_qtnode::test_QmlModelRows_read_the_model()
+{
+    QQmlEngine engine;
+    QQmlComponent component(&engine);
+    component.setData(
+        "import QtQuick 2.0\n"
+        "Item {\n"
+        "    ListView {\n"
+        "        objectName: 'listView'\n"
+        "        height: 10\n"
+        "        model: ListModel { ListElement { name: 'first' } ListElement { name: 'second' } ListElement { name: 'third' } }\n"
+        "        delegate: Item { height: 10 }\n"
+        "    }\n"
+        "    Repeater { objectName: 'repeater'; model: ['a', 'b']; Item {} }\n"
+        "}\n",
+        QUrl());
+    std::unique_ptr<QObject> root(component.create());
+    QVERIFY(root);
+
+    QObject* list_view = root->findChild<QObject*>("listView");
+    QObjectNode::Ptr list_node = NodeArena::Create()->Make<QObjectNode>(list_view, DBusNode::Ptr());
+    QCOMPARE((int)xpathselect::SelectNodes(list_node, "//QmlModelRow").size(), 3);
+    xpathselect::NodeVector found = xpathselect::SelectNodes(list_node, "//QmlModelRow[nameRole=\"third\"]");
+    QCOMPARE((int)found.size(), 1);
+    QVERIFY(found[0]->MatchIntegerProperty("row", 2));
+
+    QObject* repeater = root->findChild<QObject*>("repeater");
+    QObjectNode::Ptr repeater_node = NodeArena::Create()->Make<QObjectNode>(repeater, DBusNode::Ptr());
+    QCOMPARE((int)xpathselect::SelectNodes(repeater_node, "//QmlModelRow[modelData=\"b\"]").size(), 1);
+}
+
+void tst_qtnode::test_QGraphicsItemNodes_follow_the_scene()
+{
+    QGraphicsScene scene(0, 0, 400, 400);
+    QGraphicsRectItem* rect = scene.addRect(10, 10, 50, 50);
+    QGraphicsEllipseItem* child = new QGraphicsEllipseItem(0, 0, 10, 10, rect);
+    scene.addRect(300, 300, 20, 20);
+    scene.addText("text")->setPos(200, 10);
+    QGraphicsView view(&scene);
+    view.resize(500, 500);
+    view.show();
+
+    QObjectNode::Ptr view_node = NodeArena::Create()->Make<QObjectNode>(&view, DBusNode::Ptr());
+    QCOMPARE((int)xpathselect::SelectNodes(view_node, "/QGraphicsView/QGraphicsRectItem").size(), 2);
+    QCOMPARE((int)xpathselect::SelectNodes(view_node, "/QGraphicsView/QGraphicsRectItem/QGraphicsEllipseItem").size(), 1);
+    QCOMPARE((int)xpathselect::SelectNodes(view_node, "//is:QAbstractGraphicsShapeItem").size(), 3);
+    QCOMPARE((int)xpathselect::SelectNodes(view_node, "//QGraphicsTextItem").size(), 1);
+
+    // Queries only get the items that may lead to a match:
+    auto count_items_for = [&view_node](std::string const& name, bool searched) {
+        xpathselect::XPathQueryPart part(name);
+        part.PrepareNodeTest(searched);
+        int count = 0;
+        for (xpathselect::Node::Ptr const& child : view_node->ChildrenFor(part))
+        {
+            if (dynamic_cast<const QGraphicsItemNode*>(child.get()) || child->GetName() == "QGraphicsTextItem")
+                ++count;
+        }
+        return count;
+    };
+    QCOMPARE(count_items_for("QPushButton", true), 0);
+    QCOMPARE(count_items_for("QGraphicsEllipseItem", true), 1);
+    QCOMPARE(count_items_for("QGraphicsEllipseItem", false), 0);
+    QCOMPARE(count_items_for("*", true), 3);
+
+    // Only the items in the region, top-most first, with their parents:
+    xpathselect::NodeVector in_rect;
+    GetGraphicsItemNodesIn(view_node, &view, GetGraphicsItemGlobalRect(child, &view), in_rect);
+    QCOMPARE((int)in_rect.size(), 2);
+    QCOMPARE(in_rect[0]->GetPath(), std::string("/QGraphicsView/QGraphicsRectItem/QGraphicsEllipseItem"));
+    QCOMPARE(in_rect[1]->GetPath(), std::string("/QGraphicsView/QGraphicsRectItem"));
+    QVERIFY(in_rect[0]->GetParent() == in_rect[1]);
+
+    // Searches reach items deep below the top level:
+    QGraphicsItem* parent_item = child;
+    for (int level = 0; level < 50; ++level)
+        parent_item = new QGraphicsRectItem(0, 0, 1, 1, parent_item);
+    new QGraphicsLineItem(0, 0, 1, 1, parent_item);
+    QCOMPARE((int)xpathselect::SelectNodes(view_node, "//QGraphicsLineItem").size(), 1);
+}
+
+void tst_qtnode::test_RTree_finds_the_same_as_a_full_scan()
+{
+    // The tree only compares pointers, the objects are never looked at:
+    const int object_count = 500;
+    QObject objects[object_count];
+    QHash<QObject*, QRect> rects;
+    RTree tree;
+    qsrand(42);
+    for (int i = 0; i < 5000; ++i)
+    {
+        QObject* object = &objects[qrand() % object_count];
+        if (rects.contains(object))
+        {
+            QVERIFY(tree.Remove(rects.take(object), object));
+            continue;
+        }
+        QRect rect(qrand() % 1000, qrand() % 1000, qrand() % 100, qrand() % 100);
+        tree.Insert(rect, object);
+        if (!rect.isEmpty())
+            rects.insert(object, rect);
+
+        if (i % 50 == 0)
+        {
+            QCOMPARE(tree.Size(), rects.size());
+            QRect area(qrand() % 1000, qrand() % 1000, qrand() % 300, qrand() % 300);
+            QList<QObject*> found;
+            tree.Search(area, found);
+            QSet<QObject*> expected;
+            for (auto rect = rects.constBegin(); rect != rects.constEnd(); ++rect)
+            {
+                if (rect->intersects(area))
+                    expected.insert(rect.key());
+            }
+            QCOMPARE(found.size(), expected.size());
+            QCOMPARE(found.toSet(), expected);
+        }
+    }
+
+    QObject unknown;
+    QVERIFY(!tree.Remove(QRect(0, 0, 10, 10), &unknown));
+}
@@ -21,14 +21,30 @@
 #include <memory>
 
 #include <QObject>
+#include <QStandardItemModel>
 
-class QStandardItemModel;
-class QStandardItemModel;
 class QTreeWidget;
 class QListView;
 class QTreeView;
 class QTableWidget;
 
+/// Counts how often its data is read.
+class DataCountingModel : public QStandardItemModel
+{
+    Q_OBJECT
+
+public:
+    DataCountingModel() : data_calls(0) {}
+
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const
+    {
+        ++data_calls;
+        return QStandardItemModel::data(index, role);
+    }
+
+    mutable int data_calls;
+};
+
 class tst_qtnode: public QObject
 {
     Q_OBJECT
@@ -69,6 +85,29 @@ private slots:
     void test_CollectSpecialChildren_QTableWidget_collects_all_data();
     void test_CollectSpecialChildren_QTableWidget_collects_all();
     void test_CollectSpecialChildren_QObject_collects_nothing();
+
+    void test_NodeTypeRegistry_resolves_most_derived_handlers();
+    void test_NodeTypeRegistry_custom_children_provider();
+
+    void test_GetNameHash_matches_name();
+    void test_NodeArena_keeps_parents_alive();
+    void test_NodeArena_one_arena_per_query();
+    void test_NodeCache_reuses_children_until_tree_changes();
+    void test_NodeCache_keeps_no_arena_alive();
+
+    void test_IsOfType_matches_base_classes();
+
+    void test_ChildrenFor_skips_data_children_that_cannot_match();
+    void test_Children_property_names_data_children_once();
+    void test_Children_property_leaves_out_missing_data_children();
+    void test_ChildrenFor_evaluates_role_predicates_on_the_model();
+    void test_ModelCache_ids_follow_the_item();
+    void test_ModelCache_ids_differ_between_views();
+    void test_QTreeView_indices_are_nested();
+    void test_QTreeView_child_steps_read_only_the_children();
+    void test_QmlModelRows_read_the_model();
+    void test_QGraphicsItemNodes_follow_the_scene();
+    void test_RTree_finds_the_same_as_a_full_scan();
 private:
     std::shared_ptr<QStandardItemModel> testModel;
     std::shared_ptr<QTreeWidget> treeWidget;
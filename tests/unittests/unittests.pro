@@ -3,13 +3,12 @@
 CONFIG += testcase
 TARGET = tst_libautopilot-qt
 
-QT += testlib dbus widgets quick quickwidgets
+QT += testlib dbus widgets quick quickwidgets core-private quick-private
 
 CONFIG += link_pkgconfig debug
 
-unix:!macx {
-    PKGCONFIG += xpathselect
-}
+INCLUDEPATH += ../../3rdparty
+LIBS += ../../3rdparty/libxpathselect.a
 
 QMAKE_CXXFLAGS += -std=c++0x -Wl,--no-undefined
 
@@ -23,11 +22,35 @@ SOURCES += \
 	tst_introspection.cpp \
     ../../driver/introspection.cpp \
     ../../driver/rootnode.cpp \
-    ../../driver/qtnode.cpp
+    ../../driver/qtnode.cpp \
+    ../../driver/fastproperties.cpp \
+    ../../driver/propertyprofiler.cpp \
+    ../../driver/propertyrecord.cpp \
+    ../../driver/binarystate.cpp \
+    ../../driver/sealedmemfd.cpp \
+    ../../driver/nodetyperegistry.cpp \
+    ../../driver/nodearena.cpp \
+    ../../driver/nodecache.cpp \
+    ../../driver/modelcache.cpp \
+    ../../driver/objectindex.cpp \
+    ../../driver/spatialindex.cpp \
+    ../../driver/threadbatches.cpp
 
 HEADERS += \
     tst_qtnode.h \
     tst_introspection.h \
     ../../driver/introspection.h \
     ../../driver/rootnode.h \
-    ../../driver/qtnode.h
+    ../../driver/qtnode.h \
+    ../../driver/fastproperties.h \
+    ../../driver/propertyprofiler.h \
+    ../../driver/propertyrecord.h \
+    ../../driver/binarystate.h \
+    ../../driver/sealedmemfd.h \
+    ../../driver/nodetyperegistry.h \
+    ../../driver/nodearena.h \
+    ../../driver/nodecache.h \
+    ../../driver/modelcache.h \
+    ../../driver/objectindex.h \
+    ../../driver/spatialindex.h \
+    ../../driver/threadbatches.h